@@ -0,0 +1,167 @@
+/* bench-baseline.c
+ *
+ * This file stores benchmark results as a baseline, and compares
+ * later results against it, for "make perfcheck".
+ *
+ * The baseline is JSON with one scenario to a line, so that it reads
+ * well in a diff. It's read back a line at a time rather than with a
+ * real JSON parser, so keep to that layout when editing it by hand.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "bench-baseline.h"
+
+#define SUMMARY_FORMAT "{\"name\": \"%s\", \"ops\": %ld, \"median_ns\": %lld, " \
+	"\"mad_ns\": %lld, \"peak_rss_kb\": %ld, \"allocs\": %ld, \"bytes\": %lld}"
+#define SUMMARY_SCAN " {\"name\": \"%31[^\"]\", \"ops\": %ld, \"median_ns\": %lld, " \
+	"\"mad_ns\": %lld, \"peak_rss_kb\": %ld, \"allocs\": %ld, \"bytes\": %lld}"
+
+/* Memory use that goes up by less than this (in KiB) isn't worth
+ * mentioning, whatever the percentage. */
+#define RSS_SLACK 1024
+
+int WriteBaseline(const char* File, const struct BenchSummary* Summaries,
+		  int Count)
+{
+	FILE* Out = fopen(File, "w");
+	int i;
+
+	if (!Out)
+	{
+		fprintf(stderr, "Unable to write %s.\n", File);
+		return 0;
+	}
+
+	fprintf(Out, "{\n\"format\": 1,\n\"scenarios\": [\n");
+	for (i = 0; i < Count; i++)
+	{
+		const struct BenchSummary* S = &Summaries[i];
+		fprintf(Out, SUMMARY_FORMAT "%s\n", S->Name, S->Ops, S->Median,
+			S->MAD, S->PeakRSS, S->Allocs, S->Bytes,
+			i + 1 < Count ? "," : "");
+	}
+	fprintf(Out, "]\n}\n");
+
+	if (fclose(Out) != 0)
+	{
+		fprintf(stderr, "Unable to write %s.\n", File);
+		return 0;
+	}
+	return 1;
+}
+
+struct BenchSummary* ReadBaseline(const char* File, int* Count)
+{
+	struct BenchSummary* Summaries = NULL;
+	struct BenchSummary S;
+	int Allocated = 0;
+	char Line[512];
+	FILE* In = fopen(File, "r");
+
+	*Count = 0;
+	if (!In)
+	{
+		fprintf(stderr, "Unable to read %s.\n", File);
+		return NULL;
+	}
+
+	while (fgets(Line, sizeof(Line), In))
+	{
+		if (!strstr(Line, "\"name\""))
+			continue;
+		if (sscanf(Line, SUMMARY_SCAN, S.Name, &S.Ops, &S.Median, &S.MAD,
+			   &S.PeakRSS, &S.Allocs, &S.Bytes) != 7)
+		{
+			fprintf(stderr, "Unable to understand %s: %s", File, Line);
+			continue;
+		}
+		if (*Count == Allocated)
+		{
+			Allocated = Allocated ? Allocated * 2 : 16;
+			struct BenchSummary* Grown = (struct BenchSummary*)
+				realloc(Summaries, Allocated * sizeof(S));
+			if (!Grown)
+			{
+				fprintf(stderr, "Out of memory\n");
+				break;
+			}
+			Summaries = Grown;
+		}
+		Summaries[(*Count)++] = S;
+	}
+
+	fclose(In);
+	if (!*Count)
+	{
+		free(Summaries);
+		return NULL;
+	}
+	return Summaries;
+}
+
+const struct BenchSummary* FindSummary(const struct BenchSummary* Summaries,
+		int Count, const char* Name)
+{
+	int i;
+	for (i = 0; i < Count; i++)
+	{
+		if (strcmp(Summaries[i].Name, Name) == 0)
+			return &Summaries[i];
+	}
+	return NULL;
+}
+
+static double Change(double Now, double Base)
+{
+	return Base > 0 ? (Now - Base) * 100.0 / Base : 0.0;
+}
+
+int CompareSummary(const struct BenchSummary* Now,
+		   const struct BenchSummary* Base, double Threshold, FILE* Out)
+{
+	if (Now->Ops != Base->Ops)
+	{
+		fprintf(Out, "%-16s does %ld ops, but the baseline did %ld; "
+			"make a new baseline\n", Now->Name, Now->Ops, Base->Ops);
+		return 0;
+	}
+
+	double Time = Change(Now->Median, Base->Median);
+	double Rss = Change(Now->PeakRSS, Base->PeakRSS);
+	double Allocs = Change(Now->Allocs, Base->Allocs);
+
+	/* A slower run only counts if it's also well outside the noise
+	 * seen when the baseline was made. */
+	int SlowerTime = Time > Threshold &&
+		Now->Median - Base->Median > 3 * Base->MAD;
+	int MoreRss = Rss > Threshold && Now->PeakRSS - Base->PeakRSS > RSS_SLACK;
+	int MoreAllocs = Allocs > Threshold;
+
+	fprintf(Out, "%-16s time %+7.1f%%  rss %+7.1f%%  allocs %+7.1f%%  %s%s%s%s\n",
+		Now->Name, Time, Rss, Allocs,
+		SlowerTime || MoreRss || MoreAllocs ? "REGRESSED" : "ok",
+		SlowerTime ? " (time)" : "", MoreRss ? " (rss)" : "",
+		MoreAllocs ? " (allocs)" : "");
+
+	return !SlowerTime && !MoreRss && !MoreAllocs;
+}
@@ -0,0 +1,50 @@
+/* bench-baseline.h
+ *
+ * This file contains the prototypes for the benchmark baselines
+ * in bench-baseline.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* What a number of runs of one benchmark scenario came to. */
+struct BenchSummary {
+	char Name[32];
+	long Ops;          /* Things done in each run. */
+	long long Median;  /* Median time of a run, in nanoseconds, */
+	long long MAD;     /* and the median distance from that. */
+	long PeakRSS;      /* Most memory used by any run, in KiB. */
+	long Allocs;       /* Median number of allocations in a run. */
+	long long Bytes;   /* Size of the data in each run, or 0. */
+};
+
+/* Writes Count summaries to File as JSON. Returns 0 on failure. */
+int WriteBaseline(const char* File, const struct BenchSummary* Summaries,
+		  int Count);
+
+/* Reads the summaries written by WriteBaseline. Sets Count to the
+ * number read, and returns them (free them), or NULL on failure. */
+struct BenchSummary* ReadBaseline(const char* File, int* Count);
+
+/* Returns the summary called Name, or NULL. */
+const struct BenchSummary* FindSummary(const struct BenchSummary* Summaries,
+		int Count, const char* Name);
+
+/* Prints how Now compares with Base to Out. Returns 0 if the time,
+ * memory use or allocations got more than Threshold percent worse. */
+int CompareSummary(const struct BenchSummary* Now,
+		   const struct BenchSummary* Base, double Threshold, FILE* Out);
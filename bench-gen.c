@@ -0,0 +1,182 @@
+/* bench-gen.c
+ *
+ * This file generates the GPX tracks and JPEG files used by the
+ * benchmarks. Everything is made from a seed, so the same data
+ * comes out every time, on every machine.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench-gen.h"
+
+unsigned long BenchRandom(unsigned long long* State)
+{
+	/* Knuth's MMIX LCG; the top bits are good enough for this. */
+	*State = *State * 6364136223846793005ULL + 1442695040888963407ULL;
+	return (unsigned long)(*State >> 33);
+}
+
+int WriteBenchGPX(const char* File, long Points, long SegmentEvery,
+		  time_t Start, int Interval, unsigned long Seed)
+{
+	unsigned long long State = Seed;
+	double Lat = -31.95, Long = 115.86, Elev = 20.0;
+	char Time[32];
+	struct tm Tm;
+	long i;
+
+	FILE* Out = fopen(File, "w");
+	if (!Out)
+	{
+		fprintf(stderr, "Unable to create %s.\n", File);
+		return 0;
+	}
+
+	fputs("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+	      "<gpx version=\"1.1\" creator=\"gpscorrelate-bench\" "
+	      "xmlns=\"http://www.topografix.com/GPX/1/1\">\n"
+	      "<trk><trkseg>\n", Out);
+	for (i = 0; i < Points; i++)
+	{
+		if (SegmentEvery && i && i % SegmentEvery == 0)
+			fputs("</trkseg><trkseg>\n", Out);
+
+		/* Wander about a little. */
+		Lat  += ((long)(BenchRandom(&State) % 2001) - 1000) * 1e-7;
+		Long += ((long)(BenchRandom(&State) % 2001) - 1000) * 1e-7;
+		Elev += ((long)(BenchRandom(&State) % 201) - 100) * 1e-2;
+
+		time_t PointTime = Start + (time_t)i * Interval;
+		gmtime_r(&PointTime, &Tm);
+		strftime(Time, sizeof(Time), "%Y-%m-%dT%H:%M:%SZ", &Tm);
+		fprintf(Out, "<trkpt lat=\"%.6f\" lon=\"%.6f\"><ele>%.1f</ele>"
+			"<time>%s</time></trkpt>\n", Lat, Long, Elev, Time);
+	}
+	fputs("</trkseg></trk>\n</gpx>\n", Out);
+
+	if (fclose(Out) != 0)
+	{
+		fprintf(stderr, "Unable to write %s.\n", File);
+		return 0;
+	}
+	return 1;
+}
+
+void FormatExifTime(time_t Time, char* Buffer)
+{
+	struct tm Tm;
+	gmtime_r(&Time, &Tm);
+	strftime(Buffer, 20, "%Y:%m:%d %H:%M:%S", &Tm);
+}
+
+static void Put16(unsigned char* Where, unsigned Value)
+{
+	/* Little endian, as the TIFF header says. */
+	Where[0] = Value & 0xFF;
+	Where[1] = (Value >> 8) & 0xFF;
+}
+
+static void Put32(unsigned char* Where, unsigned long Value)
+{
+	Put16(Where, Value & 0xFFFF);
+	Put16(Where + 2, (Value >> 16) & 0xFFFF);
+}
+
+int WriteBenchJPEG(const char* File, time_t PhotoTime, long Size)
+{
+	/* The EXIF data is a TIFF structure holding IFD0, which only
+	 * points to the Exif IFD, which only holds DateTimeOriginal. */
+	unsigned char Tiff[64];
+	memset(Tiff, 0, sizeof(Tiff));
+	memcpy(Tiff, "II*\0", 4);
+	Put32(Tiff + 4, 8);          /* IFD0 offset */
+	Put16(Tiff + 8, 1);          /* IFD0: one entry */
+	Put16(Tiff + 10, 0x8769);    /* ExifIFDPointer */
+	Put16(Tiff + 12, 4);         /* LONG */
+	Put32(Tiff + 14, 1);
+	Put32(Tiff + 18, 26);
+	Put32(Tiff + 22, 0);         /* No IFD1 */
+	Put16(Tiff + 26, 1);         /* Exif IFD: one entry */
+	Put16(Tiff + 28, 0x9003);    /* DateTimeOriginal */
+	Put16(Tiff + 30, 2);         /* ASCII */
+	Put32(Tiff + 32, 20);
+	Put32(Tiff + 36, 44);
+	Put32(Tiff + 40, 0);
+	FormatExifTime(PhotoTime, (char*)Tiff + 44);
+
+	FILE* Out = fopen(File, "wb");
+	if (!Out)
+	{
+		fprintf(stderr, "Unable to create %s.\n", File);
+		return 0;
+	}
+
+	static const unsigned char Soi[] = { 0xFF, 0xD8 };
+	unsigned char App1[10];
+	App1[0] = 0xFF;
+	App1[1] = 0xE1;
+	App1[2] = (2 + 6 + sizeof(Tiff)) >> 8;
+	App1[3] = (2 + 6 + sizeof(Tiff)) & 0xFF;
+	memcpy(App1 + 4, "Exif\0\0", 6);
+	/* A 1x1 greyscale frame header and a scan header, so that the
+	 * file looks like a JPEG to anything that checks. */
+	static const unsigned char Sof[] = {
+		0xFF, 0xC0, 0x00, 0x0B, 0x08, 0x00, 0x01, 0x00, 0x01,
+		0x01, 0x01, 0x11, 0x00
+	};
+	static const unsigned char Sos[] = {
+		0xFF, 0xDA, 0x00, 0x08, 0x01, 0x01, 0x00, 0x00, 0x3F, 0x00
+	};
+	static const unsigned char Eoi[] = { 0xFF, 0xD9 };
+
+	fwrite(Soi, sizeof(Soi), 1, Out);
+	fwrite(App1, sizeof(App1), 1, Out);
+	fwrite(Tiff, sizeof(Tiff), 1, Out);
+	fwrite(Sof, sizeof(Sof), 1, Out);
+	fwrite(Sos, sizeof(Sos), 1, Out);
+
+	/* Pad it out to size with "scan data", which must not contain
+	 * 0xFF. It's the same for every file, as it doesn't matter. */
+	long Written = sizeof(Soi) + sizeof(App1) + sizeof(Tiff) +
+		sizeof(Sof) + sizeof(Sos) + sizeof(Eoi);
+	unsigned char Filler[4096];
+	long i;
+	for (i = 0; i < (long)sizeof(Filler); i++)
+		Filler[i] = (unsigned char)(i % 0xFF);
+	while (Written < Size)
+	{
+		long Chunk = Size - Written;
+		if (Chunk > (long)sizeof(Filler))
+			Chunk = sizeof(Filler);
+		fwrite(Filler, Chunk, 1, Out);
+		Written += Chunk;
+	}
+	fwrite(Eoi, sizeof(Eoi), 1, Out);
+
+	if (fclose(Out) != 0)
+	{
+		fprintf(stderr, "Unable to write %s.\n", File);
+		return 0;
+	}
+	return 1;
+}
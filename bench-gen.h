@@ -0,0 +1,41 @@
+/* bench-gen.h
+ *
+ * This file contains the prototypes for the benchmark data
+ * generators in bench-gen.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A small random number generator that gives the same numbers on
+ * every machine for the same seed. */
+unsigned long BenchRandom(unsigned long long* State);
+
+/* Writes a GPX file with one track of Points points, Interval seconds
+ * apart from Start, wandering about from Seed. A new track segment is
+ * started every SegmentEvery points, if that's not 0. Returns 0 on
+ * failure. */
+int WriteBenchGPX(const char* File, long Points, long SegmentEvery,
+		  time_t Start, int Interval, unsigned long Seed);
+
+/* Writes a JPEG file of about Size bytes holding just enough EXIF
+ * data to say it was taken at PhotoTime (with no GPS data). It
+ * isn't a picture of anything. Returns 0 on failure. */
+int WriteBenchJPEG(const char* File, time_t PhotoTime, long Size);
+
+/* Formats Time as EXIF does, into a buffer of at least 20 bytes. */
+void FormatExifTime(time_t Time, char* Buffer);
@@ -32,8 +32,10 @@
 
 #include "gpsstructure.h"
 #include "exif-gps.h"
+#include "photo-cache.h"
 #include "correlate.h"
 #include "unixtime.h"
+#include "stats.h"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 
@@ -43,51 +45,27 @@ static void Round(const struct GPSPoint* First, struct GPSPoint* Result,
 static void Interpolate(const struct GPSPoint* First, struct GPSPoint* Result,
 			time_t PhotoTime);
 
-/* This function returns a GPSPoint with the point selected for the
- * file. This allows us to do funky stuff like not actually write
- * the files - ie, just correlate and keep into memory... */
-
-struct GPSPoint* CorrelatePhoto(const char* Filename,
+struct GPSPoint* CorrelateTime(const char* TimeTemp,
 		struct CorrelateOptions* Options)
 {
-	/* Read out the timestamp from the EXIF data. */
-	char* TimeTemp;
-	int IncludesGPS = 0;
-	TimeTemp = ReadExifDate(Filename, &IncludesGPS);
-	if (!TimeTemp)
-	{
-		/* Error reading the time from the file. Abort. */
-		/* If this was a read error, then a seperate message
-		 * will appear on the console. Otherwise, we were
-		 * returned here due to the lack of exif tags. */
-		Options->Result = CORR_NOEXIFINPUT;
-		return NULL;
-	}
-	if (IncludesGPS)
-	{
-		/* Already have GPS data in the file!
-		 * So we can't do this again... */
-		Options->Result = CORR_GPSDATAEXISTS;
-		free(TimeTemp);
-		return NULL;
-	}
+	/* PhotoTime isn't a true epoch time, but is rather out
+	 * by the local offset from UTC */
+	time_t PhotoTime =
+		ConvertToUnixTime(TimeTemp, EXIF_DATE_FORMAT, 0, 0);
+
 	if (Options->AutoTimeZone)
 	{
 		/* Use the local time zone as of the date of first picture
 		 * as the time for correlating all the remainder. */
 		time_t RealTime;
 
-		/* PhotoTime isn't a true epoch time, but is rather out
-		 * by the local offset from UTC */
-		time_t PhotoTime =
-			ConvertToUnixTime(TimeTemp, EXIF_DATE_FORMAT, 0, 0);
-
 		/* Extract the component time values */
-		struct tm *PhotoTm = gmtime(&PhotoTime);
+		struct tm PhotoTm;
+		BreakDownUTC(PhotoTime, &PhotoTm);
 
 		/* Then create a true epoch-based local time, including DST */
-		PhotoTm->tm_isdst = -1;
-		RealTime = mktime(PhotoTm);
+		PhotoTm.tm_isdst = -1;
+		RealTime = mktime(&PhotoTm);
 
 		/* Finally, RealTime is the proper Epoch time of the photo.
 		 * The difference from PhotoTime is the time zone offset. */
@@ -97,19 +75,24 @@ struct GPSPoint* CorrelatePhoto(const char* Filename,
 	}
 	//printf("Using offset %02d:%02d\n", Options->TimeZoneHours, Options->TimeZoneMins);
 
-	/* Now convert the time into Unixtime. */
-	time_t PhotoTime =
-		ConvertToUnixTime(TimeTemp, EXIF_DATE_FORMAT,
-			Options->TimeZoneHours, Options->TimeZoneMins);
+	return CorrelateLocalTime(PhotoTime, Options);
+}
+
+struct GPSPoint* CorrelateLocalTime(time_t PhotoTime,
+		struct CorrelateOptions* Options)
+{
+	Options->MatchTrack = -1;
+	Options->MatchPoint = -1;
+
+	/* Now convert the time into Unixtime. Note that we SUBTRACT
+	 * the time zone: we want the result to be in UTC. */
+	PhotoTime -= Options->TimeZoneHours * 60 * 60;
+	PhotoTime -= Options->TimeZoneMins * 60;
 
 	/* Add the PhotoOffset time. This is to make the Photo time match
 	 * the GPS time - ie, it is (GPS - Photo). */
 	PhotoTime += Options->PhotoOffset;
 
-	/* Free the memory for the time string - it won't otherwise
-	 * be freed for us. */
-	free(TimeTemp);
-
 	/* Search the list of GPS tracks to find one containing the range
 	 * we're interested in. Options points to an array with the last
 	 * entry denoted by a NULL Points pointer. */
@@ -136,12 +119,38 @@ struct GPSPoint* CorrelatePhoto(const char* Filename,
 	/* Time to run through the list, and see if our PhotoTime
 	 * is in between two points. Alternately, it might be
 	 * exactly on a point... even better... */
-	const struct GPSPoint* Search;
+	const struct GPSTrack* Track = &Options->Track[TrackNum];
+	const struct GPSPoint* Search = Track->Points;
+	int PointNum = 0;
 	struct GPSPoint* Actual = (struct GPSPoint*) malloc(sizeof(struct GPSPoint));
 
 	Options->Result = CORR_NOMATCH; /* For convenience later */
+	Options->MatchTrack = TrackNum;
+
+	/* Every point before the first one at or after the photo time,
+	 * apart from the very last of them, would just be walked past
+	 * below, so start from that one if the track has an index. */
+	if (Track->Index)
+	{
+		long Low = 0, High = Track->NumPoints;
+		while (Low < High)
+		{
+			long Middle = Low + (High - Low) / 2;
+			if (Track->LatestBy[Middle] < PhotoTime)
+				Low = Middle + 1;
+			else
+				High = Middle;
+		}
+		if (Low > 0)
+			Low--;
+		if (Low < Track->NumPoints)
+		{
+			Search = Track->Index[Low];
+			PointNum = Low;
+		}
+	}
 
-	for (Search = Options->Track[TrackNum].Points; Search; Search = Search->Next)
+	for (; Search; Search = Search->Next, PointNum++)
 	{
 		/* First test: is it exactly this point? */
 		if (PhotoTime == Search->Time)
@@ -157,6 +166,7 @@ struct GPSPoint* CorrelatePhoto(const char* Filename,
 			Actual->Time = Search->Time;
 
 			Options->Result = CORR_OK;
+			Options->MatchPoint = PointNum;
 			break;
 		}
 
@@ -209,6 +219,7 @@ struct GPSPoint* CorrelatePhoto(const char* Filename,
 					 * time between two points.
 					 * Abort. */
 					Options->Result = CORR_TOOFAR;
+					Options->MatchPoint = PointNum;
 					free(Actual);
 					return NULL;
 				} 
@@ -229,11 +240,13 @@ struct GPSPoint* CorrelatePhoto(const char* Filename,
 				/* No interpolation. Round. */
 				Round(Search, Actual, PhotoTime);
 				Options->Result = CORR_ROUND;
+				Options->MatchPoint = PointNum;
 				break;
 			} else {
 				/* Interpolate away! */
 				Interpolate(Search, Actual, PhotoTime);
 				Options->Result = CORR_INTERPOLATED;
+				Options->MatchPoint = PointNum;
 				break;
 			}
 		}
@@ -248,28 +261,118 @@ struct GPSPoint* CorrelatePhoto(const char* Filename,
 		return NULL;
 	}
 
+	return Actual;
+}
+
+char* CorrelateRead(const char* Filename, struct CorrelateOptions* Options)
+{
+	long long Started = MonotonicMicros();
+
+	Options->MatchTrack = -1;
+	Options->MatchPoint = -1;
+	Options->ReadMicros = Options->MatchMicros = Options->WriteMicros = 0;
+
+	/* Read out the timestamp from the EXIF data. */
+	char* TimeTemp;
+	int IncludesGPS = 0;
+	TimeTemp = ReadExifDateCached(Options->Cache, Filename, &IncludesGPS);
+	Options->ReadMicros = MonotonicMicros() - Started;
+	if (!TimeTemp)
+	{
+		/* Error reading the time from the file. Abort. */
+		/* If this was a read error, then a seperate message
+		 * will appear on the console. Otherwise, we were
+		 * returned here due to the lack of exif tags. */
+		Options->Result = CORR_NOEXIFINPUT;
+		return NULL;
+	}
+	if (IncludesGPS && !Options->ReplaceGPS)
+	{
+		/* Already have GPS data in the file!
+		 * So we can't do this again... */
+		Options->Result = CORR_GPSDATAEXISTS;
+		free(TimeTemp);
+		return NULL;
+	}
+	return TimeTemp;
+}
+
+struct GPSPoint* CorrelateMatch(char* TimeTemp, struct CorrelateOptions* Options)
+{
+	long long Started = MonotonicMicros();
+
+	long long Began = StatsBegin();
+	struct GPSPoint* Actual = CorrelateTime(TimeTemp, Options);
+	StatsEnd(STATS_TRACK_SEARCH, Began);
+	/* Free the memory for the time string - it won't otherwise
+	 * be freed for us. */
+	free(TimeTemp);
+	Options->MatchMicros = MonotonicMicros() - Started;
+	return Actual;
+}
+
+void CorrelateWrite(const char* Filename, const struct GPSPoint* Actual,
+		struct CorrelateOptions* Options)
+{
 	/* Write the data back into the Exif info. If we're allowed. */
 	if (Options->NoWriteExif)
 	{
 		/* Don't write exif tags. Just return. */
-		return Actual;
-	} else {
-		/* Do write the exif tags. And then return. */
-		if (WriteGPSData(Filename, Actual, Options->Datum, Options->NoChangeMtime, Options->DegMinSecs))
-		{
-			/* All ok. Good! Return. */
-			return Actual;
-		} else {
+		return;
+	}
+
+	/* Do write the exif tags. And then return. */
+	long long Started = MonotonicMicros();
+	int Written = WriteGPSData(Filename, Actual, Options->Datum,
+			Options->NoChangeMtime, Options->DegMinSecs);
+	Options->WriteMicros = MonotonicMicros() - Started;
+	switch (Written)
+	{
+		case 0:
 			/* Not good. Return point, but note failure. */
 			Options->Result = CORR_EXIFWRITEFAIL;
-			return Actual;
-		}
+			break;
+		case GPS_WRITE_UNCHANGED:
+			/* Already there. Nothing needed writing. */
+			Options->Result = CORR_UNCHANGED;
+			break;
+		default:
+			/* All ok. Good! */
+			break;
 	}
-	
-	/* Looks like nothing matched. Free the prepared memory,
-	 * and return nothing. */
-	free(Actual);
-	return NULL;
+}
+
+/* Reads, matches and writes one photo, for CorrelatePhoto. */
+static struct GPSPoint* CorrelateSteps(const char* Filename,
+		struct CorrelateOptions* Options)
+{
+	char* TimeTemp = CorrelateRead(Filename, Options);
+	if (!TimeTemp)
+	{
+		return NULL;
+	}
+
+	struct GPSPoint* Actual = CorrelateMatch(TimeTemp, Options);
+	if (!Actual)
+	{
+		return NULL;
+	}
+
+	CorrelateWrite(Filename, Actual, Options);
+	return Actual;
+}
+
+/* This function returns a GPSPoint with the point selected for the
+ * file. This allows us to do funky stuff like not actually write
+ * the files - ie, just correlate and keep into memory... */
+
+struct GPSPoint* CorrelatePhoto(const char* Filename,
+		struct CorrelateOptions* Options)
+{
+	long long Began = StatsBegin();
+	struct GPSPoint* Actual = CorrelateSteps(Filename, Options);
+	StatsEndFile(STATS_PHOTO, Began, Filename);
+	return Actual;
 }
 
 void Round(const struct GPSPoint* First, struct GPSPoint* Result,
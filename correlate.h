@@ -25,6 +25,10 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
  */
 
+#include <sys/types.h>
+
+struct PhotoCache;
+
 /* A structure of options to pass to the correlate function.
  * Not really sure if this is needed, but... */
 struct CorrelateOptions {
@@ -38,6 +42,7 @@ struct CorrelateOptions {
 	char* Datum;     /* Datum of the data; when writing. */
 	int DoBetweenTrkSeg; /* Match between track segments. */
 	int DegMinSecs;   /* Write out data as DD MM SS.SS (more accurate than in the past) */
+	int ReplaceGPS;   /* Replace any GPS data already in the photo. */
 	
 	int Result;
 
@@ -47,6 +52,17 @@ struct CorrelateOptions {
 
 	struct GPSTrack *Track; /* Pointer to array of tracks to use. The last
 				   track must be entirely zeros. */
+
+	struct PhotoCache *Cache; /* Photo metadata cache, or NULL to always
+				     read the photos. */
+
+	/* Filled in by CorrelatePhoto, for reporting. */
+	int MatchTrack;   /* Index of the track matched against, or -1. */
+	int MatchPoint;   /* Index in that track of the point at or just
+			     before the photo, or -1. */
+	long ReadMicros;  /* Time taken to read the photo, */
+	long MatchMicros; /* find its position */
+	long WriteMicros; /* and write it, in microseconds. */
 };
 
 /* Return codes in order:
@@ -62,8 +78,10 @@ struct CorrelateOptions {
  * _NOEXIFINPUT - The source file contained no EXIF tags, or not the one we wanted. Hmm.
  *      Returns NULL for Point.
  * _GPSDATAEXISTS - There is already GPS data in the photo... you probably don't want
- *      to fiddle with it.
+ *      to fiddle with it. (Unless ReplaceGPS is set.)
  *      Returns NULL for Point.
+ * _UNCHANGED - matched, but the photo already had exactly that data, so it
+ *      wasn't written again.
  */
 #define CORR_OK             1
 #define CORR_INTERPOLATED   2
@@ -73,7 +91,35 @@ struct CorrelateOptions {
 #define CORR_EXIFWRITEFAIL  6
 #define CORR_NOEXIFINPUT    7
 #define CORR_GPSDATAEXISTS  8
+#define CORR_UNCHANGED      9
 
 
 struct GPSPoint* CorrelatePhoto(const char* Filename, 
 		struct CorrelateOptions* Options);
+
+/* CorrelatePhoto in its three steps, so that each can be given its own
+ * threads. CorrelateRead returns the photo's EXIF time, or NULL with
+ * Result set if the photo goes no further. CorrelateMatch takes that
+ * time, and frees it, returning what CorrelatePhoto would. If there's
+ * a point, CorrelateWrite then writes it to the photo, unless
+ * NoWriteExif is set, updating Result. */
+char* CorrelateRead(const char* Filename, struct CorrelateOptions* Options);
+struct GPSPoint* CorrelateMatch(char* ExifTime,
+		struct CorrelateOptions* Options);
+void CorrelateWrite(const char* Filename, const struct GPSPoint* Point,
+		struct CorrelateOptions* Options);
+
+/* The matching part of CorrelatePhoto on its own: finds the point for
+ * a photo taken at ExifTime (in EXIF_DATE_FORMAT), setting Result and
+ * the track and point indexes. Reads and writes no files. Returns NULL
+ * if there's no match. */
+struct GPSPoint* CorrelateTime(const char* ExifTime,
+		struct CorrelateOptions* Options);
+
+/* CorrelateTime, for a photo whose EXIF time has already been read
+ * as though it were UTC (ConvertToUnixTime with no time zone). The
+ * time zone in Options is applied, but not worked out: AutoTimeZone
+ * is ignored. Nothing is parsed, so it's quick enough to run over a
+ * whole list of photos again each time the time zone is changed. */
+struct GPSPoint* CorrelateLocalTime(time_t LocalTime,
+		struct CorrelateOptions* Options);
@@ -0,0 +1,361 @@
+/* dirwalk.c
+ *
+ * This file contains the directory walker used by --recursive.
+ *
+ * A few threads read directories at once, which keeps a slow disk
+ * or a network filesystem busy, and pass the photos they find into
+ * a small queue. Correlation takes them out of the queue as it goes,
+ * so it starts on the first photo while the walk is still running,
+ * and a huge tree never has to be held in memory all at once.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "i18n.h"
+#include "trace.h"
+#include "dirwalk.h"
+
+#define WALK_MAX_THREADS 8
+#define WALK_QUEUE       256 /* Photos found but not yet handed out. */
+
+struct PendingDir {
+	char* Path;
+	struct PendingDir* Next;
+};
+
+struct DirWalker {
+	pthread_mutex_t Lock;
+	pthread_cond_t WorkReady;  /* A directory was queued, or the walk ended. */
+	pthread_cond_t NotFull;    /* Room in Found. */
+	pthread_cond_t NotEmpty;   /* Something in Found, or the walk ended. */
+
+	struct PendingDir* Dirs;   /* Directories waiting to be read. */
+	int Busy;                  /* Directories being read right now. */
+	int Finished;
+	int Stop;
+
+	char* Found[WALK_QUEUE];   /* Ring of photos found. */
+	int Head;
+	int Count;
+	char* Current;             /* Last one handed out. */
+
+	pthread_t* Threads;
+	int NumThreads;
+};
+
+/* Image types that Exiv2 can write GPS tags into. */
+static const char* const PhotoExtensions[] = {
+	"jpg", "jpeg", "jpe", "tif", "tiff", "dng", "nef", "nrw", "cr2",
+	"orf", "pef", "arw", "sr2", "srw", "rw2", "raf", "png", NULL
+};
+
+int LooksLikePhoto(const char* File)
+{
+	/* Check the name first; it costs nothing. */
+	const char* Dot = strrchr(File, '.');
+	const char* const* Ext;
+	if (!Dot || strchr(Dot, '/'))
+		return 0;
+	for (Ext = PhotoExtensions; *Ext; Ext++)
+	{
+		if (strcasecmp(Dot + 1, *Ext) == 0)
+			break;
+	}
+	if (!*Ext)
+		return 0;
+
+	/* Then make sure it really starts like one. */
+	unsigned char Magic[8];
+	int Fd = open(File, O_RDONLY);
+	if (Fd < 0)
+		return 0;
+	ssize_t Got = read(Fd, Magic, sizeof(Magic));
+	close(Fd);
+	if (Got < 2)
+		return 0;
+
+	/* JPEG */
+	if (Magic[0] == 0xFF && Magic[1] == 0xD8)
+		return 1;
+	if (Got < 4)
+		return 0;
+	/* TIFF, and the raw formats built on it (Olympus and
+	 * Panasonic bend the header a little). */
+	if (memcmp(Magic, "II*\0", 4) == 0 || memcmp(Magic, "MM\0*", 4) == 0 ||
+	    memcmp(Magic, "IIRO", 4) == 0 || memcmp(Magic, "IIRS", 4) == 0 ||
+	    memcmp(Magic, "MMOR", 4) == 0 || memcmp(Magic, "IIU\0", 4) == 0)
+		return 1;
+	/* Fuji */
+	if (Got == sizeof(Magic) && memcmp(Magic, "FUJIFILM", 8) == 0)
+		return 1;
+	/* PNG */
+	if (memcmp(Magic, "\x89PNG", 4) == 0)
+		return 1;
+	return 0;
+}
+
+/* Queues a directory to be read. Called with the lock held. */
+static int QueueDir(struct DirWalker* Walker, char* Path)
+{
+	struct PendingDir* Dir = (struct PendingDir*) malloc(sizeof(*Dir));
+	if (!Dir)
+	{
+		free(Path);
+		return 0;
+	}
+	Dir->Path = Path;
+	Dir->Next = Walker->Dirs;
+	Walker->Dirs = Dir;
+	pthread_cond_signal(&Walker->WorkReady);
+	return 1;
+}
+
+/* Hands a photo over to the reader, waiting for room if need be.
+ * Takes ownership of Path. Returns 0 if the walk has been stopped. */
+static int AddFound(struct DirWalker* Walker, char* Path)
+{
+	pthread_mutex_lock(&Walker->Lock);
+	while (Walker->Count == WALK_QUEUE && !Walker->Stop)
+		pthread_cond_wait(&Walker->NotFull, &Walker->Lock);
+	int Stopped = Walker->Stop;
+	if (Stopped)
+	{
+		free(Path);
+	} else {
+		Walker->Found[(Walker->Head + Walker->Count) % WALK_QUEUE] = Path;
+		Walker->Count++;
+		pthread_cond_signal(&Walker->NotEmpty);
+	}
+	pthread_mutex_unlock(&Walker->Lock);
+	return !Stopped;
+}
+
+static void ReadDir(struct DirWalker* Walker, const char* Path)
+{
+	DIR* Dir = opendir(Path);
+	struct dirent* Entry;
+	size_t PathLength = strlen(Path);
+
+	if (!Dir)
+	{
+		fprintf(stderr, _("Unable to read directory %s.\n"), Path);
+		return;
+	}
+
+	while ((Entry = readdir(Dir)))
+	{
+		if (strcmp(Entry->d_name, ".") == 0 || strcmp(Entry->d_name, "..") == 0)
+			continue;
+
+		char* Full = (char*) malloc(PathLength + strlen(Entry->d_name) + 2);
+		if (!Full)
+			break;
+		if (PathLength && Path[PathLength - 1] == '/')
+			sprintf(Full, "%s%s", Path, Entry->d_name);
+		else
+			sprintf(Full, "%s/%s", Path, Entry->d_name);
+
+		/* Most filesystems say what the entry is, which saves a
+		 * stat() for each one. Symbolic links to directories aren't
+		 * followed, so that a loop can't send us round forever. */
+		int IsDir = 0, IsFile = 0;
+		struct stat Info;
+#ifdef DT_DIR
+		if (Entry->d_type == DT_DIR)
+			IsDir = 1;
+		else if (Entry->d_type == DT_REG)
+			IsFile = 1;
+		else if (Entry->d_type == DT_LNK)
+			IsFile = (stat(Full, &Info) == 0 && S_ISREG(Info.st_mode));
+		else if (Entry->d_type == DT_UNKNOWN)
+#endif
+		{
+			if (lstat(Full, &Info) == 0)
+			{
+				IsDir = S_ISDIR(Info.st_mode);
+				IsFile = S_ISREG(Info.st_mode) ||
+					(S_ISLNK(Info.st_mode) && stat(Full, &Info) == 0 &&
+					 S_ISREG(Info.st_mode));
+			}
+		}
+
+		if (IsDir)
+		{
+			pthread_mutex_lock(&Walker->Lock);
+			QueueDir(Walker, Full);
+			pthread_mutex_unlock(&Walker->Lock);
+		} else if (IsFile && LooksLikePhoto(Full)) {
+			if (!AddFound(Walker, Full))
+				break;
+		} else {
+			free(Full);
+		}
+	}
+
+	closedir(Dir);
+}
+
+static void* WalkThread(void* Data)
+{
+	struct DirWalker* Walker = (struct DirWalker*) Data;
+
+	TraceThreadName("walker");
+	pthread_mutex_lock(&Walker->Lock);
+	for (;;)
+	{
+		while (!Walker->Dirs && Walker->Busy && !Walker->Stop)
+			pthread_cond_wait(&Walker->WorkReady, &Walker->Lock);
+		if (Walker->Stop || !Walker->Dirs)
+			break;
+
+		struct PendingDir* Dir = Walker->Dirs;
+		Walker->Dirs = Dir->Next;
+		Walker->Busy++;
+		pthread_mutex_unlock(&Walker->Lock);
+
+		ReadDir(Walker, Dir->Path);
+		free(Dir->Path);
+		free(Dir);
+
+		pthread_mutex_lock(&Walker->Lock);
+		Walker->Busy--;
+	}
+
+	/* Nothing queued and nobody reading means nothing more can turn
+	 * up. Let everyone else know. */
+	Walker->Finished = 1;
+	pthread_cond_broadcast(&Walker->WorkReady);
+	pthread_cond_broadcast(&Walker->NotEmpty);
+	pthread_mutex_unlock(&Walker->Lock);
+	return NULL;
+}
+
+struct DirWalker* StartDirWalker(const char* Dir, int Threads)
+{
+	struct DirWalker* Walker = (struct DirWalker*) calloc(1, sizeof(*Walker));
+	char* Path = strdup(Dir);
+	int i;
+
+	if (Threads <= 0)
+	{
+		long Cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		/* Reading directories mostly waits on the disk, so a
+		 * few more than there are CPUs doesn't hurt. */
+		Threads = Cpus > 0 ? (int)Cpus * 2 : 4;
+	}
+	if (Threads > WALK_MAX_THREADS)
+		Threads = WALK_MAX_THREADS;
+
+	if (!Walker || !Path ||
+	    !(Walker->Threads = (pthread_t*) malloc(Threads * sizeof(pthread_t))))
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		free(Path);
+		if (Walker)
+			free(Walker->Threads);
+		free(Walker);
+		return NULL;
+	}
+
+	pthread_mutex_init(&Walker->Lock, NULL);
+	pthread_cond_init(&Walker->WorkReady, NULL);
+	pthread_cond_init(&Walker->NotFull, NULL);
+	pthread_cond_init(&Walker->NotEmpty, NULL);
+	QueueDir(Walker, Path);
+
+	for (i = 0; i < Threads; i++)
+	{
+		if (pthread_create(&Walker->Threads[i], NULL, WalkThread, Walker) != 0)
+			break;
+		Walker->NumThreads++;
+	}
+	if (!Walker->NumThreads)
+	{
+		fprintf(stderr, _("Unable to start walking %s.\n"), Dir);
+		StopDirWalker(Walker);
+		return NULL;
+	}
+
+	return Walker;
+}
+
+const char* NextWalkedFile(struct DirWalker* Walker)
+{
+	free(Walker->Current);
+	Walker->Current = NULL;
+
+	pthread_mutex_lock(&Walker->Lock);
+	while (!Walker->Count && !Walker->Finished)
+		pthread_cond_wait(&Walker->NotEmpty, &Walker->Lock);
+	if (Walker->Count)
+	{
+		Walker->Current = Walker->Found[Walker->Head];
+		Walker->Head = (Walker->Head + 1) % WALK_QUEUE;
+		Walker->Count--;
+		pthread_cond_signal(&Walker->NotFull);
+	}
+	pthread_mutex_unlock(&Walker->Lock);
+
+	return Walker->Current;
+}
+
+void StopDirWalker(struct DirWalker* Walker)
+{
+	int i;
+
+	if (!Walker)
+		return;
+
+	pthread_mutex_lock(&Walker->Lock);
+	Walker->Stop = 1;
+	pthread_cond_broadcast(&Walker->WorkReady);
+	pthread_cond_broadcast(&Walker->NotFull);
+	pthread_mutex_unlock(&Walker->Lock);
+
+	for (i = 0; i < Walker->NumThreads; i++)
+		pthread_join(Walker->Threads[i], NULL);
+
+	while (Walker->Dirs)
+	{
+		struct PendingDir* Dir = Walker->Dirs;
+		Walker->Dirs = Dir->Next;
+		free(Dir->Path);
+		free(Dir);
+	}
+	for (i = 0; i < Walker->Count; i++)
+		free(Walker->Found[(Walker->Head + i) % WALK_QUEUE]);
+	free(Walker->Current);
+
+	pthread_cond_destroy(&Walker->NotEmpty);
+	pthread_cond_destroy(&Walker->NotFull);
+	pthread_cond_destroy(&Walker->WorkReady);
+	pthread_mutex_destroy(&Walker->Lock);
+	free(Walker->Threads);
+	free(Walker);
+}
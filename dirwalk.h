@@ -0,0 +1,40 @@
+/* dirwalk.h
+ *
+ * This file contains the prototypes for the directory walker
+ * in dirwalk.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct DirWalker;
+
+/* Starts walking the tree under Dir in the background, looking for
+ * photos. Threads is the number of directories to read at once;
+ * 0 picks a number to suit the machine. Returns NULL on failure. */
+struct DirWalker* StartDirWalker(const char* Dir, int Threads);
+
+/* Returns the next photo found, or NULL once the whole tree has been
+ * walked. The name is valid until the next call. Photos come out in
+ * no particular order, which can differ from one walk to the next. */
+const char* NextWalkedFile(struct DirWalker* Walker);
+
+/* Stops the walk, if it's still going, and frees everything. */
+void StopDirWalker(struct DirWalker* Walker);
+
+/* Returns 1 if File has a photo extension and starts like a photo. */
+int LooksLikePhoto(const char* File);
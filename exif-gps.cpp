@@ -31,6 +31,7 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <stdint.h>
 #include <time.h>
 #include <iostream>
 #include <iomanip>
@@ -46,6 +47,9 @@
 
 #include "gpsstructure.h"
 #include "exif-gps.h"
+#include "exif-rational.h"
+#include "exif-strip.h"
+#include "stats.h"
 
 #ifdef DEBUG
 #include "exiv2/futils.hpp"
@@ -54,9 +58,28 @@
 #define DEBUGLOG(...) /* no logging */
 #endif
 
-#define MAX(a,b) (((a)>(b))?(a):(b))
 #define MIN(a,b) (((a)<(b))?(a):(b))
 
+// Counts the time until the end of the enclosing block against
+// a stage, for --stats. Exceptions are counted too.
+class StageTimer {
+public:
+	StageTimer(int Stage) : Stage(Stage), Began(StatsBegin()) {}
+	~StageTimer() { StatsEnd(Stage, Began); }
+private:
+	int Stage;
+	long long Began;
+};
+
+void InitExif(void)
+{
+#ifdef EXV_HAVE_XMP_TOOLKIT
+	// Done anyway the first time XMP data is touched, but not in
+	// a way that's safe if two threads get there at once.
+	Exiv2::XmpParser::initialize();
+#endif
+}
+
 /* Debug
 int main(int argc, char* argv[])
 {
@@ -99,12 +122,18 @@ char* ReadExifDate(const char* File, int* IncludesGPS)
 	Exiv2::Image::AutoPtr Image;
 
 	try {
+		StageTimer Timer(STATS_EXIF_OPEN);
 		Image = Exiv2::ImageFactory::open(File);
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to open file %s.\n", File);
 		return NULL;
 	}
-	Image->readMetadata();
+	{
+		StageTimer Timer(STATS_EXIF_READ);
+		Image->readMetadata();
+	}
+	if (StatsEnabled())
+		StatsSizeOpened(Image->io().size());
 	if (Image.get() == NULL)
 	{
 		DEBUGLOG("Failed to read file %s %s.\n",
@@ -148,20 +177,34 @@ char* ReadExifDate(const char* File, int* IncludesGPS)
 }
 
 char* ReadExifData(const char* File, double* Lat, double* Long, double* Elev, int* IncludesGPS)
+{
+	return ReadExifDetails(File, Lat, Long, Elev, IncludesGPS, NULL);
+}
+
+char* ReadExifDetails(const char* File, double* Lat, double* Long, double* Elev,
+		      int* IncludesGPS, int* IncludesLatitude)
 {
 	// This function varies in that it reads
 	// much more data than the last, specifically
 	// for display purposes. For the GUI version.
+	// IncludesLatitude (if not NULL) gets the same answer that
+	// ReadExifDate gives, so the photo cache can serve both.
 	// Open and read the file.
 	Exiv2::Image::AutoPtr Image;
 
 	try {
+		StageTimer Timer(STATS_EXIF_OPEN);
 		Image = Exiv2::ImageFactory::open(File);
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to open file %s.\n", File);
 		return NULL;
 	}
-	Image->readMetadata();
+	{
+		StageTimer Timer(STATS_EXIF_READ);
+		Image->readMetadata();
+	}
+	if (StatsEnabled())
+		StatsSizeOpened(Image->io().size());
 	if (Image.get() == NULL)
 	{
 		DEBUGLOG("Failed to read file %s %s.\n",
@@ -187,6 +230,12 @@ char* ReadExifData(const char* File, double* Lat, double* Long, double* Elev, in
 
 	// Copy the tag and return that.
 	char* Copy = strdup(Value.c_str());
+
+	if (IncludesLatitude)
+	{
+		// Same test as ReadExifDate uses.
+		*IncludesLatitude = (ExifRead["Exif.GPSInfo.GPSLatitude"].count() >= 3);
+	}
 	
 	// Check if we have GPS tags.
 	Exiv2::Exifdatum GPSData = ExifRead["Exif.GPSInfo.GPSVersionID"];
@@ -291,12 +340,18 @@ char* ReadGPSTimestamp(const char* File, char* DateStamp, char* TimeStamp, int*
 	Exiv2::Image::AutoPtr Image;
 
 	try {
+		StageTimer Timer(STATS_EXIF_OPEN);
 		Image = Exiv2::ImageFactory::open(File);
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to open file %s.\n", File);
 		return NULL;
 	}
-	Image->readMetadata();
+	{
+		StageTimer Timer(STATS_EXIF_READ);
+		Image->readMetadata();
+	}
+	if (StatsEnabled())
+		StatsSizeOpened(Image->io().size());
 	if (Image.get() == NULL)
 	{
 		DEBUGLOG("Failed to read file %s %s.\n",
@@ -387,57 +442,57 @@ static void EraseGpsTags(Exiv2::ExifData &ExifInfo)
 	}
 }
 
-/* Converts a floating point number with known significant decimal places
- * into a string representation of a rational number.
- * Number must be non-negative.
+/* Compares two tag values. Rationals are compared by value, so that
+ * 3600/100 is the same as 36/1.
  */
-static void ConvertToRational(double Number, int Decimals, char *Buf, int BufSize)
+static bool SameGpsValue(const Exiv2::Exifdatum &Old, const Exiv2::Exifdatum &New)
 {
-	// Calculate the appropriate denominator based on the number of
-	// significant figures in the original data point.
-	// Add one to deal with the fact that an even factor of 10 requires
-	// one more digit to represent than the exponent (e.g. 10^3 = 1000
-	// takes four digits to represent, not the 3 from the exponent).
-	// Cap it at 10^9 to avoid overflow in the EXIF rational data type.
-	double IntDecimals = ceil(log10(Number + 1.0));
-	double Multiplier = pow(10, MAX(0, MIN(Decimals, 9 - IntDecimals)));
-	int Int = (int)round(Number * Multiplier);
-	snprintf(Buf, BufSize, "%d/%d", Int, (int)Multiplier);
+	if (Old.count() != New.count())
+		return false;
+	if (Old.typeId() == Exiv2::unsignedRational &&
+	    New.typeId() == Exiv2::unsignedRational)
+	{
+		for (long i = 0; i < Old.count(); i++)
+		{
+			Exiv2::URational OldNum = Old.toRational(i);
+			Exiv2::URational NewNum = New.toRational(i);
+			if (OldNum.second == 0 || NewNum.second == 0)
+			{
+				if (OldNum != NewNum)
+					return false;
+			} else if ((uint64_t)OldNum.first * NewNum.second !=
+				   (uint64_t)NewNum.first * OldNum.second)
+				return false;
+		}
+		return true;
+	}
+	return Old.typeId() == New.typeId() && Old.toString() == New.toString();
 }
 
-/* Converts a floating point number with known significant decimal places
- * into a string representation of a set of latitude or longitude rational
- * numbers.
+/* Returns true if ExifInfo holds exactly the GPS tags in NewGPS,
+ * with the same values, and no others.
  */
-static void ConvertToLatLongRational(double Number, int Decimals, char *Buf, int BufSize)
+static bool SameGpsTags(const Exiv2::ExifData &ExifInfo, const Exiv2::ExifData &NewGPS)
 {
-	int Deg, Min, Sec;
-	Deg = (int)floor(fabs(Number)); // Slice off after decimal.
-	Min = (int)floor((fabs(Number) - floor(fabs(Number))) * 60); // Now grab just the minutes.
-	double FracPart = ((fabs(Number) - floor(fabs(Number))) * 60) - (double)Min; // Grab the fractional minute.
-	// Calculate the appropriate denominator based on the number of
-	// significant figures in the original data point. Splitting off the
-	// minutes and integer seconds reduces the number of significant
-	// figures by 3.6 (log10(60*60)), so round it down to 3 in order to
-	// preserve the maximum precision.  Cap it at 7 to avoid overflow
-	// in the EXIF rational data type.
-	double Multiplier = pow(10, MAX(0, MIN(Decimals - 3, 7)));
-	Sec = (int)round(FracPart * 60 * Multiplier); // Convert to seconds.
-	snprintf(Buf, BufSize, "%d/1 %d/1 %d/%d", Deg, Min, Sec, (int)Multiplier);
-	//printf("New style lat/long: %f -> %d/%d/ %d/%d\n", Number, Deg, Min, Sec, (int)Multiplier);
-}
+	long Existing = 0;
+	for (Exiv2::ExifData::const_iterator Iter = ExifInfo.begin();
+		Iter != ExifInfo.end(); ++Iter)
+	{
+		if (Iter->key().find("Exif.GPSInfo") == 0)
+			Existing++;
+	}
+	if (Existing != NewGPS.count())
+		return false;
 
-/* Converts a floating point number into a string representation of a set of
- * latitude or longitude rational numbers, using the older, not as accurate
- * style, which nobody should really be using any more.
- */
-static void ConvertToOldLatLongRational(double Number, char *Buf, int BufSize)
-{
-	int Deg, Min;
-	Deg = (int)floor(fabs(Number)); // Slice off after decimal.
-	Min = (int)floor((fabs(Number) - floor(fabs(Number))) * 6000);
-	snprintf(Buf, BufSize, "%d/1 %d/100 0/1", Deg, Min);
-	//printf("Old style lat/long: %f -> %s\n", Number, Buf);
+	for (Exiv2::ExifData::const_iterator Iter = NewGPS.begin();
+		Iter != NewGPS.end(); ++Iter)
+	{
+		Exiv2::ExifData::const_iterator Old =
+			ExifInfo.findKey(Exiv2::ExifKey(Iter->key()));
+		if (Old == ExifInfo.end() || !SameGpsValue(*Old, *Iter))
+			return false;
+	}
+	return true;
 }
 
 int WriteGPSData(const char* File, const struct GPSPoint* Point,
@@ -453,12 +508,18 @@ int WriteGPSData(const char* File, const struct GPSPoint* Point,
 	Exiv2::Image::AutoPtr Image;
 
 	try {
+		StageTimer Timer(STATS_EXIF_OPEN);
 		Image = Exiv2::ImageFactory::open(File);
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to open file %s.\n", File);
 		return 0;
 	}
-	Image->readMetadata();
+	{
+		StageTimer Timer(STATS_EXIF_READ);
+		Image->readMetadata();
+	}
+	if (StatsEnabled())
+		StatsSizeOpened(Image->io().size());
 	if (Image.get() == NULL)
 	{
 		// It failed if we got here.
@@ -467,13 +528,11 @@ int WriteGPSData(const char* File, const struct GPSPoint* Point,
 		return 0;
 	}
 	
-	Exiv2::ExifData &ExifToWrite = Image->exifData();
+	Exiv2::ExifData &ExifInfo = Image->exifData();
 
-	// Make sure we're starting from a clean GPS IFD.
-	// There might be lots of GPS tags existing here, since only the
-	// presence of the GPSLatitude tag causes correlation to stop with
-	// "GPS Already Present" error.
-	EraseGpsTags(ExifToWrite);
+	// Build up the new GPS tags on their own first, so that they can
+	// be compared with any that are already there.
+	Exiv2::ExifData ExifToWrite;
 
 	char ScratchBuf[100];
 
@@ -585,25 +644,39 @@ int WriteGPSData(const char* File, const struct GPSPoint* Point,
 	// Make up the timestamp...
 	// The timestamp is taken as the UTC time of the photo.
 	// If interpolation occurred, then this time is the time of the photo.
-	struct tm TimeStamp = *gmtime(&(Point->Time));
-
 	Value = Exiv2::Value::create(Exiv2::unsignedRational);
-	snprintf(ScratchBuf, sizeof(ScratchBuf), "%d/1 %d/1 %d/1",
-			TimeStamp.tm_hour, TimeStamp.tm_min,
-			TimeStamp.tm_sec);
+	ConvertToGPSTimeStamp(Point->Time, ScratchBuf, sizeof(ScratchBuf));
 	Value->read(ScratchBuf);
 	ExifToWrite.add(Exiv2::ExifKey("Exif.GPSInfo.GPSTimeStamp"), Value.get());
 
 	// And we should also do a datestamp.
-	snprintf(ScratchBuf, sizeof(ScratchBuf), "%04d:%02d:%02d",
-			TimeStamp.tm_year + 1900,
-			TimeStamp.tm_mon + 1,
-			TimeStamp.tm_mday);
+	ConvertToGPSDateStamp(Point->Time, ScratchBuf, sizeof(ScratchBuf));
 	ExifToWrite["Exif.GPSInfo.GPSDateStamp"] = ScratchBuf;
 
+	// If the file already has exactly these tags, don't rewrite it.
+	if (SameGpsTags(ExifInfo, ExifToWrite))
+	{
+		DEBUGLOG("GPS data in %s is unchanged.\n", File);
+		return GPS_WRITE_UNCHANGED;
+	}
+
+	// Make sure we're starting from a clean GPS IFD.
+	// There might be lots of GPS tags existing here, since only the
+	// presence of the GPSLatitude tag causes correlation to stop with
+	// "GPS Already Present" error.
+	EraseGpsTags(ExifInfo);
+	for (Exiv2::ExifData::const_iterator Iter = ExifToWrite.begin();
+		Iter != ExifToWrite.end(); ++Iter)
+	{
+		ExifInfo.add(*Iter);
+	}
+
 	// Write the data to file.
 	try {
+		StageTimer Timer(STATS_EXIF_WRITE);
 		Image->writeMetadata();
+		if (StatsEnabled())
+			StatsSizeWritten(Image->io().size());
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to write to file %s.\n", File);
 		return 0;
@@ -633,12 +706,18 @@ int WriteFixedDatestamp(const char* File, time_t Time)
 	Exiv2::Image::AutoPtr Image;
 
 	try {
+		StageTimer Timer(STATS_EXIF_OPEN);
 		Image = Exiv2::ImageFactory::open(File);
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to open file %s.\n", File);
 		return 0;
 	}
-	Image->readMetadata();
+	{
+		StageTimer Timer(STATS_EXIF_READ);
+		Image->readMetadata();
+	}
+	if (StatsEnabled())
+		StatsSizeOpened(Image->io().size());
 	if (Image.get() == NULL)
 	{
 		// It failed if we got here.
@@ -649,26 +728,23 @@ int WriteFixedDatestamp(const char* File, time_t Time)
 	
 	Exiv2::ExifData &ExifToWrite = Image->exifData();
 	
-	const struct tm TimeStamp = *gmtime(&Time);
 	char ScratchBuf[100];
 
-	snprintf(ScratchBuf, sizeof(ScratchBuf), "%04d:%02d:%02d",
-			TimeStamp.tm_year + 1900,
-			TimeStamp.tm_mon + 1,
-			TimeStamp.tm_mday);
+	ConvertToGPSDateStamp(Time, ScratchBuf, sizeof(ScratchBuf));
 	ExifToWrite.erase(ExifToWrite.findKey(Exiv2::ExifKey("Exif.GPSInfo.GPSDateStamp")));
 	ExifToWrite["Exif.GPSInfo.GPSDateStamp"] = ScratchBuf;
 
 	Exiv2::Value::AutoPtr Value = Exiv2::Value::create(Exiv2::unsignedRational);
-	snprintf(ScratchBuf, sizeof(ScratchBuf), "%d/1 %d/1 %d/1",
-			TimeStamp.tm_hour, TimeStamp.tm_min,
-			TimeStamp.tm_sec);
+	ConvertToGPSTimeStamp(Time, ScratchBuf, sizeof(ScratchBuf));
 	Value->read(ScratchBuf);
 	ExifToWrite.erase(ExifToWrite.findKey(Exiv2::ExifKey("Exif.GPSInfo.GPSTimeStamp")));
 	ExifToWrite.add(Exiv2::ExifKey("Exif.GPSInfo.GPSTimeStamp"), Value.get());
 	
 	try {
+		StageTimer Timer(STATS_EXIF_WRITE);
 		Image->writeMetadata();
+		if (StatsEnabled())
+			StatsSizeWritten(Image->io().size());
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to write to file %s.\n", File);
 		return 0;
@@ -683,24 +759,25 @@ int WriteFixedDatestamp(const char* File, time_t Time)
 	return 1;
 }
 
-int RemoveGPSExif(const char* File, int NoChangeMtime)
+/* The slow way to do RemoveGPSExif, for any kind of file Exiv2 knows. */
+static int RemoveGPSWithExiv2(const char* File)
 {
-	struct stat statbuf;
-	struct stat statbuf2;
-	struct utimbuf utb;
-	if (NoChangeMtime)
-		stat(File, &statbuf);
-
 	// Open the file and start reading.
 	Exiv2::Image::AutoPtr Image;
 	
 	try {
+		StageTimer Timer(STATS_EXIF_OPEN);
 		Image = Exiv2::ImageFactory::open(File);
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to open file %s.\n", File);
 		return 0;
 	}
-	Image->readMetadata();
+	{
+		StageTimer Timer(STATS_EXIF_READ);
+		Image->readMetadata();
+	}
+	if (StatsEnabled())
+		StatsSizeOpened(Image->io().size());
 	if (Image.get() == NULL)
 	{
 		// It failed if we got here.
@@ -720,12 +797,39 @@ int RemoveGPSExif(const char* File, int NoChangeMtime)
 	EraseGpsTags(ExifInfo);
 	
 	try {
+		StageTimer Timer(STATS_EXIF_WRITE);
 		Image->writeMetadata();
+		if (StatsEnabled())
+			StatsSizeWritten(Image->io().size());
 	} catch (Exiv2::Error e) {
 		DEBUGLOG("Failed to write to file %s.\n", File);
 		return 0;
 	}
 
+	return 1;
+}
+
+int RemoveGPSExif(const char* File, int NoChangeMtime)
+{
+	struct stat statbuf;
+	struct stat statbuf2;
+	struct utimbuf utb;
+	if (NoChangeMtime)
+		stat(File, &statbuf);
+
+	// Most photos are JPEGs with the EXIF block laid out the usual
+	// way, and for those only a few bytes need changing. Anything
+	// else goes through Exiv2, which rewrites the whole file.
+	int Stripped;
+	{
+		StageTimer Timer(STATS_EXIF_WRITE);
+		Stripped = StripGPSInPlace(File);
+	}
+	if (Stripped == STRIP_UNUSUAL)
+		Stripped = RemoveGPSWithExiv2(File);
+	if (!Stripped)
+		return 0;
+
 	if (NoChangeMtime)
 	{
 		stat(File, &statbuf2);
@@ -30,10 +30,19 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+
+/* Gets Exiv2 ready. Must be called before photos are read or
+ * written on more than one thread at once. */
+void InitExif(void);
 	
 char* ReadExifDate(const char* File, int* IncludesGPS);
 char* ReadExifData(const char* File, double* Lat, double* Long, double* Elevation, int* IncludesGPS);
+char* ReadExifDetails(const char* File, double* Lat, double* Long, double* Elevation,
+		      int* IncludesGPS, int* IncludesLatitude);
 char* ReadGPSTimestamp(const char* File, char* DateStamp, char* TimeStamp, int* IncludesGPS);
+/* Returns 0 on failure, 1 if written, or GPS_WRITE_UNCHANGED if the
+ * file already held exactly this GPS data and so was left alone. */
+#define GPS_WRITE_UNCHANGED 2
 int WriteGPSData(const char* File, const struct GPSPoint* Point,
 		 const char* Datum, int NoChangeMtime, int DegMinSecs);
 int WriteFixedDatestamp(const char* File, time_t TimeStamp);
@@ -0,0 +1,103 @@
+/* exif-rational.c
+ *
+ * This file turns GPS positions and times into the text of the
+ * rational and date values that go in the GPS tags. It's kept apart
+ * from exif-gps.cpp so that it can be checked without Exiv2.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "exif-rational.h"
+#include "unixtime.h"
+
+#define MAX(a,b) (((a)>(b))?(a):(b))
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+/* Converts a floating point number with known significant decimal places
+ * into a string representation of a rational number.
+ * Number must be non-negative.
+ */
+void ConvertToRational(double Number, int Decimals, char *Buf, int BufSize)
+{
+	/* Calculate the appropriate denominator based on the number of
+	 * significant figures in the original data point.
+	 * Add one to deal with the fact that an even factor of 10 requires
+	 * one more digit to represent than the exponent (e.g. 10^3 = 1000
+	 * takes four digits to represent, not the 3 from the exponent).
+	 * Cap it at 10^9 to avoid overflow in the EXIF rational data type. */
+	double IntDecimals = ceil(log10(Number + 1.0));
+	double Multiplier = pow(10, MAX(0, MIN(Decimals, 9 - IntDecimals)));
+	int Int = (int)round(Number * Multiplier);
+	snprintf(Buf, BufSize, "%d/%d", Int, (int)Multiplier);
+}
+
+/* Converts a floating point number with known significant decimal places
+ * into a string representation of a set of latitude or longitude rational
+ * numbers.
+ */
+void ConvertToLatLongRational(double Number, int Decimals, char *Buf, int BufSize)
+{
+	int Deg, Min, Sec;
+	Deg = (int)floor(fabs(Number)); /* Slice off after decimal. */
+	Min = (int)floor((fabs(Number) - floor(fabs(Number))) * 60); /* Now grab just the minutes. */
+	double FracPart = ((fabs(Number) - floor(fabs(Number))) * 60) - (double)Min; /* Grab the fractional minute. */
+	/* Calculate the appropriate denominator based on the number of
+	 * significant figures in the original data point. Splitting off the
+	 * minutes and integer seconds reduces the number of significant
+	 * figures by 3.6 (log10(60*60)), so round it down to 3 in order to
+	 * preserve the maximum precision.  Cap it at 7 to avoid overflow
+	 * in the EXIF rational data type. */
+	double Multiplier = pow(10, MAX(0, MIN(Decimals - 3, 7)));
+	Sec = (int)round(FracPart * 60 * Multiplier); /* Convert to seconds. */
+	snprintf(Buf, BufSize, "%d/1 %d/1 %d/%d", Deg, Min, Sec, (int)Multiplier);
+}
+
+/* Converts a floating point number into a string representation of a set of
+ * latitude or longitude rational numbers, using the older, not as accurate
+ * style, which nobody should really be using any more.
+ */
+void ConvertToOldLatLongRational(double Number, char *Buf, int BufSize)
+{
+	int Deg, Min;
+	Deg = (int)floor(fabs(Number)); /* Slice off after decimal. */
+	Min = (int)floor((fabs(Number) - floor(fabs(Number))) * 6000);
+	snprintf(Buf, BufSize, "%d/1 %d/100 0/1", Deg, Min);
+}
+
+void ConvertToGPSTimeStamp(time_t Time, char *Buf, int BufSize)
+{
+	struct tm TimeStamp;
+	BreakDownUTC(Time, &TimeStamp);
+	snprintf(Buf, BufSize, "%d/1 %d/1 %d/1",
+			TimeStamp.tm_hour, TimeStamp.tm_min,
+			TimeStamp.tm_sec);
+}
+
+void ConvertToGPSDateStamp(time_t Time, char *Buf, int BufSize)
+{
+	struct tm TimeStamp;
+	BreakDownUTC(Time, &TimeStamp);
+	snprintf(Buf, BufSize, "%04d:%02d:%02d",
+			TimeStamp.tm_year + 1900,
+			TimeStamp.tm_mon + 1,
+			TimeStamp.tm_mday);
+}
@@ -0,0 +1,49 @@
+/* exif-rational.h
+ *
+ * This file contains the prototypes for the GPS tag value formatting
+ * in exif-rational.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Each of these formats a value as the text Exiv2 reads a tag from,
+ * into Buf, which holds BufSize bytes. */
+
+/* Number as one rational, keeping Decimals decimal places where it
+ * fits. Number must be non-negative. */
+void ConvertToRational(double Number, int Decimals, char *Buf, int BufSize);
+
+/* The size of a latitude or longitude as degrees, minutes and seconds,
+ * keeping as many of Decimals decimal places as fit. */
+void ConvertToLatLongRational(double Number, int Decimals, char *Buf, int BufSize);
+
+/* The same, as degrees and hundredths of minutes, the way older
+ * versions did it. */
+void ConvertToOldLatLongRational(double Number, char *Buf, int BufSize);
+
+/* The GPSTimeStamp and GPSDateStamp for Time (in UTC). */
+void ConvertToGPSTimeStamp(time_t Time, char *Buf, int BufSize);
+void ConvertToGPSDateStamp(time_t Time, char *Buf, int BufSize);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,395 @@
+/* exif-strip.c
+ *
+ * This file takes the GPS tags out of a JPEG by changing the few bytes
+ * of its EXIF block that hold them, rather than having Exiv2 read all
+ * the metadata and write the whole file out again. Anything it isn't
+ * sure of is left for Exiv2. It's kept apart from exif-gps.cpp so that
+ * it can be checked without Exiv2.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "exif-strip.h"
+
+#define GPS_INFO_TAG 0x8825 /* The entry in IFD0 pointing to the GPS IFD. */
+#define EXIF_IFD_TAG 0x8769 /* And to the Exif IFD. */
+#define INTEROP_IFD_TAG 0xa005 /* In the Exif IFD, to the Interop IFD. */
+#define THUMBNAIL_TAG 0x0201 /* In IFD1, where a JPEG thumbnail is, */
+#define THUMBNAIL_LENGTH_TAG 0x0202 /* and how long. */
+#define STRIP_OFFSETS_TAG 0x0111 /* Where any other thumbnail is. */
+#define TIFF_LONG 4
+#define TIFF_IFD 13
+
+/* Give up looking for the EXIF block after this many JPEG segments. */
+#define MAX_SEGMENTS 32
+
+/* The TIFF structure inside an APP1 segment, as read into memory. */
+struct Tiff {
+	unsigned char* Data;
+	size_t Size;
+	int BigEndian;
+	size_t DirtyFrom, DirtyTo; /* The bytes changed: [From, To). */
+};
+
+static unsigned Get16(const struct Tiff* T, size_t At)
+{
+	const unsigned char* P = T->Data + At;
+	return T->BigEndian ? (P[0] << 8) | P[1] : (P[1] << 8) | P[0];
+}
+
+static unsigned long Get32(const struct Tiff* T, size_t At)
+{
+	const unsigned char* P = T->Data + At;
+	if (T->BigEndian)
+		return ((unsigned long) P[0] << 24) | (P[1] << 16) | (P[2] << 8) | P[3];
+	return ((unsigned long) P[3] << 24) | (P[2] << 16) | (P[1] << 8) | P[0];
+}
+
+static void Put16(struct Tiff* T, size_t At, unsigned Value)
+{
+	unsigned char* P = T->Data + At;
+	P[T->BigEndian ? 0 : 1] = (Value >> 8) & 0xff;
+	P[T->BigEndian ? 1 : 0] = Value & 0xff;
+}
+
+static void MarkDirty(struct Tiff* T, size_t At, size_t Length)
+{
+	if (At < T->DirtyFrom)
+		T->DirtyFrom = At;
+	if (At + Length > T->DirtyTo)
+		T->DirtyTo = At + Length;
+}
+
+/* Is [At, At + Length) inside the TIFF data? */
+static int Fits(const struct Tiff* T, unsigned long At, unsigned long Length)
+{
+	return At <= T->Size && Length <= T->Size - At;
+}
+
+/* The size of one value of a TIFF type, or 0 if we don't know it. */
+static unsigned TypeSize(unsigned Type)
+{
+	static const unsigned char Sizes[] =
+		{ 0, 1, 1, 2, 4, 8, 1, 1, 2, 4, 8, 4, 8, 4 };
+	return Type < sizeof(Sizes) ? Sizes[Type] : 0;
+}
+
+/* Some bytes of the TIFF data: [At, At + Length). */
+struct Extent {
+	unsigned long At, Length;
+};
+
+/* Does [At, At + Length) share any bytes with the Count extents at List? */
+static int Overlaps(const struct Extent* List, unsigned Count,
+		    unsigned long At, unsigned long Length)
+{
+	unsigned i;
+	if (!Length)
+		return 0;
+	for (i = 0; i < Count; i++)
+	{
+		if (At < List[i].At + List[i].Length && List[i].At < At + Length)
+			return 1;
+	}
+	return 0;
+}
+
+/* Where the value of the IFD entry at Entry is kept, if it isn't in
+ * the entry itself; if it is, Value's Length is 0. Returns 0 if the
+ * type isn't known or the value doesn't fit in T. */
+static int ValueExtent(const struct Tiff* T, size_t Entry, struct Extent* Value)
+{
+	unsigned Size = TypeSize(Get16(T, Entry + 2));
+	unsigned long Count = Get32(T, Entry + 4);
+	Value->At = 0;
+	Value->Length = 0;
+	if (!Size || Count > T->Size / Size)
+		return 0;
+	if (Size * Count <= 4)
+		return 1;
+	Value->At = Get32(T, Entry + 8);
+	Value->Length = Size * Count;
+	return Value->At >= 8 && Fits(T, Value->At, Value->Length);
+}
+
+/* The entry for Tag in the IFD at Ifd, which must fit in T, or 0 if
+ * there isn't one. */
+static size_t FindEntry(const struct Tiff* T, unsigned long Ifd, unsigned Tag)
+{
+	unsigned Entries = Get16(T, Ifd);
+	unsigned i;
+	for (i = 0; i < Entries; i++)
+	{
+		if (Get16(T, Ifd + 2 + 12 * i) == Tag)
+			return Ifd + 2 + 12 * i;
+	}
+	return 0;
+}
+
+/* The IFD the entry at Entry points to, or 0 if it isn't a pointer. */
+static unsigned long IfdPointer(const struct Tiff* T, size_t Entry)
+{
+	unsigned Type = Get16(T, Entry + 2);
+	if ((Type != TIFF_LONG && Type != TIFF_IFD) || Get32(T, Entry + 4) != 1)
+		return 0;
+	return Get32(T, Entry + 8);
+}
+
+/* Checks that the IFD at Ifd and the values it keeps outside itself
+ * fit in T and keep clear of the Count extents at Gps. The link to the
+ * next IFD, which is put in Next (if given), might be missing, as
+ * it's often 0. Returns 0 if anything's amiss. */
+static int ClearOfGps(const struct Tiff* T, unsigned long Ifd,
+		      const struct Extent* Gps, unsigned Count,
+		      unsigned long* Next)
+{
+	if (Ifd < 8 || !Fits(T, Ifd, 2))
+		return 0;
+	unsigned Entries = Get16(T, Ifd);
+	unsigned long Length = 2 + 12 * Entries;
+	if (!Fits(T, Ifd, Length))
+		return 0;
+	unsigned long Link = 0;
+	if (Fits(T, Ifd, Length + 4))
+	{
+		Link = Get32(T, Ifd + Length);
+		Length += 4;
+	}
+	if (Next)
+		*Next = Link;
+	if (Overlaps(Gps, Count, Ifd, Length))
+		return 0;
+	unsigned i;
+	for (i = 0; i < Entries; i++)
+	{
+		struct Extent Value;
+		if (!ValueExtent(T, Ifd + 2 + 12 * i, &Value) ||
+		    Overlaps(Gps, Count, Value.At, Value.Length))
+			return 0;
+	}
+	return 1;
+}
+
+/* Checks that nothing but the pointer in IFD0 refers to any of the
+ * Count extents at Gps: not IFD0, the Exif and Interop IFDs, IFD1,
+ * the thumbnail, or any of their values. Wiping them mustn't lose
+ * anything else. */
+static int GpsIsApart(const struct Tiff* T, unsigned long Ifd0,
+		      const struct Extent* Gps, unsigned Count)
+{
+	unsigned long Ifd1;
+	size_t Entry;
+	if (!ClearOfGps(T, Ifd0, Gps, Count, &Ifd1))
+		return 0;
+
+	if ((Entry = FindEntry(T, Ifd0, EXIF_IFD_TAG)))
+	{
+		unsigned long Exif = IfdPointer(T, Entry);
+		if (!ClearOfGps(T, Exif, Gps, Count, NULL))
+			return 0;
+		if ((Entry = FindEntry(T, Exif, INTEROP_IFD_TAG)) &&
+		    !ClearOfGps(T, IfdPointer(T, Entry), Gps, Count, NULL))
+			return 0;
+	}
+
+	if (Ifd1)
+	{
+		if (!ClearOfGps(T, Ifd1, Gps, Count, NULL))
+			return 0;
+		/* Only a JPEG thumbnail is simple enough to follow. */
+		if (FindEntry(T, Ifd1, STRIP_OFFSETS_TAG))
+			return 0;
+		size_t Start = FindEntry(T, Ifd1, THUMBNAIL_TAG);
+		size_t Length = FindEntry(T, Ifd1, THUMBNAIL_LENGTH_TAG);
+		if (Start && Length)
+		{
+			unsigned long At = Get32(T, Start + 8);
+			unsigned long Size = Get32(T, Length + 8);
+			if (!Fits(T, At, Size) || Overlaps(Gps, Count, At, Size))
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* Takes the GPS IFD out of T. Nothing is changed unless the whole of
+ * it makes sense. */
+static int StripTiff(struct Tiff* T)
+{
+	if (T->Size < 8)
+		return STRIP_UNUSUAL;
+	if (!memcmp(T->Data, "MM", 2))
+		T->BigEndian = 1;
+	else if (memcmp(T->Data, "II", 2))
+		return STRIP_UNUSUAL;
+	if (Get16(T, 2) != 42)
+		return STRIP_UNUSUAL;
+
+	/* Find the pointer in IFD0. */
+	unsigned long Ifd0 = Get32(T, 4);
+	if (Ifd0 < 8 || !Fits(T, Ifd0, 2))
+		return STRIP_UNUSUAL;
+	unsigned Entries = Get16(T, Ifd0);
+	unsigned long Ifd0End = Ifd0 + 2 + 12 * Entries + 4; /* With the link. */
+	if (!Fits(T, Ifd0, Ifd0End - Ifd0))
+		return STRIP_UNUSUAL;
+	size_t Pointer = FindEntry(T, Ifd0, GPS_INFO_TAG);
+	if (!Pointer)
+		return STRIP_DONE;
+
+	/* Find everything the GPS IFD takes up: itself, and then its
+	 * values, and check nothing else uses any of it before touching
+	 * anything. */
+	unsigned long Gps = IfdPointer(T, Pointer);
+	if (Gps < 8 || !Fits(T, Gps, 2))
+		return STRIP_UNUSUAL;
+	unsigned GpsEntries = Get16(T, Gps);
+	unsigned long GpsLength = 2 + 12 * GpsEntries;
+	if (!Fits(T, Gps, GpsLength))
+		return STRIP_UNUSUAL;
+	/* The link to the next IFD should be 0, and might be missing. */
+	if (Fits(T, Gps, GpsLength + 4))
+		GpsLength += 4;
+	struct Extent* Wipe = (struct Extent*)
+		malloc((GpsEntries + 1) * sizeof(*Wipe));
+	if (!Wipe)
+		return STRIP_UNUSUAL;
+	Wipe[0].At = Gps;
+	Wipe[0].Length = GpsLength;
+	unsigned NumWipe = 1;
+	unsigned i;
+	for (i = 0; i < GpsEntries; i++)
+	{
+		if (!ValueExtent(T, Gps + 2 + 12 * i, &Wipe[NumWipe]))
+		{
+			free(Wipe);
+			return STRIP_UNUSUAL;
+		}
+		if (Wipe[NumWipe].Length)
+			NumWipe++;
+	}
+	if (!GpsIsApart(T, Ifd0, Wipe, NumWipe))
+	{
+		free(Wipe);
+		return STRIP_UNUSUAL;
+	}
+
+	/* Wipe the values and the IFD itself. */
+	for (i = 0; i < NumWipe; i++)
+	{
+		memset(T->Data + Wipe[i].At, 0, Wipe[i].Length);
+		MarkDirty(T, Wipe[i].At, Wipe[i].Length);
+	}
+	free(Wipe);
+
+	/* And take the pointer out of IFD0, moving the entries after it
+	 * and the link to IFD1 up to close the gap. Nothing else refers
+	 * to where they were. */
+	memmove(T->Data + Pointer, T->Data + Pointer + 12, Ifd0End - Pointer - 12);
+	memset(T->Data + Ifd0End - 12, 0, 12);
+	Put16(T, Ifd0, Entries - 1);
+	MarkDirty(T, Ifd0, Ifd0End - Ifd0);
+
+	return STRIP_DONE;
+}
+
+static int ReadAt(FILE* F, unsigned char* Buf, size_t Length, long At)
+{
+	return !fseek(F, At, SEEK_SET) && fread(Buf, 1, Length, F) == Length;
+}
+
+static int WriteAt(FILE* F, const unsigned char* Buf, size_t Length, long At)
+{
+	return !fseek(F, At, SEEK_SET) && fwrite(Buf, 1, Length, F) == Length;
+}
+
+int StripGPSInPlace(const char* File)
+{
+	FILE* F = fopen(File, "r+b");
+	if (!F)
+		return STRIP_UNUSUAL;
+
+	/* Walk the segments at the start of the JPEG, up to the EXIF one.
+	 * Any other layout, including a JPEG without EXIF, is left
+	 * for Exiv2. */
+	unsigned char Marker[4];
+	long At = 2;
+	int Result = STRIP_UNUSUAL;
+	int Segment;
+	if (!ReadAt(F, Marker, 2, 0) || Marker[0] != 0xff || Marker[1] != 0xd8)
+	{
+		fclose(F);
+		return STRIP_UNUSUAL;
+	}
+	for (Segment = 0; Segment < MAX_SEGMENTS; Segment++)
+	{
+		if (!ReadAt(F, Marker, 4, At) || Marker[0] != 0xff)
+			break;
+		/* Past this, it's the image itself. */
+		if (Marker[1] == 0xda || Marker[1] == 0xd9)
+			break;
+		size_t Length = (Marker[2] << 8) | Marker[3];
+		if (Length < 2)
+			break;
+		if (Marker[1] != 0xe1 || Length < 2 + 6 + 8)
+		{
+			At += 2 + Length;
+			continue;
+		}
+
+		/* An APP1 segment: is it EXIF, or XMP or something else? */
+		unsigned char* Data = (unsigned char*) malloc(Length - 2);
+		if (!Data)
+			break;
+		if (!ReadAt(F, Data, Length - 2, At + 4))
+		{
+			free(Data);
+			break;
+		}
+		if (memcmp(Data, "Exif\0\0", 6))
+		{
+			free(Data);
+			At += 2 + Length;
+			continue;
+		}
+
+		struct Tiff T;
+		T.Data = Data + 6;
+		T.Size = Length - 2 - 6;
+		T.BigEndian = 0;
+		T.DirtyFrom = T.Size;
+		T.DirtyTo = 0;
+		Result = StripTiff(&T);
+		if (Result == STRIP_DONE && T.DirtyTo > T.DirtyFrom &&
+			!WriteAt(F, T.Data + T.DirtyFrom, T.DirtyTo - T.DirtyFrom,
+				At + 4 + 6 + T.DirtyFrom))
+		{
+			Result = STRIP_FAILED;
+		}
+		free(Data);
+		break;
+	}
+
+	if (fclose(F) && Result == STRIP_DONE)
+		Result = STRIP_FAILED;
+	return Result;
+}
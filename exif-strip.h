@@ -0,0 +1,40 @@
+/* exif-strip.h
+ *
+ * Taking the GPS tags out of a JPEG without rewriting it.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* What StripGPSInPlace came to. */
+#define STRIP_FAILED   0 /* The file couldn't be written. */
+#define STRIP_DONE     1 /* No GPS tags are left (maybe there were none). */
+#define STRIP_UNUSUAL -1 /* Not laid out the way this expects; nothing
+			  * was changed, so Exiv2 will have to do it. */
+
+/* Takes the GPS IFD out of the EXIF block of a JPEG, changing only the
+ * bytes it takes up and the entry in IFD0 that points to it. The GPS
+ * tags' values are wiped, not just left unreferenced. */
+int StripGPSInPlace(const char* File);
+
+#ifdef __cplusplus
+}
+#endif
@@ -44,4 +44,11 @@ struct GPSTrack {
 	struct GPSPoint* Points;
 	time_t MinTime;
 	time_t MaxTime;
+	/* Filled in by IndexTrack, so that points can be found without
+	 * walking the whole list. Index is NULL if there isn't one. */
+	long NumPoints;
+	struct GPSPoint** Index;  /* Every point, in list order. */
+	time_t* LatestBy;         /* Latest time of any point up to each one. */
+	/* Where reading the file got to, for UpdateGPX. */
+	struct GPXTail* Tail;
 };
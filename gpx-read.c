@@ -26,19 +26,70 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <locale.h>
 #include <libxml/parser.h>
-#include <libxml/tree.h>
+#include <libxml/encoding.h>
+#include <zlib.h>
 
 #include "i18n.h"
 #include "gpx-read.h"
 #include "unixtime.h"
 #include "gpsstructure.h"
-
-/* Pointers to the first and last points, used during parsing */
-static struct GPSPoint* FirstPoint;
-static struct GPSPoint* LastPoint;
+#include "stats.h"
+
+/* How much of the file to hand to the parser at a time. */
+#define GPX_CHUNK 65536
+
+/* Where the last read of a GPX file got to, so that UpdateGPX can
+ * carry on from there rather than starting again. Live loggers add
+ * points all day, often rewriting the closing tags each time, so the
+ * place to carry on from is just after the last whole <trkpt>. */
+struct GPXTail {
+	long Offset;            /* Just after the last whole <trkpt>, or 0. */
+	char* Prefix;           /* Start tags of the elements open there. */
+	char* Encoding;         /* As declared in the file, if at all. */
+	int Resumable;          /* 0 if the encoding rules out carrying on. */
+	unsigned char Start[64];  /* The first bytes of the file, and */
+	int StartLength;
+	unsigned char Before[64]; /* those up to Offset, to check that */
+	int BeforeLength;         /* they haven't been changed. */
+	int EndOfSegment;       /* What the last point had there. */
+};
+
+/* Everything needed while parsing. The parser calls us back as it
+ * goes, so no tree of the whole file is ever built. */
+struct GPXParse {
+	xmlParserCtxtPtr Context;
+	int Invalid;            /* The root isn't <gpx>. */
+	long Skew;              /* Parser offset to file offset. */
+
+	/* The elements open, and the start tag of each (NULL inside a
+	 * point), so the parser can be put back in this state later. */
+	char** Open;
+	char* InSegment;        /* Whether each is a <trkseg>. */
+	int Depth;
+	int Size;
+	int Changed;            /* Open has changed since the last Prefix. */
+
+	/* The point being read, if any. */
+	int PointDepth;         /* Depth inside the <trkpt>, or 0. */
+	char* Lat;
+	char* Long;
+	char* Elev;
+	char* Time;
+	char** Field;           /* Where the text being read goes. */
+	char* Text;
+	size_t TextLength;
+	size_t TextSize;
+
+	struct GPSPoint* Previous; /* Last point already in the track. */
+	struct GPSPoint* First;    /* Points read this time. */
+	struct GPSPoint* Last;
+
+	struct GPXTail Tail;    /* Where we've got to. */
+};
 
 /* Returns the number of decimal places in the given decimal number string */
 static int NumDecimals(const char *Decimal)
@@ -50,154 +101,403 @@ static int NumDecimals(const char *Decimal)
 	return 0;
 }
 
-static void ExtractTrackPoints(xmlNodePtr Start)
+/* Powers of ten that a double holds exactly. */
+static const double ExactTens[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* strtod(), but always with "." for the decimal point, as GPX has
+ * it, whatever the locale says. */
+static double StrtodDot(const char* Text)
 {
-	/* The pointer passed to us should be the start
-	 * of a heap of trkpt's. So walk though them,
-	 * extracting what we need. */
-	xmlNodePtr Current = NULL;
-	xmlNodePtr CCurrent = NULL;
-	xmlAttrPtr Properties = NULL;
-	const char* Lat;
-	const char* Long;
-	const char* Elev;
-	const char* Time;
-
-	for (Current = Start; Current; Current = Current->next)
-	{
-		if ((Current->type == XML_ELEMENT_NODE) &&
-			(strcmp((const char *)Current->name, "trkpt") == 0))
+	const char* Point = localeconv()->decimal_point;
+	if (strcmp(Point, ".") == 0)
+		return strtod(Text, NULL);
+
+	char* Copy = (char*) malloc(strlen(Text) * strlen(Point) + 1);
+	if (!Copy)
+		return 0;
+	char* Out = Copy;
+	for (; *Text; Text++)
+	{
+		if (*Text == '.')
 		{
-			/* This is indeed a trackpoint. Extract! */
-
-			/* Reset the vars... so we don't get
-			 * the data from last run. */
-			Lat = NULL;
-			Long = NULL;
-			Elev = NULL;
-			Time = NULL;
-			
-			/* To get the Lat and Long, we have to
-			 * extract the properties... another 
-			 * linked list to walk. */
-			for (Properties = Current->properties;
-					Properties;
-					Properties = Properties->next)
-			{
-				if (strcmp((const char *)Properties->name, "lat") == 0)
-				{
-					Lat = (const char *)Properties->children->content;
-				}
-				if (strcmp((const char *)Properties->name, "lon") == 0)
-				{
-					Long = (const char *)Properties->children->content;
-				}
-			}
+			strcpy(Out, Point);
+			Out += strlen(Point);
+		} else {
+			*Out++ = *Text;
+		}
+	}
+	*Out = '\0';
+	double Value = strtod(Copy, NULL);
+	free(Copy);
+	return Value;
+}
 
-			/* Now, grab the elevation and time.
-			 * These are children of trkpt. */
-			/* Oh, and what's the deal with the
-			 * Node->children->content thing? */
-			for (CCurrent = Current->children;
-					CCurrent;
-					CCurrent = CCurrent->next)
-			{
-				if (strcmp((const char *)CCurrent->name, "ele") == 0)
-				{
-					if (CCurrent->children)
-						Elev = (const char *)CCurrent->children->content;
-				}
-				if (strcmp((const char *)CCurrent->name, "time") == 0)
-				{
-					if (CCurrent->children)
-						Time = (const char *)CCurrent->children->content;
-				}
-			}
+/* Reads a decimal number as atof() would in the "C" locale. Setting
+ * LC_NUMERIC around the whole read used to see to that, but it's
+ * shared by every thread. A number with few enough digits is one
+ * division of two exact doubles, which rounds just as strtod() does;
+ * anything else goes to strtod() itself. */
+static double ParseDecimal(const char* Text)
+{
+	const char* Scan = Text;
+	unsigned long long Mantissa = 0;
+	int Digits = 0;         /* Significant digits in Mantissa. */
+	int Scale = 0;          /* How many of them follow the point. */
+	int Seen = 0;           /* Digits of any kind. */
+	int Negative = 0;
+
+	while (*Scan == ' ' || (*Scan >= '\t' && *Scan <= '\r'))
+		Scan++;
+	if (*Scan == '-' || *Scan == '+')
+		Negative = *Scan++ == '-';
+	for (; *Scan >= '0' && *Scan <= '9'; Scan++, Seen++)
+	{
+		if (Mantissa || *Scan != '0')
+			Digits++;
+		if (Digits <= 15)
+			Mantissa = Mantissa * 10 + (*Scan - '0');
+	}
+	if (*Scan == '.')
+	{
+		for (Scan++; *Scan >= '0' && *Scan <= '9'; Scan++, Seen++, Scale++)
+		{
+			if (Mantissa || *Scan != '0')
+				Digits++;
+			if (Digits <= 15)
+				Mantissa = Mantissa * 10 + (*Scan - '0');
+		}
+	}
 
-			/* Check that we have all the data. If we're missing something,
-			 * then skip this point... */
-			if (Time == NULL || Long == NULL || Lat == NULL)
-			{
-				/* Missing some data. */
-				/* TODO: Really should report this upstream... */
-				continue;
-			}
+	/* Fifteen digits always fit in the 53 bits a double has. */
+	if (!Seen || Digits > 15 || Scale > 22 ||
+	    *Scan == 'e' || *Scan == 'E' || *Scan == 'x' || *Scan == 'X')
+		return StrtodDot(Text);
+
+	double Value = (double) Mantissa / ExactTens[Scale];
+	return Negative ? -Value : Value;
+}
+
+/* Returns a copy of the Length bytes at Text, as a string. */
+static char* CopyText(const xmlChar* Text, size_t Length)
+{
+	char* Copy = (char*) malloc(Length + 1);
+	if (Copy)
+	{
+		memcpy(Copy, Text, Length);
+		Copy[Length] = '\0';
+	}
+	return Copy;
+}
+
+/* Copies Text, an attribute value as the parser gives it, to Out,
+ * escaped so it can be read again, returning the end of what was
+ * written. Out must have room for six times as much. The parser
+ * leaves any & as a reference already, so only < and " need it. */
+static char* EscapeAttribute(char* Out, const char* Text)
+{
+	for (; *Text; Text++)
+	{
+		if (*Text == '<')
+			Out += sprintf(Out, "&lt;");
+		else if (*Text == '"')
+			Out += sprintf(Out, "&quot;");
+		else
+			*Out++ = *Text;
+	}
+	return Out;
+}
+
+/* Writes out a start tag with the namespaces it declares. Attributes
+ * aren't needed again, so they're left out. */
+static char* StartTag(const xmlChar* Name, const xmlChar* Prefix,
+		      int NumNamespaces, const xmlChar** Namespaces)
+{
+	size_t Length = strlen((const char*)Name) + 3;
+	char* Tag;
+	char* Out;
+	int i;
+
+	if (Prefix)
+		Length += strlen((const char*)Prefix) + 1;
+	for (i = 0; i < NumNamespaces * 2; i += 2)
+	{
+		Length += 10;
+		if (Namespaces[i])
+			Length += strlen((const char*)Namespaces[i]);
+		Length += 6 * strlen((const char*)Namespaces[i + 1]);
+	}
+
+	Tag = Out = (char*) malloc(Length);
+	if (!Tag)
+		return NULL;
+	if (Prefix)
+		Out += sprintf(Out, "<%s:%s", Prefix, Name);
+	else
+		Out += sprintf(Out, "<%s", Name);
+	for (i = 0; i < NumNamespaces * 2; i += 2)
+	{
+		if (Namespaces[i])
+			Out += sprintf(Out, " xmlns:%s=\"", Namespaces[i]);
+		else
+			Out += sprintf(Out, " xmlns=\"");
+		Out = EscapeAttribute(Out, (const char*)Namespaces[i + 1]);
+		*Out++ = '"';
+	}
+	strcpy(Out, ">");
+	return Tag;
+}
+
+/* Notes where we are as the place to carry on from next time: after
+ * the point just read, with the elements open as they are now. */
+static void SaveTail(struct GPXParse* Parse)
+{
+	struct GPSPoint* Last = Parse->Last ? Parse->Last : Parse->Previous;
+	long Consumed = xmlByteConsumed(Parse->Context);
+	int i;
+
+	if (Consumed < 0)
+		return;
+
+	if (Parse->Changed || !Parse->Tail.Prefix)
+	{
+		size_t Length = 1;
+		char* Prefix;
+		for (i = 0; i < Parse->Depth; i++)
+			Length += strlen(Parse->Open[i]);
+		Prefix = (char*) malloc(Length);
+		if (!Prefix)
+			return;
+		Prefix[0] = '\0';
+		for (i = 0; i < Parse->Depth; i++)
+			strcat(Prefix, Parse->Open[i]);
+		free(Parse->Tail.Prefix);
+		Parse->Tail.Prefix = Prefix;
+		Parse->Changed = 0;
+	}
+
+	Parse->Tail.Offset = Parse->Skew + Consumed;
+	Parse->Tail.EndOfSegment = Last ? Last->EndOfSegment : 0;
+}
+
+/* Adds the point just read to the list, if it has all we need. */
+static void AddPoint(struct GPXParse* Parse)
+{
+	struct GPSPoint* Point;
+
+	/* Check that we have all the data. If we're missing something,
+	 * then skip this point... */
+	if (Parse->Time == NULL || Parse->Long == NULL || Parse->Lat == NULL)
+		return;
 
-			/* Right, now we theoretically have all the data.
-			 * Allocate ourselves some memory and go for it... */
-			if (FirstPoint)
+	Point = (struct GPSPoint*) malloc(sizeof(struct GPSPoint));
+	if (!Point)
+	{
+		xmlStopParser(Parse->Context);
+		return;
+	}
+
+	Point->Lat = ParseDecimal(Parse->Lat);
+	Point->LatDecimals = NumDecimals(Parse->Lat);
+	Point->Long = ParseDecimal(Parse->Long);
+	Point->LongDecimals = NumDecimals(Parse->Long);
+	Point->Elev = 0;
+	Point->ElevDecimals = -1; // default meaning no altitude was found
+	if (Parse->Elev) {
+		Point->Elev = ParseDecimal(Parse->Elev);
+		Point->ElevDecimals = NumDecimals(Parse->Elev);
+	}
+	Point->Time = ConvertToUnixTime(Parse->Time, GPX_DATE_FORMAT, 0, 0);
+	Point->EndOfSegment = 0;
+	Point->Next = NULL;
+
+	if (Parse->Last)
+		Parse->Last->Next = Point;
+	else
+		Parse->First = Point;
+	Parse->Last = Point;
+}
+
+static void ForgetPoint(struct GPXParse* Parse)
+{
+	free(Parse->Lat);
+	free(Parse->Long);
+	free(Parse->Elev);
+	free(Parse->Time);
+	Parse->Lat = Parse->Long = Parse->Elev = Parse->Time = NULL;
+	Parse->Field = NULL;
+}
+
+static void StartElement(void* Data, const xmlChar* Name, const xmlChar* Prefix,
+			 const xmlChar* URI, int NumNamespaces, const xmlChar** Namespaces,
+			 int NumAttributes, int NumDefaulted, const xmlChar** Attributes)
+{
+	struct GPXParse* Parse = (struct GPXParse*) Data;
+	const char* Local = (const char*) Name;
+	int i;
+
+	if (Parse->Depth == 0)
+	{
+		/* Check that this is indeed a GPX - the root node
+		 * should be "gpx". */
+		if (strcmp(Local, "gpx") != 0)
+		{
+			Parse->Invalid = 1;
+			xmlStopParser(Parse->Context);
+			return;
+		}
+		if (Parse->Context->encoding && !Parse->Tail.Encoding)
+			Parse->Tail.Encoding = strdup((const char*) Parse->Context->encoding);
+	}
+
+	if (Parse->Depth == Parse->Size)
+	{
+		int Size = Parse->Size ? Parse->Size * 2 : 16;
+		char** Open = (char**) realloc(Parse->Open, Size * sizeof(*Open));
+		char* InSegment = Open ? (char*) realloc(Parse->InSegment, Size) : NULL;
+		if (Open)
+			Parse->Open = Open;
+		if (!InSegment)
+		{
+			xmlStopParser(Parse->Context);
+			return;
+		}
+		Parse->InSegment = InSegment;
+		Parse->Size = Size;
+	}
+	Parse->Open[Parse->Depth] = NULL;
+	Parse->InSegment[Parse->Depth] = 0;
+	Parse->Depth++;
+
+	if (Parse->PointDepth)
+	{
+		/* Grab the elevation and time, which are children
+		 * of trkpt. */
+		if (Parse->Depth == Parse->PointDepth + 1)
+		{
+			Parse->Field = NULL;
+			if (strcmp(Local, "ele") == 0)
+				Parse->Field = &Parse->Elev;
+			else if (strcmp(Local, "time") == 0)
+				Parse->Field = &Parse->Time;
+			Parse->TextLength = 0;
+		}
+		return;
+	}
+
+	if (Parse->Depth > 1 && Parse->InSegment[Parse->Depth - 2] &&
+	    strcmp(Local, "trkpt") == 0)
+	{
+		/* This is indeed a trackpoint. The Lat and Long are
+		 * attributes. */
+		Parse->PointDepth = Parse->Depth;
+		for (i = 0; i < NumAttributes * 5; i += 5)
+		{
+			char** Value = NULL;
+			if (strcmp((const char*) Attributes[i], "lat") == 0)
+				Value = &Parse->Lat;
+			if (strcmp((const char*) Attributes[i], "lon") == 0)
+				Value = &Parse->Long;
+			if (Value)
 			{
-				/* Ok, adding to the list... */
-				LastPoint->Next = (struct GPSPoint*) malloc(sizeof(struct GPSPoint));
-				LastPoint = LastPoint->Next;
-				LastPoint->Next = NULL;
-			} else {
-				/* This is the first one. */
-				FirstPoint = (struct GPSPoint*) malloc(sizeof(struct GPSPoint));
-				FirstPoint->Next = NULL;
-				LastPoint = FirstPoint;
+				free(*Value);
+				*Value = CopyText(Attributes[i + 3], Attributes[i + 4] - Attributes[i + 3]);
 			}
+		}
+		return;
+	}
+
+	Parse->InSegment[Parse->Depth - 1] = (strcmp(Local, "trkseg") == 0);
+	Parse->Open[Parse->Depth - 1] = StartTag(Name, Prefix, NumNamespaces, Namespaces);
+	Parse->Changed = 1;
+	if (!Parse->Open[Parse->Depth - 1])
+		xmlStopParser(Parse->Context);
+}
+
+static void EndElement(void* Data, const xmlChar* Name, const xmlChar* Prefix,
+		       const xmlChar* URI)
+{
+	struct GPXParse* Parse = (struct GPXParse*) Data;
 
-			/* Clear the structure first... */
-			LastPoint->Lat = 0;
-			LastPoint->LatDecimals = 0;
-			LastPoint->Long = 0;
-			LastPoint->LongDecimals = 0;
-			LastPoint->Elev = 0;
-			LastPoint->ElevDecimals = -1; // default meaning no altitude was found
-			LastPoint->Time = 0;
-			LastPoint->EndOfSegment = 0;
-
-			/* Write the data into LastPoint, which should be a new point. */
-			LastPoint->Lat = atof(Lat);
-			LastPoint->LatDecimals = NumDecimals(Lat);
-			LastPoint->Long = atof(Long);
-			LastPoint->LongDecimals = NumDecimals(Long);
-			if (Elev) {
-				LastPoint->Elev = atof(Elev);
-				LastPoint->ElevDecimals = NumDecimals(Elev);
+	if (Parse->Depth == 0)
+		return;
+	Parse->Depth--;
+
+	if (Parse->PointDepth)
+	{
+		if (Parse->Depth == Parse->PointDepth)
+		{
+			/* End of <ele> or <time>. Any text at all counts. */
+			if (Parse->Field && Parse->Text && Parse->TextLength)
+			{
+				free(*Parse->Field);
+				*Parse->Field = CopyText((const xmlChar*) Parse->Text, Parse->TextLength);
 			}
-			LastPoint->Time = ConvertToUnixTime(Time, GPX_DATE_FORMAT, 0, 0);
-			
-			/* Debug...
-			printf("TrackPoint. Lat %s (%f), Long %s (%f). Elev %s (%f), Time %d.\n",
-					Lat, atof(Lat), Long, atof(Long), Elev, atof(Elev),
-					ConvertToUnixTime(Time, GPX_DATE_FORMAT, 0, 0));
-			printf("Decimals %d %d %d\n", LastPoint->LatDecimals, LastPoint->LongDecimals, LastPoint->ElevDecimals);
-			*/
-			
-					
+			Parse->Field = NULL;
+		} else if (Parse->Depth == Parse->PointDepth - 1) {
+			/* End of the <trkpt>. */
+			AddPoint(Parse);
+			ForgetPoint(Parse);
+			Parse->PointDepth = 0;
+			SaveTail(Parse);
 		}
-	} /* End For. */
+		return;
+	}
 
-	/* Return control to the recursive function... */
+	/* Mark the last point as being the end of a track segment. */
+	if (Parse->InSegment[Parse->Depth])
+	{
+		struct GPSPoint* Last = Parse->Last ? Parse->Last : Parse->Previous;
+		if (Last)
+			Last->EndOfSegment = 1;
+	}
+	free(Parse->Open[Parse->Depth]);
+	Parse->Open[Parse->Depth] = NULL;
+	Parse->Changed = 1;
 }
 
-static void FindTrackSeg(xmlNodePtr Start)
+static void Characters(void* Data, const xmlChar* Text, int Length)
 {
-	/* Go recursive till we find a <trgseg> tag. */
-	xmlNodePtr Current = NULL;
+	struct GPXParse* Parse = (struct GPXParse*) Data;
 
-	for (Current = Start; Current; Current = Current->next)
+	if (!Parse->Field || Parse->Depth != Parse->PointDepth + 1)
+		return;
+	if (Parse->TextLength + Length > Parse->TextSize)
 	{
-		if ((Current->type == XML_ELEMENT_NODE) &&
-			(strcmp((const char *)Current->name, "trkseg") == 0))
+		size_t Size = (Parse->TextLength + Length) * 2;
+		char* Bigger = (char*) realloc(Parse->Text, Size);
+		if (!Bigger)
 		{
-			/* Found it... the children should
-			 * all be trkpt's. */
-			ExtractTrackPoints(Current->children);
-			
-			/* Mark the last point as being the end
-			 * of a track segment. */
-			if (LastPoint) LastPoint->EndOfSegment = 1;
-			
+			xmlStopParser(Parse->Context);
+			return;
 		}
-		
-		/* And again, with children of this node. */
-		FindTrackSeg(Current->children);
-		
-	} /* End For */
+		Parse->Text = Bigger;
+		Parse->TextSize = Size;
+	}
+	memcpy(Parse->Text + Parse->TextLength, Text, Length);
+	Parse->TextLength += Length;
+}
 
+static void FreeParse(struct GPXParse* Parse)
+{
+	struct GPSPoint* Next;
+
+	while (Parse->Depth > 0)
+		free(Parse->Open[--Parse->Depth]);
+	free(Parse->Open);
+	free(Parse->InSegment);
+	ForgetPoint(Parse);
+	free(Parse->Text);
+	while (Parse->First)
+	{
+		Next = Parse->First->Next;
+		free(Parse->First);
+		Parse->First = Next;
+	}
+	free(Parse->Tail.Prefix);
+	free(Parse->Tail.Encoding);
 }
 
 /* Determines and stores the min and max times from the GPS track */
@@ -223,93 +523,397 @@ static void GetTrackRange(struct GPSTrack* Track)
 	}
 }
 
+int IndexTrack(struct GPSTrack* Track)
+{
+	const struct GPSPoint* Point;
+	time_t Latest;
+	long i = 0;
+
+	free(Track->Index);
+	free(Track->LatestBy);
+	Track->Index = NULL;
+	Track->LatestBy = NULL;
+
+	Track->NumPoints = 0;
+	for (Point = Track->Points; Point; Point = Point->Next)
+		Track->NumPoints++;
+	if (!Track->NumPoints)
+		return 1;
+
+	Track->Index = (struct GPSPoint**) malloc(Track->NumPoints * sizeof(*Track->Index));
+	Track->LatestBy = (time_t*) malloc(Track->NumPoints * sizeof(*Track->LatestBy));
+	if (!Track->Index || !Track->LatestBy)
+	{
+		free(Track->Index);
+		free(Track->LatestBy);
+		Track->Index = NULL;
+		Track->LatestBy = NULL;
+		return 0;
+	}
 
-int ReadGPX(const char* File, struct GPSTrack* Track)
+	/* Points aren't always in time order, so keep the latest time
+	 * seen so far, which always is. */
+	Latest = Track->Points->Time;
+	for (Point = Track->Points; Point; Point = Point->Next, i++)
+	{
+		if (Point->Time > Latest)
+			Latest = Point->Time;
+		Track->Index[i] = (struct GPSPoint*) Point;
+		Track->LatestBy[i] = Latest;
+	}
+	return 1;
+}
+
+/* Adds Count points, from First on, which have just been put on the
+ * end of the track, to its index. */
+static void ExtendIndex(struct GPSTrack* Track, struct GPSPoint* First, long Count)
 {
-	/* Init the libxml library. Also checks version. */
-	LIBXML_TEST_VERSION
+	struct GPSPoint** Index;
+	time_t* LatestBy;
+	time_t Latest;
+	long i;
 
-	xmlDocPtr GPXData;
-	
-	/* Read the GPX data from file. */
-	GPXData = xmlParseFile(File);
-	if (GPXData == NULL)
+	if (!Track->Index)
 	{
-		fprintf(stderr, _("Failed to parse GPX data from %s.\n"), File);
+		IndexTrack(Track);
+		return;
+	}
+
+	Index = (struct GPSPoint**) realloc(Track->Index, (Track->NumPoints + Count) * sizeof(*Index));
+	if (Index)
+		Track->Index = Index;
+	LatestBy = (time_t*) realloc(Track->LatestBy, (Track->NumPoints + Count) * sizeof(*LatestBy));
+	if (LatestBy)
+		Track->LatestBy = LatestBy;
+	if (!Index || !LatestBy)
+	{
+		IndexTrack(Track);
+		return;
+	}
+
+	Latest = Track->LatestBy[Track->NumPoints - 1];
+	for (i = Track->NumPoints; First; First = First->Next, i++)
+	{
+		if (First->Time > Latest)
+			Latest = First->Time;
+		Track->Index[i] = First;
+		Track->LatestBy[i] = Latest;
+	}
+	Track->NumPoints = i;
+}
+
+/* Returns 1 if the file at F still has, at the start and just before
+ * where Tail says the last read got to, what it had then. */
+static int TailUnchanged(FILE* F, const struct GPXTail* Tail)
+{
+	unsigned char Before[sizeof(Tail->Before)];
+
+	if (!Tail->Offset || !Tail->Prefix || !Tail->Resumable)
+		return 0;
+	if (fread(Before, 1, Tail->StartLength, F) != (size_t) Tail->StartLength ||
+	    memcmp(Before, Tail->Start, Tail->StartLength) != 0)
+		return 0;
+	if (fseek(F, Tail->Offset - Tail->BeforeLength, SEEK_SET) != 0)
+		return 0;
+	if (fread(Before, 1, Tail->BeforeLength, F) != (size_t) Tail->BeforeLength)
 		return 0;
+	return memcmp(Before, Tail->Before, Tail->BeforeLength) == 0;
+}
+
+/* Returns 1 if the text after Offset can be handed to a parser after
+ * an ASCII prefix: the file isn't in UTF-16 or the like. */
+static int CanResume(FILE* F, const char* Encoding)
+{
+	unsigned char Start[4];
+	size_t Got;
+
+	if (Encoding)
+	{
+		switch (xmlParseCharEncoding(Encoding))
+		{
+			case XML_CHAR_ENCODING_UTF8:
+			case XML_CHAR_ENCODING_ASCII:
+			case XML_CHAR_ENCODING_8859_1:
+			case XML_CHAR_ENCODING_8859_2:
+			case XML_CHAR_ENCODING_8859_3:
+			case XML_CHAR_ENCODING_8859_4:
+			case XML_CHAR_ENCODING_8859_5:
+			case XML_CHAR_ENCODING_8859_6:
+			case XML_CHAR_ENCODING_8859_7:
+			case XML_CHAR_ENCODING_8859_8:
+			case XML_CHAR_ENCODING_8859_9:
+				break;
+			default:
+				return 0;
+		}
 	}
 
-	/* Now grab the "root" node. */
-	xmlNodePtr GPXRoot;
-	GPXRoot = xmlDocGetRootElement(GPXData);
+	rewind(F);
+	Got = fread(Start, 1, sizeof(Start), F);
+	return !memchr(Start, 0, Got) &&
+		!(Got >= 2 && ((Start[0] == 0xFE && Start[1] == 0xFF) ||
+			       (Start[0] == 0xFF && Start[1] == 0xFE)));
+}
+
+/* Returns 1 if F starts as a gzip file does. libxml used to read these
+ * for us, so they're still read, through zlib. */
+static int IsCompressed(FILE* F)
+{
+	unsigned char Magic[2];
+	int Compressed = fread(Magic, 1, 2, F) == 2 &&
+		Magic[0] == 0x1f && Magic[1] == 0x8b;
+	rewind(F);
+	return Compressed;
+}
+
+/* Reads the next part of the file into Chunk. Returns how much was
+ * read, 0 at the end, or -1 on an error. */
+static long ReadChunk(FILE* F, gzFile Compressed, char* Chunk)
+{
+	if (Compressed)
+		return gzread(Compressed, Chunk, GPX_CHUNK);
+	long Got = (long) fread(Chunk, 1, GPX_CHUNK, F);
+	return Got == 0 && ferror(F) ? -1 : Got;
+}
+
+/* Reads File into Track. A file that must be Finished is read from
+ * the start; otherwise the read carries on from where the last one got
+ * to, if the file hasn't changed before there; a compressed file is
+ * always read from the start. Progress, if given, is kept up to date
+ * as we go. */
+static int ParseGPX(const char* File, struct GPSTrack* Track, int Finished,
+		    struct GPXProgress* Progress)
+{
+	struct GPXTail* Tail = Finished ? NULL : Track->Tail;
+	int EndOfSegment = 0;
+	struct GPXParse Parse;
+	xmlSAXHandler Handler;
+	char* Chunk;
+	long Got = 0;
+	long long FileRead = 0;    /* Compressed, if it is. */
+	FILE* F;
+	gzFile Compressed = NULL;
+	int Ok;
+	int Cancelled = 0;
+
+	F = fopen(File, "rb");
+	if (F && IsCompressed(F))
+	{
+		Compressed = gzopen(File, "rb");
+		if (!Compressed)
+		{
+			fclose(F);
+			F = NULL;
+		}
+	}
+	if (!F)
+	{
+		fprintf(stderr, _("Failed to parse GPX data from %s.\n"), File);
+		return 0;
+	}
+	Chunk = (char*) malloc(GPX_CHUNK);
+	if (!Chunk)
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		if (Compressed)
+			gzclose(Compressed);
+		fclose(F);
+		return 0;
+	}
 
-	if (GPXRoot == NULL)
+	memset(&Handler, 0, sizeof(Handler));
+	Handler.initialized = XML_SAX2_MAGIC;
+	Handler.startElementNs = StartElement;
+	Handler.endElementNs = EndElement;
+	Handler.characters = Characters;
+	Handler.cdataBlock = Characters;
+	Handler.warning = xmlParserWarning;
+	Handler.error = xmlParserError;
+
+	memset(&Parse, 0, sizeof(Parse));
+	Parse.Context = xmlCreatePushParserCtxt(&Handler, &Parse, NULL, 0, File);
+	if (!Parse.Context)
 	{
-		fprintf(stderr, _("GPX file has no root. Not healthy.\n"));
-		xmlFreeDoc(GPXData);
-		xmlCleanupParser();
+		fprintf(stderr, _("Out of memory\n"));
+		free(Chunk);
+		if (Compressed)
+			gzclose(Compressed);
+		fclose(F);
 		return 0;
 	}
 
-	/* Check that this is indeed a GPX - the root node
-	 * should be "gpx". */
-	if (strcmp((const char *)GPXRoot->name, "gpx") == 0)
+	if (Tail && !Compressed && Track->Points && TailUnchanged(F, Tail))
 	{
-		/* Ok, it is a GPX file. */
+		/* Only new points, then. Put the parser back the way it was
+		 * after the last point, and go on from there. */
+		if (Track->Index)
+			Parse.Previous = Track->Index[Track->NumPoints - 1];
+		else
+			for (Parse.Previous = Track->Points; Parse.Previous->Next; )
+				Parse.Previous = Parse.Previous->Next;
+		EndOfSegment = Parse.Previous->EndOfSegment;
+		Parse.Previous->EndOfSegment = Tail->EndOfSegment;
+
+		if (Tail->Encoding)
+			snprintf(Chunk, GPX_CHUNK, "<?xml version=\"1.0\" encoding=\"%s\"?>", Tail->Encoding);
+		else
+			snprintf(Chunk, GPX_CHUNK, "<?xml version=\"1.0\"?>");
+		Parse.Tail = *Tail;
+		Parse.Tail.Prefix = strdup(Tail->Prefix);
+		Parse.Tail.Encoding = Tail->Encoding ? strdup(Tail->Encoding) : NULL;
+		Parse.Skew = Tail->Offset - (long) strlen(Chunk) - (long) strlen(Tail->Prefix);
+		xmlParseChunk(Parse.Context, Chunk, strlen(Chunk), 0);
+		xmlParseChunk(Parse.Context, Tail->Prefix, strlen(Tail->Prefix), 0);
 	} else {
-		/* Not valid. */
-		fprintf(stderr, _("Invalid GPX file.\n"));
-		xmlFreeDoc(GPXData);
-		xmlCleanupParser();
+		/* From the start. */
+		Tail = NULL;
+		rewind(F);
+	}
+
+	while (Parse.Context->wellFormed && !Parse.Invalid && !Cancelled &&
+	       (Got = ReadChunk(F, Compressed, Chunk)) > 0)
+	{
+		xmlParseChunk(Parse.Context, Chunk, Got, 0);
+		if (Progress)
+		{
+			/* Progress is in bytes of the file as it is on disk,
+			 * to go with its size. */
+			long long Now = Compressed ? (long long) gzoffset(Compressed) : FileRead + Got;
+			__atomic_fetch_add(&Progress->Done, Now - FileRead, __ATOMIC_RELAXED);
+			FileRead = Now;
+			Cancelled = __atomic_load_n(&Progress->Cancel, __ATOMIC_RELAXED);
+		}
+	}
+	if (Finished && Parse.Context->wellFormed && !Parse.Invalid && !Cancelled)
+		xmlParseChunk(Parse.Context, NULL, 0, 1);
+
+	Ok = Parse.Context->wellFormed && !Parse.Invalid && !Cancelled && Got >= 0;
+	if (Ok && !Tail)
+		Parse.Tail.Resumable = !Compressed && CanResume(F, Parse.Tail.Encoding);
+	if (Ok && Parse.Tail.Offset && !Compressed)
+	{
+		/* Keep the last few bytes read, to check next time. */
+		Parse.Tail.BeforeLength = Parse.Tail.Offset < (long) sizeof(Parse.Tail.Before) ?
+			(int) Parse.Tail.Offset : (int) sizeof(Parse.Tail.Before);
+		Parse.Tail.StartLength = Parse.Tail.BeforeLength;
+		rewind(F);
+		Ok = fread(Parse.Tail.Start, 1, Parse.Tail.StartLength, F) ==
+				(size_t) Parse.Tail.StartLength &&
+			fseek(F, Parse.Tail.Offset - Parse.Tail.BeforeLength, SEEK_SET) == 0 &&
+			fread(Parse.Tail.Before, 1, Parse.Tail.BeforeLength, F) ==
+				(size_t) Parse.Tail.BeforeLength;
+	}
+	if (!Ok && !Cancelled)
+	{
+		if (Parse.Invalid)
+			fprintf(stderr, _("Invalid GPX file.\n"));
+		else
+			fprintf(stderr, _("Failed to parse GPX data from %s.\n"), File);
+	}
+	if (Ok && !Tail && !Parse.First && Track->Points)
+	{
+		/* Rewritten, and not yet with any points; most likely
+		 * caught half way. Keep what we had. */
+		fprintf(stderr, _("No GPS points in %s; keeping those read before.\n"), File);
+		Ok = 0;
+	}
+
+	xmlFreeParserCtxt(Parse.Context);
+	Parse.Context = NULL;
+	free(Chunk);
+	if (Compressed)
+		gzclose(Compressed);
+	fclose(F);
+
+	if (!Ok)
+	{
+		/* Leave the track as it was. */
+		if (Tail)
+			Parse.Previous->EndOfSegment = EndOfSegment;
+		FreeParse(&Parse);
 		return 0;
 	}
 
-	/* Now comes the messy part... walking the tree to find
-	 * what we want.
-	 * I've chosen to do it with two functions, one of which
-	 * is recursive, rather than a clever inside-this-function
-	 * walk the tree thing.
-	 * 
-	 * We start by calling the recursive function to look for
-	 * <trkseg> tags, and then that function calls another
-	 * when it has found one... this sub function then
-	 * hauls out the <trkpt> tags with the actual data.
-	 * Messy, convoluted, but it seems to work... */
-	/* As to where to store the data? Again, its messy.
-	 * We maintain two global vars, FirstPoint and LastPoint.
-	 * FirstPoint points to the first GPSPoint done, and
-	 * LastPoint is the last point done, used for the next
-	 * point... we use this to build a singly-linked list. */
-	/* (I think I'll just be grateful for the work that libxml
-	 * puts in for me... imagine having to write an XML parser!
-	 * Nasty.) */
-	/* Before we go into this function, we also setlocale to "C".
-	 * The GPX def indicates that the decimal separator should be
-	 * ".", but certain locales specify otherwise. Which has caused issues.
-	 * So we set the locale for this function, and then revert it.
-	 */
-	
-	FirstPoint = NULL;
-	LastPoint = NULL;
-	
-	char* OldLocale = setlocale(LC_NUMERIC, "C");
-	
-	FindTrackSeg(GPXRoot);
-
-	setlocale(LC_NUMERIC, OldLocale);
-
-	/* Clean up stuff for the XML library. */
-	xmlFreeDoc(GPXData);
-	xmlCleanupParser();
-
-	Track->Points = FirstPoint;
-
-	/* Find the time range for this track */
-	GetTrackRange(Track);
+	if (Tail)
+	{
+		/* Add the new points to the end. */
+		struct GPSPoint* Point;
+		long Count = 0;
+		Parse.Previous->Next = Parse.First;
+		for (Point = Parse.First; Point; Point = Point->Next, Count++)
+		{
+			if (Point->Time < Track->MinTime)
+				Track->MinTime = Point->Time;
+			if (Point->Time > Track->MaxTime)
+				Track->MaxTime = Point->Time;
+		}
+		if (Count)
+			ExtendIndex(Track, Parse.First, Count);
+	} else {
+		FreeTrack(Track);
+		Track->Points = Parse.First;
+		/* Find the time range for this track */
+		GetTrackRange(Track);
+		IndexTrack(Track);
+	}
+	Parse.First = NULL;
 
+	/* Remember where we got to, for next time. */
+	if (!Track->Tail)
+		Track->Tail = (struct GPXTail*) calloc(1, sizeof(*Track->Tail));
+	if (Track->Tail)
+	{
+		free(Track->Tail->Prefix);
+		free(Track->Tail->Encoding);
+		*Track->Tail = Parse.Tail;
+		Parse.Tail.Prefix = NULL;
+		Parse.Tail.Encoding = NULL;
+	}
+
+	FreeParse(&Parse);
 	return 1;
 }
 
+void InitGPX(void)
+{
+	/* Init the libxml library. Also checks version. */
+	LIBXML_TEST_VERSION
+	xmlInitParser();
+}
+
+int ReadGPX(const char* File, struct GPSTrack* Track)
+{
+	return ReadGPXWatched(File, Track, NULL);
+}
+
+int ReadGPXWatched(const char* File, struct GPSTrack* Track,
+		   struct GPXProgress* Progress)
+{
+	LIBXML_TEST_VERSION
+
+	long long Began = StatsBegin();
+
+	/* The file is read as it goes past, calling us back for each
+	 * element, rather than being read into a tree first, which took
+	 * a lot of memory for big tracks. As it goes, we note where we
+	 * got to, so that UpdateGPX can carry on from there.
+	 * The XML library isn't cleaned up afterwards: that's only safe
+	 * once nothing else will use it, in any thread. */
+	int Ok = ParseGPX(File, Track, 1, Progress);
+
+	StatsEndFile(STATS_GPX_PARSE, Began, File);
+	return Ok;
+}
+
+int UpdateGPX(const char* File, struct GPSTrack* Track)
+{
+	LIBXML_TEST_VERSION
+
+	long long Began = StatsBegin();
+	int Ok = ParseGPX(File, Track, 0, NULL);
+	StatsEndFile(STATS_GPX_PARSE, Began, File);
+	return Ok;
+}
 
 void FreeTrack(struct GPSTrack* Track)
 {
@@ -325,4 +929,30 @@ void FreeTrack(struct GPSTrack* Track)
 		CurrentFree = NextFree;
 	}
 	Track->Points = NULL;
+
+	free(Track->Index);
+	free(Track->LatestBy);
+	Track->Index = NULL;
+	Track->LatestBy = NULL;
+	Track->NumPoints = 0;
+
+	if (Track->Tail)
+	{
+		free(Track->Tail->Prefix);
+		free(Track->Tail->Encoding);
+		free(Track->Tail);
+		Track->Tail = NULL;
+	}
+}
+
+void GatherTracks(const struct GPSTrack* Tracks, int Count,
+		  struct GPSTrack* Into)
+{
+	int i;
+	for (i = 0; i < Count; i++)
+	{
+		if (Tracks[i].Points)
+			*Into++ = Tracks[i];
+	}
+	memset(Into, 0, sizeof(*Into));
 }
@@ -27,5 +27,45 @@
 
 struct GPSTrack;
 
+/* Gets the XML library ready. The first read does this anyway, but
+ * it must be done before reading on more than one thread at once. */
+void InitGPX(void);
+
 int ReadGPX(const char* File, struct GPSTrack* Track);
+
+/* For keeping an eye on ReadGPXWatched from another thread. Done is
+ * added to, atomically, as each part of the file is read. Setting
+ * Cancel (atomically) makes the read stop soon after, and fail. */
+struct GPXProgress {
+	long long Done;   /* Bytes of the file read. */
+	int Cancel;
+};
+
+/* ReadGPX, keeping Progress up to date. Any number of these can go
+ * on at once, on different threads, once InitGPX has been called. */
+int ReadGPXWatched(const char* File, struct GPSTrack* Track,
+		   struct GPXProgress* Progress);
+
+/* Brings Track, read from File by ReadGPX or UpdateGPX, up to date
+ * with it. If points have only been added to the file since, only
+ * those are read, and added to the end of the track; otherwise, the
+ * whole file is read again. To tell, only the start of the file and
+ * the end of the last point read are compared. Unlike ReadGPX, the
+ * file needn't be finished, so a log still being written can be
+ * followed. Returns 0 if the file can't be read, leaving Track as it
+ * was. */
+int UpdateGPX(const char* File, struct GPSTrack* Track);
 void FreeTrack(struct GPSTrack* Track);
+
+/* Copies those of the Count tracks at Tracks that have any points to
+ * Into, then an empty track to end them, as CorrelateOptions wants.
+ * A log still being written may have no points yet, and would end the
+ * list early. Into needs room for Count + 1; the points are shared,
+ * so it must be gathered again after any of the tracks changes. */
+void GatherTracks(const struct GPSTrack* Tracks, int Count,
+		  struct GPSTrack* Into);
+
+/* Builds the index CorrelateTime uses to find points in a track
+ * quickly. ReadGPX does this itself. Returns 0 if there wasn't the
+ * memory, which only makes matching slower. */
+int IndexTrack(struct GPSTrack* Track);
@@ -37,6 +37,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 
 #include <gdk/gdkkeysyms.h>
 #include <gtk/gtk.h>
@@ -45,8 +46,12 @@
 #include "gpsstructure.h"
 #include "gui.h"
 #include "exif-gps.h"
+#include "photo-cache.h"
 #include "gpx-read.h"
 #include "correlate.h"
+#include "unixtime.h"
+#include "workpool.h"
+#include "photo-list.h"
 
 /* Declare all our widgets. Global to this module. */
 GtkWidget *MatchWindow;
@@ -99,22 +104,14 @@ GtkWidget *StripGPSButton;
 GtkWidget *PhotoListVBox;
 GtkWidget *PhotoListScroll;
 GtkWidget *PhotoList;
+GtkWidget *PreviewLabel;
+GtkWidget *ProgressHBox;
+GtkWidget *ProgressBar;
+GtkWidget *CancelButton;
 GtkTooltips *tooltips;
 
-/* Enum and other stuff for the Photo list box. */
-enum
-{
-	LIST_FILENAME,
-	LIST_LAT,
-	LIST_LONG,
-	LIST_ELEV,
-	LIST_TIME,
-	LIST_STATE,
-	LIST_POINTER,
-	LIST_NOCOLUMNS
-};
-
-GtkListStore *PhotoListStore;
+/* Stuff for the Photo list box. */
+GtkTreeModel *PhotoListModel;
 GtkCellRenderer *PhotoListRenderer;
 GtkTreeViewColumn *FileColumn;
 GtkTreeViewColumn *LatColumn;
@@ -123,21 +120,93 @@ GtkTreeViewColumn *ElevColumn;
 GtkTreeViewColumn *TimeColumn;
 GtkTreeViewColumn *StateColumn;
 
-/* Structure and variables for holding the list of
- * photos in memory. */
+/* Variables for holding the list of photos in memory. There is
+ * one entry for each row of PhotoListModel, in the same order, so
+ * a row's number is its index in Photos. The threads are handed
+ * these indexes, so Photos isn't moved while they're running:
+ * ReservePhotos makes room for a batch before any of it is handed
+ * over. */
+struct GUIPhoto* Photos = NULL;
+int NumPhotos = 0;
+int PhotoSpace = 0;		// Entries allocated at Photos
+
+struct GPSTrack* GPSData;  	// Array of track entries; empty entry is last
+int NumTracks;			// Number of entries at GPSData
+
+struct PhotoCache* PhotoCache;	// Photo metadata cache, or NULL
+
+/* Reading photos as they're added, and correlating them, run on a
+ * pool of threads, so the window carries on working. The threads put
+ * what they've done on a list, and the main loop picks it up at most
+ * once a frame, however fast photos are getting done, rather than
+ * redrawing after each one. */
+#define RESULTS_FRAME_MS 16
+
+/* Adding or removing more photos than this at once takes the list
+ * away from the tree view while it's done, so it isn't kept up to
+ * date after every one. */
+#define BULK_ROWS 100
+
+struct PhotoJob {
+	int Photo;                 /* Index into Photos. */
+	int Skipped;               /* The run was cancelled first. */
 
-struct GUIPhotoList {
-	char* Filename;
+	/* What was read from a photo being added. */
 	char* Time;
-	GtkTreeIter ListPointer;
-	struct GUIPhotoList* Next;
+	time_t Epoch;
+	double Lat, Long, Elev;
+	int IncludesGPS;
+
+	/* What correlating a photo came to. */
+	struct GPSPoint* Point;    /* What CorrelatePhoto returned. */
+	int Result;                /* And its Options.Result. */
+
+	struct PhotoJob* Next;
 };
 
-struct GUIPhotoList* FirstPhoto = NULL;
-struct GUIPhotoList* LastPhoto = NULL;
+struct PhotoRun {
+	void (*Do)(struct PhotoRun* Run, struct PhotoJob* Job); /* On a thread. */
+	void (*Show)(struct PhotoJob* Job); /* On the main loop, afterwards. */
+	int Follow;                /* Scroll to the last photo shown. */
+	struct CorrelateOptions Options; /* Each job gets its own copy. */
+	struct WorkPool* Pool;
+	int Total;                 /* Photos in the run, */
+	int Shown;                 /* and how many are on the screen. */
+
+	pthread_mutex_t Lock;      /* Over the rest. */
+	int Cancelled;
+	struct PhotoJob* Done;     /* Newest first; not shown yet. */
+	int Posted;                /* ShowDone is on its way. */
+	long long LastShown;       /* When it last ran. */
+};
 
-struct GPSTrack* GPSData;  	// Array of track entries; empty entry is last
-int NumTracks;			// Number of entries at GPSData
+struct PhotoRun* Running = NULL; // Photos being read or correlated, or NULL
+
+/* GPX files are read on the pool of threads too, all at once. The
+ * tracks already loaded are kept until every one of the new files has
+ * been read, so cancelling, or a file that can't be read, leaves
+ * things as they were. */
+#define GPX_PROGRESS_MS 100
+
+struct GPXFile {
+	char* Name;
+	struct GPSTrack Track;
+	int Ok;
+};
+
+struct GPXLoad {
+	struct GPXFile* Files;
+	int NumFiles;
+	long long TotalBytes;      /* Size of all the files together. */
+	struct GPXProgress Progress; /* Shared by all the threads. */
+	int Remaining;             /* Files still being read; atomic. */
+	struct WorkPool* Pool;
+	guint Timer;               /* Keeps the progress bar moving. */
+};
+
+struct GPXLoad* LoadingGPX = NULL; // GPX files being read, or NULL
+
+int PreviewPosted = 0;		// PreviewMatches is on its way
 
 static const char* const ConfigDefaults[] = {
 	"interpolate", "true",
@@ -162,18 +231,41 @@ gchar* PhotoOpenDir = NULL;
 static gboolean DestroyWindow(GtkWidget *Widget, GdkEvent *Event, gpointer Data);
 
 static void AddPhotosButtonPress(GtkWidget *Widget, gpointer Data);
-static void AddPhotoToList(const char* Filename);
+static int ReservePhotos(int More);
+static int AddPhotoToList(const char* Filename);
 static void RemovePhotosButtonPress( GtkWidget *Widget, gpointer Data );
 
-static void SetListItem(GtkTreeIter* Iter, const char* Filename,
-			const char* Time, double Lat, double Long, double Elev,
-			const char* PassedState, int IncludesGPS);
+static void ShowRows(int First, int Last);
 
 static void SelectGPSButtonPress( GtkWidget *Widget, gpointer Data );
 static void CorrelateButtonPress( GtkWidget *Widget, gpointer Data );
+static void CancelButtonPress( GtkWidget *Widget, gpointer Data );
 static void StripGPSButtonPress( GtkWidget *Widget, gpointer Data );
-
-static void GtkGUIUpdate(void);
+static void MatchOptionChanged( GtkWidget *Widget, gpointer Data );
+
+static void ReadCorrelateOptions(struct CorrelateOptions* Options);
+static gboolean PreviewMatches(gpointer Data);
+
+static struct PhotoRun* StartPhotoRun(
+		void (*Do)(struct PhotoRun* Run, struct PhotoJob* Job),
+		void (*Show)(struct PhotoJob* Job), int Follow);
+static void QueuePhoto(struct PhotoRun* Run, int Photo);
+static void AllQueued(struct PhotoRun* Run);
+static void PhotoWork(void* Data, void* RunData);
+static gboolean ShowDone(gpointer Data);
+static void FinishPhotoRun(struct PhotoRun* Run);
+static void SetBusy(int Busy);
+
+static void ReadGPXWork(void* Data, void* LoadData);
+static gboolean ShowGPXProgress(gpointer Data);
+static gboolean GPXLoaded(gpointer Data);
+
+static void ReadPhoto(struct PhotoRun* Run, struct PhotoJob* Job);
+static void ShowPhotoRead(struct PhotoJob* Job);
+static void CorrelateOne(struct PhotoRun* Run, struct PhotoJob* Job);
+static void ShowCorrelated(struct PhotoJob* Job);
+static void StripOne(struct PhotoRun* Run, struct PhotoJob* Job);
+static void ShowStripped(struct PhotoJob* Job);
 
 /* Load settings, insert defaults. */
 void LoadSettings(void)
@@ -347,6 +439,8 @@ GtkWidget* CreateMatchWindow (void)
 	_("Interpolate between points. If disabled, points will be rounded to "
 	  "the nearest recorded point."), NULL);
   gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (InterpolateCheck), g_key_file_get_boolean(GUISettings, "default", "interpolate", NULL));
+  g_signal_connect (G_OBJECT (InterpolateCheck), "toggled",
+  		G_CALLBACK (MatchOptionChanged), NULL);
 
   NoWriteCheck = gtk_check_button_new_with_mnemonic (_("Don't write"));
   gtk_widget_show (NoWriteCheck);
@@ -369,6 +463,8 @@ GtkWidget* CreateMatchWindow (void)
 	  "to show where data was available and not available, but you might "
 	  "still want to interpolate between segments."), NULL);
   gtk_toggle_button_set_active (GTK_TOGGLE_BUTTON (BetweenSegmentsCheck), g_key_file_get_boolean(GUISettings, "default", "betweensegments", NULL));
+  g_signal_connect (G_OBJECT (BetweenSegmentsCheck), "toggled",
+  		G_CALLBACK (MatchOptionChanged), NULL);
 
   DegMinSecsCheck = gtk_check_button_new_with_mnemonic (_("Write DD MM SS.SS"));
   gtk_widget_show (DegMinSecsCheck);
@@ -421,6 +517,8 @@ GtkWidget* CreateMatchWindow (void)
 	  "in seconds. If a photos time is outside this value from any point, "
 	  "it will not be matched."), NULL);
   gtk_entry_set_text (GTK_ENTRY (GapTimeEntry), g_key_file_get_value(GUISettings, "default", "maxgap", NULL));
+  g_signal_connect (G_OBJECT (GapTimeEntry), "changed",
+  		G_CALLBACK (MatchOptionChanged), NULL);
   gtk_entry_set_width_chars (GTK_ENTRY (GapTimeEntry), 7);
 
   TimeZoneEntry = gtk_entry_new ();
@@ -434,6 +532,8 @@ GtkWidget* CreateMatchWindow (void)
 	  "Enter +8:00 here so that the correct adjustment to the photos time "
 	  "can be made. GPS data is always in UTC."), NULL);
   gtk_entry_set_text (GTK_ENTRY (TimeZoneEntry), g_key_file_get_value(GUISettings, "default", "timezone", NULL));
+  g_signal_connect (G_OBJECT (TimeZoneEntry), "changed",
+  		G_CALLBACK (MatchOptionChanged), NULL);
   gtk_entry_set_width_chars (GTK_ENTRY (TimeZoneEntry), 7);
   
   PhotoOffsetEntry = gtk_entry_new ();
@@ -446,6 +546,8 @@ GtkWidget* CreateMatchWindow (void)
 	  "the GPS data. Calculate this with (GPS - Photo). "
 	  "Can be negative or positive."), NULL);
   gtk_entry_set_text (GTK_ENTRY (PhotoOffsetEntry), g_key_file_get_value(GUISettings, "default", "photooffset", NULL));
+  g_signal_connect (G_OBJECT (PhotoOffsetEntry), "changed",
+  		G_CALLBACK (MatchOptionChanged), NULL);
   gtk_entry_set_width_chars (GTK_ENTRY (PhotoOffsetEntry), 7);
 
   GPSDatumEntry = gtk_entry_new ();
@@ -522,17 +624,33 @@ GtkWidget* CreateMatchWindow (void)
   gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (PhotoListScroll), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
   gtk_scrolled_window_set_shadow_type (GTK_SCROLLED_WINDOW (PhotoListScroll), GTK_SHADOW_IN);
 
-  /* Get the photo list store ready. */
-  PhotoListStore = gtk_list_store_new(LIST_NOCOLUMNS,
-		  G_TYPE_STRING,  /* The Filename */
-		  G_TYPE_STRING,  /* Latitude     */
-		  G_TYPE_STRING,  /* Longitude    */
-		  G_TYPE_STRING,  /* Elevation    */
-		  G_TYPE_STRING,  /* The Time     */
-		  G_TYPE_STRING,  /* The State    */
-		  G_TYPE_POINTER); /* Pointer to the matching list item. */
-
-  PhotoList = gtk_tree_view_new_with_model (GTK_TREE_MODEL(PhotoListStore));
+  /* How many photos the time zone and offset being tried out
+   * match. Only shown once they've been changed. */
+  PreviewLabel = gtk_label_new ("");
+  gtk_box_pack_start (GTK_BOX (PhotoListVBox), PreviewLabel, FALSE, FALSE, 2);
+  gtk_misc_set_alignment (GTK_MISC (PreviewLabel), 0, 0.5);
+
+  /* Progress of reading or correlating photos. Only shown while
+   * that's going on. */
+  ProgressHBox = gtk_hbox_new (FALSE, 4);
+  gtk_box_pack_start (GTK_BOX (PhotoListVBox), ProgressHBox, FALSE, FALSE, 2);
+
+  ProgressBar = gtk_progress_bar_new ();
+  gtk_widget_show (ProgressBar);
+  gtk_box_pack_start (GTK_BOX (ProgressHBox), ProgressBar, TRUE, TRUE, 0);
+
+  CancelButton = gtk_button_new_from_stock (GTK_STOCK_CANCEL);
+  gtk_widget_show (CancelButton);
+  gtk_box_pack_start (GTK_BOX (ProgressHBox), CancelButton, FALSE, FALSE, 0);
+  gtk_tooltips_set_tip (tooltips, CancelButton,
+	_("Stop once the photos being worked on now are done."), NULL);
+  g_signal_connect (G_OBJECT (CancelButton), "clicked",
+  		G_CALLBACK (CancelButtonPress), NULL);
+
+  /* Get the photo list model ready. */
+  PhotoListModel = NewPhotoListModel(&Photos, &NumPhotos);
+
+  PhotoList = gtk_tree_view_new_with_model (PhotoListModel);
   gtk_widget_show (PhotoList);
   gtk_container_add (GTK_CONTAINER (PhotoListScroll), PhotoList);
 
@@ -546,6 +664,8 @@ GtkWidget* CreateMatchWindow (void)
 							"text", LIST_FILENAME,
 							NULL);
   gtk_tree_view_column_set_resizable (FileColumn, TRUE);
+  gtk_tree_view_column_set_sizing (FileColumn, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (FileColumn, 200);
   gtk_tree_view_append_column (GTK_TREE_VIEW (PhotoList), FileColumn);
 
   /* Latitude Column. */
@@ -553,6 +673,8 @@ GtkWidget* CreateMatchWindow (void)
 							"text", LIST_LAT,
 							NULL);
   gtk_tree_view_column_set_resizable (LatColumn, TRUE);
+  gtk_tree_view_column_set_sizing (LatColumn, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (LatColumn, 130);
   gtk_tree_view_append_column (GTK_TREE_VIEW (PhotoList), LatColumn);
   
   /* Longitude Column. */
@@ -560,6 +682,8 @@ GtkWidget* CreateMatchWindow (void)
 							"text", LIST_LONG,
 							NULL);
   gtk_tree_view_column_set_resizable (LongColumn, TRUE);
+  gtk_tree_view_column_set_sizing (LongColumn, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (LongColumn, 130);
   gtk_tree_view_append_column (GTK_TREE_VIEW (PhotoList), LongColumn);
   
   /* Elevation Column. */
@@ -567,6 +691,8 @@ GtkWidget* CreateMatchWindow (void)
 							"text", LIST_ELEV,
 							NULL);
   gtk_tree_view_column_set_resizable (ElevColumn, TRUE);
+  gtk_tree_view_column_set_sizing (ElevColumn, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (ElevColumn, 90);
   gtk_tree_view_append_column (GTK_TREE_VIEW (PhotoList), ElevColumn);
   
   /* Time column. */
@@ -574,6 +700,8 @@ GtkWidget* CreateMatchWindow (void)
 							"text", LIST_TIME,
 							NULL);
   gtk_tree_view_column_set_resizable (TimeColumn, TRUE);
+  gtk_tree_view_column_set_sizing (TimeColumn, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (TimeColumn, 150);
   gtk_tree_view_append_column (GTK_TREE_VIEW (PhotoList), TimeColumn);
 
   /* State column. */
@@ -581,13 +709,31 @@ GtkWidget* CreateMatchWindow (void)
 							"text", LIST_STATE,
 							NULL);
   gtk_tree_view_column_set_resizable (StateColumn, TRUE);
+  gtk_tree_view_column_set_sizing (StateColumn, GTK_TREE_VIEW_COLUMN_FIXED);
+  gtk_tree_view_column_set_fixed_width (StateColumn, 150);
   gtk_tree_view_append_column (GTK_TREE_VIEW (PhotoList), StateColumn);
 
+  /* Every row is the same height, so the tree view needn't look at
+   * each one to find out. With that, it only asks the model about
+   * the rows it draws, so changes off the screen needn't be
+   * passed on (see ShowRows). */
+  gtk_tree_view_set_fixed_height_mode (GTK_TREE_VIEW (PhotoList), TRUE);
+
   /* Get the track list store ready.
    * Create the empty terminating entry. */
   GPSData = (struct GPSTrack*) calloc(1, sizeof(*GPSData));
   NumTracks = 0;
 
+  /* Open the photo metadata cache. We can do without it. */
+  gchar* CacheDir = g_build_filename(g_get_user_cache_dir(), "gpscorrelate", NULL);
+  if (g_mkdir_with_parents(CacheDir, 0700) == 0)
+  {
+    gchar* CacheFile = g_build_filename(CacheDir, "photocache", NULL);
+    PhotoCache = OpenPhotoCache(CacheFile);
+    g_free(CacheFile);
+  }
+  g_free(CacheDir);
+
   /* Final thing: show the window. */
   gtk_widget_show(MatchWindow);
 
@@ -613,25 +759,32 @@ gboolean DestroyWindow(GtkWidget *Widget,
 	g_key_file_set_string(GUISettings, "default", "photoopendir", PhotoOpenDir);
 	SaveSettings();
 
+	/* Let any photos being written right now finish, but don't
+	 * start any more. */
+	if (Running)
+	{
+		pthread_mutex_lock(&Running->Lock);
+		Running->Cancelled = 1;
+		pthread_mutex_unlock(&Running->Lock);
+		FinishWorkPool(Running->Pool);
+		Running->Pool = NULL;
+	}
+	if (LoadingGPX)
+	{
+		__atomic_store_n(&LoadingGPX->Progress.Cancel, 1, __ATOMIC_RELAXED);
+		FinishWorkPool(LoadingGPX->Pool);
+		LoadingGPX->Pool = NULL;
+	}
+
 	/* Someone closed the window. */
 	/* Free the memory we allocated for the photo list. */
-	struct GUIPhotoList* Free = NULL;
-	struct GUIPhotoList* Free2 = NULL;
-	if (FirstPhoto)
+	int i;
+	for (i = 0; i < NumPhotos; i++)
 	{
-		/* Walk through the singly-linked list
-		 * freeing stuff. */
-		Free = FirstPhoto;
-		while (1)
-		{
-			free(Free->Filename);
-			free(Free->Time);
-			Free2 = Free->Next;
-			free(Free);
-			if (Free2 == NULL) break;
-			Free = Free2;
-		}
+		free(Photos[i].Filename);
+		free(Photos[i].Time);
 	}
+	free(Photos);
 	
 	/* Free the memory for the GPS data, if applicable. */
 	while (NumTracks > 0)
@@ -641,6 +794,8 @@ gboolean DestroyWindow(GtkWidget *Widget,
 	}
 	free(GPSData);
 
+	ClosePhotoCache(PhotoCache);
+
 	/* Tell GTK that we're done. */
 	gtk_exit(0);
 
@@ -689,20 +844,55 @@ void AddPhotosButtonPress( GtkWidget *Widget, gpointer Data )
 		/* GTK returns a GSList - a singly-linked list of filenames. */
 		GSList* FileNames = gtk_file_chooser_get_filenames (GTK_FILE_CHOOSER(AddPhotosDialog));
 		GSList* Run;
+		int Count = g_slist_length(FileNames);
+
+		/* The rows go in straight away, and the photos are read
+		 * in the background. Make room for them all first, so
+		 * Photos stays put while the threads read them. */
+		struct PhotoRun* Reading = NULL;
+		if (ReservePhotos(Count))
+			Reading = StartPhotoRun(ReadPhoto, ShowPhotoRead, 0);
+
+		int Bulk = Count > BULK_ROWS;
+		if (Bulk)
+		{
+			g_object_ref(PhotoListModel);
+			gtk_tree_view_set_model(GTK_TREE_VIEW(PhotoList), NULL);
+		}
 		for (Run = FileNames; Run; Run = Run->next)
 		{
-			/* Show what's happening on the screen. */
-			GtkGUIUpdate();
 			/*printf("Filename: %s.\n", (char*)Run->data);*/
 			/* Call the other function with the filename - this
 			 * function adds it to the internal list, and adds it
 			 * to the screen display, too. */
-			AddPhotoToList((char*)Run->data);
+			int Added = AddPhotoToList((char*)Run->data);
+			if (Added < 0)
+			{
+				/* Out of memory; nothing to be done. */
+			} else if (Reading) {
+				QueuePhoto(Reading, Added);
+			} else {
+				/* No threads; read it here and now. */
+				struct PhotoJob Job;
+				memset(&Job, 0, sizeof(Job));
+				Job.Photo = Added;
+				ReadPhoto(NULL, &Job);
+				ShowPhotoRead(&Job);
+				free(Job.Time);
+			}
 			/* Free the memory passed to us. */
 			g_free(Run->data);
 		}
+		if (Bulk)
+		{
+			gtk_tree_view_set_model(GTK_TREE_VIEW(PhotoList), PhotoListModel);
+			g_object_unref(PhotoListModel);
+		}
 		/* We're done with the list - free it. */
 		g_slist_free(FileNames);
+
+		if (Reading)
+			AllQueued(Reading);
 	}
 
 	/* Copy out the directory that the user ended up at. */
@@ -714,78 +904,89 @@ void AddPhotosButtonPress( GtkWidget *Widget, gpointer Data )
 
 }
 
-void AddPhotoToList(const char* Filename)
+/* Makes sure there's room in Photos for More photos to be added
+ * without it moving. Returns 0 if there isn't the memory. */
+int ReservePhotos(int More)
 {
-	/* Add the photo to the list. Query out the exif tags
-	 * at the same time, too - so we can add them to the
-	 * current list. */
-	/* Note that this function does more than update the GUI:
-	 * it also adds it to the internal list, ready to go. */
-	
-	/* Get ready to read the relevant data. */
-	GtkTreeIter AddStuff;
+	if (NumPhotos + More <= PhotoSpace)
+		return 1;
+
+	int Space = PhotoSpace ? PhotoSpace * 2 : 64;
+	if (Space < NumPhotos + More)
+		Space = NumPhotos + More;
+	struct GUIPhoto* Grown = (struct GUIPhoto*) realloc(Photos, Space * sizeof(*Photos));
+	if (!Grown)
+		return 0;
+	Photos = Grown;
+	PhotoSpace = Space;
+	return 1;
+}
 
-	double Lat, Long, Elev;
-	Lat = Long = Elev = 0;
-	int IncludesGPS = 0;
+int AddPhotoToList(const char* Filename)
+{
+	/* Add the photo to the list, both on the screen and in
+	 * the internal list, ready to go. The EXIF tags are read
+	 * afterwards, by ReadPhoto; until then the row just says
+	 * so. Returns its index in Photos, or -1. */
+
+	if (!ReservePhotos(1))
+		return -1;
+
+	/* We make a copy of Filename - it won't exist once we return.
+	 * Time comes once the photo has been read. */
+	struct GUIPhoto* Photo = &Photos[NumPhotos];
+	memset(Photo, 0, sizeof(*Photo));
+	Photo->Filename = strdup(Filename);
+	if (!Photo->Filename)
+		return -1;
+
+	Photo->State = _("Reading...");
+
+	/* Add it to the screen. */
+	NumPhotos++;
+	PhotoRowInserted(PhotoListModel, NumPhotos-1);
+	return NumPhotos-1;
+}
 
-	/* Read the EXIF data. */
-	char *Time = ReadExifData(Filename, &Lat, &Long, &Elev, &IncludesGPS);
+/* Runs on one of the pool's threads: reads the EXIF data of a photo
+ * just added. */
+void ReadPhoto(struct PhotoRun* Run, struct PhotoJob* Job)
+{
+	Job->Time = ReadExifDataCached(PhotoCache, Photos[Job->Photo].Filename,
+			&Job->Lat, &Job->Long, &Job->Elev, &Job->IncludesGPS);
+	if (Job->Time)
+		Job->Epoch = ConvertToUnixTime(Job->Time, EXIF_DATE_FORMAT, 0, 0);
+}
 
-	/* Note: we don't check if Time is NULL here. It is done for
-	 * us in SetListItem, and we check again before we attempt
-	 * to allocate memory to store "Time" in. */
-		
-	/* Add the data to the list. */
-	gtk_list_store_append(PhotoListStore, &AddStuff);
-	SetListItem(&AddStuff, Filename, Time, Lat, Long, Elev, NULL, IncludesGPS);
-
-	/* Save away the filename and the TreeIter information in the internal
-	 * singly-linked list. */
-	/* We also make a copy of Filename - it won't exist once we return. */
-	if (FirstPhoto)
-	{
-		/* Already at least one element. Add to it. */
-		LastPhoto->Next = (struct GUIPhotoList*) malloc(sizeof(struct GUIPhotoList));
-		LastPhoto = LastPhoto->Next;
-		LastPhoto->Next = NULL;
-	} else {
-		/* No elements. Righto, add one. */
-		FirstPhoto = (struct GUIPhotoList*) malloc(sizeof(struct GUIPhotoList));
-		LastPhoto = FirstPhoto;
-		FirstPhoto->Next = NULL;
-	}
+/* Fills in a photo's row once ReadPhoto has been at it. */
+void ShowPhotoRead(struct PhotoJob* Job)
+{
+	struct GUIPhoto* Photo = &Photos[Job->Photo];
 
-	/* Now that we've allocated memory for the structure, allocate
-	 * memory for the strings and then fill them. */
-	/* Filename first... */
-	LastPhoto->Filename = strdup(Filename);
-	/* And then Time, after checking for NULLness. */
-	if (Time)
+	if (Job->Skipped)
 	{
-		LastPhoto->Time = strdup(Time);
-	} else {
-		LastPhoto->Time = strdup(_("No EXIF data"));
+		/* It'll still be read if it's correlated. */
+		Photo->State = _("Not read");
+		return;
 	}
-	/* Save the TreeIter as the last step. */
-	LastPhoto->ListPointer = AddStuff;
-	
-	/* Save the pointer into the data, as well. */
-	gtk_list_store_set(PhotoListStore, &AddStuff,
-		LIST_POINTER, LastPhoto,
-		-1);
-
-	/* Free the memory allocated for us.
-	 * (ReadExifData allocates and returns memory) */
-	free(Time);
+
+	/* Note: we don't check if Time is NULL here. It is done for
+	 * us when the row is shown. */
+	Photo->Time = Job->Time;
+	Job->Time = NULL;
+	Photo->Epoch = Job->Epoch;
+	Photo->Lat = Job->Lat;
+	Photo->Long = Job->Long;
+	Photo->Elev = Job->Elev;
+	Photo->IncludesGPS = Job->IncludesGPS;
+	Photo->GPSInFile = Job->IncludesGPS;
+	Photo->State = NULL;
 }
 
 void RemovePhotosButtonPress( GtkWidget *Widget, gpointer Data )
 {
 	/* Someone clicked the remove photos button. So make it happen!
 	 * First, query out what was selected. */
-	GtkTreeIter Iter;
-
 	GtkTreeSelection* Selection;
 	Selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(PhotoList));
 
@@ -798,189 +999,76 @@ void RemovePhotosButtonPress( GtkWidget *Widget, gpointer Data )
 		return;
 	}
 
-	/* Count the items on the GList. We need this to be able to
-	 * keep a list of items that have been removed from our internal
-	 * list, and should be removed from the screen. */
-	int SelectedCount = 0;
+	/* A row's number is its index in Photos. Mark each one
+	 * selected by freeing its filename. */
+	int Count = 0;
 	GList* Walk;
 	for (Walk = Selected; Walk; Walk = Walk->next)
 	{
-		SelectedCount++;
-	}
-
-	/* Now get ready to keep a list of Iters that we can
-	 * delete. */
-	GtkTreeIter* RemoveIters = (GtkTreeIter*) malloc(sizeof(GtkTreeIter) * SelectedCount);
-
-	/* Walk through and remove the items from our internal list. */
-	struct GUIPhotoList* PhotoWalk = NULL;
-	struct GUIPhotoList* LastPhotoWalk = NULL;
-	struct GUIPhotoList* FreeHold = NULL;
-	struct GUIPhotoList* FreeMe = NULL;
-	int IterCount = 0;
-	for (Walk = Selected; Walk; Walk = Walk->next)
-	{
-		/* Acquire a new Iter for this selected row. */
-		if (gtk_tree_model_get_iter(GTK_TREE_MODEL(PhotoListStore), &Iter,
-					    (GtkTreePath*) Walk->data))
-		{
-			/* To remove the row from our internal list.
-			 * Locate it via the pointer stored. */
-			gtk_tree_model_get(GTK_TREE_MODEL(PhotoListStore), &Iter,
-					LIST_POINTER, &FreeMe, -1);
-			/* Save the iter for afterwards: we can then remove the
-			 * data from the screen. */
-			/* gtk_list_store_remove(PhotoListStore, &Iter); */
-			RemoveIters[IterCount] = Iter;
-			IterCount++;
-			/* Now go back through and take it out from our list. */
-			PhotoWalk = FirstPhoto;
-			LastPhotoWalk = NULL;
-			while (1)
-			{
-				if (PhotoWalk == NULL) break;
-				/*printf("Search: %d / %d.\n", PhotoWalk, FreeMe);*/
-				/* Check to see if this is the one we want to be rid of. */
-				if (PhotoWalk == FreeMe)
-				{
-					/* Right. Remove. */
-					/*printf("Removing: %s.\n", PhotoWalk->Filename);*/
-					PhotoWalk = PhotoWalk->Next;
-					if (FreeMe == FirstPhoto)
-					{
-						/* Remove the top of the list. */
-						FreeHold = FreeMe;
-						FirstPhoto = FreeMe->Next;
-						LastPhotoWalk = FreeMe->Next;
-						free(FreeHold->Filename);
-						free(FreeHold->Time);
-						free(FreeHold);
-						break;
-					} else if (FreeMe == LastPhoto) {
-						/* Remove the bottom of the list. */
-						FreeHold = FreeMe;
-						LastPhoto = LastPhotoWalk;
-						LastPhoto->Next = NULL;
-						free(FreeHold->Filename);
-						free(FreeHold->Time);
-						free(FreeHold);
-						break;
-					} else {
-						/* Remove a middle of the list. */
-						FreeHold = FreeMe;
-						LastPhotoWalk->Next = FreeHold->Next;
-						free(FreeHold->Filename);
-						free(FreeHold->Time);
-						free(FreeHold);
-						break;
-					}
-				} else {
-					/* Nope, this wasn't what we wanted to delete.
-					 * So get ready to look at the next one, keeping
-					 * mind of where we were. */
-					LastPhotoWalk = PhotoWalk;
-					PhotoWalk = PhotoWalk->Next;
-				}
-			} /* End for Walk the photo list. */
-			
-		}
-	} /* End for Walk the GList. */
-
-	/* Now remove the rows from the screen. 
-	 * By this point, they are no longer in our internal list. */
-	int i;
-	for (i = 0; i < SelectedCount; i++)
-	{
-		gtk_list_store_remove(PhotoListStore, &RemoveIters[i]);
+		int Index = gtk_tree_path_get_indices((GtkTreePath*) Walk->data)[0];
+		if (Index < 0 || Index >= NumPhotos || !Photos[Index].Filename)
+			continue;
+		free(Photos[Index].Filename);
+		free(Photos[Index].Time);
+		Photos[Index].Filename = NULL;
+		Count++;
 	}
-	free(RemoveIters);
 
 	/* Free the memory used by GList. */
 	g_list_foreach(Selected, (GFunc)gtk_tree_path_free, NULL);
 	g_list_free(Selected);
 
-	/* Debug: walk the photo list tree. */
-	/*struct GUIPhotoList* List;
-	for (List = FirstPhoto; List; List = List->Next)
-	{
-		printf("List Filename: %s\n", List->Filename);
-	}
-	printf("--------------------------------------------------------------\n");*/
-
-}
-
-void SetListItem(GtkTreeIter* Iter, const char* Filename, const char* Time, double Lat,
-		double Long, double Elev, const char* PassedState, int IncludesGPS)
-{
-	/* Scratch areas. */
-	char LatScratch[100] = "";
-	char LongScratch[100] = "";
-	char ElevScratch[100] = "";
-	const char* State = NULL;
-	
-	/* Format all the data. */
-	if (!Time)
+	int From, To = 0;
+	if (Count > BULK_ROWS)
 	{
-		/* Not good. Failure. */
-		Time = "";
-		State = _("No EXIF data");
+		/* Close the gaps in one go, with nobody looking. */
+		g_object_ref(PhotoListModel);
+		gtk_tree_view_set_model(GTK_TREE_VIEW(PhotoList), NULL);
+		for (From = 0; From < NumPhotos; From++)
+		{
+			if (Photos[From].Filename)
+				Photos[To++] = Photos[From];
+		}
+		NumPhotos = To;
+		gtk_tree_view_set_model(GTK_TREE_VIEW(PhotoList), PhotoListModel);
+		g_object_unref(PhotoListModel);
 	} else {
-		/* All ok. Get ready. */
-		if (IncludesGPS)
+		/* Take them out from the bottom up, so the rows still
+		 * to go keep their numbers, telling the tree view as we
+		 * go. */
+		for (From = NumPhotos-1; From >= 0; From--)
 		{
-			State = _("GPS Data Present");
-			/* In each case below, consider the values
-			 * that are invalid for each - if that's the case,
-			 * consider the spots as "blank". */
-			/* Lat can't be greater than 90 degrees. */
-			if (Lat < 200)
-			{
-				snprintf(LatScratch, sizeof(LatScratch), "%f (%c)",
-					Lat, (Lat < 0) ? 'S' : 'N');
-			} else {
-				snprintf(LatScratch, sizeof(LatScratch), " ");
-			}
-			/* Long can't be greater than 180 degrees. */
-			if (Long < 200)
-			{
-				snprintf(LongScratch, sizeof(LongScratch), "%f (%c)",
-					Long, (Long < 0) ? 'W' : 'E');
-			} else {
-				snprintf(LongScratch, sizeof(LongScratch), " ");
-			}
-			/* Radius of earth ~6000km */
-			if (Elev > -7000000)
-			{
-				snprintf(ElevScratch, sizeof(ElevScratch), "%.2fm", Elev);
-			} else {
-				snprintf(ElevScratch, sizeof(ElevScratch), " ");
-			}
-		} else {
-			/* Placeholders for the lack of data. */
-			State = _("Ready");
+			if (Photos[From].Filename)
+				continue;
+			memmove(&Photos[From], &Photos[From+1],
+				(NumPhotos - From - 1) * sizeof(*Photos));
+			NumPhotos--;
+			PhotoRowDeleted(PhotoListModel, From);
 		}
 	}
-
-	/* Overwrite state with what we want, if needed. */
-	if (PassedState) State = PassedState;
-	/* And set all the appropriate data. */
-	gtk_list_store_set(PhotoListStore, Iter,
-		LIST_FILENAME, strrchr(Filename, G_DIR_SEPARATOR)+1,
-		LIST_LAT, LatScratch,
-		LIST_LONG, LongScratch,
-		LIST_ELEV, ElevScratch,
-		LIST_TIME, Time,
-		LIST_STATE, State,
-		-1);
-	
 }
 
-void SetState(GtkTreeIter* Iter, const char* State)
+/* Redraws rows First to Last, having been changed, if any of them
+ * are on the screen. The rest are drawn as they are when they're
+ * scrolled to. */
+void ShowRows(int First, int Last)
 {
-	/* Set the state on the item... just the state. */
-	gtk_list_store_set(PhotoListStore, Iter,
-		LIST_STATE, State,
-		-1);
+	GtkTreePath* Start;
+	GtkTreePath* End;
+	if (!gtk_tree_view_get_visible_range(GTK_TREE_VIEW(PhotoList), &Start, &End))
+		return;
+
+	int Top = gtk_tree_path_get_indices(Start)[0];
+	int Bottom = gtk_tree_path_get_indices(End)[0];
+	gtk_tree_path_free(Start);
+	gtk_tree_path_free(End);
+
+	if (First < Top)
+		First = Top;
+	if (Last > Bottom)
+		Last = Bottom;
+	if (First <= Last)
+		PhotoRowsChanged(PhotoListModel, First, Last);
 }
 
 
@@ -988,7 +1076,6 @@ void SelectGPSButtonPress( GtkWidget *Widget, gpointer Data )
 {
 	/* Select and load some GPS data! */
 	GtkWidget *GPSDataDialog;
-	GtkWidget *ErrorDialog;
 	
 	/* Get the dialog ready... */
 	GPSDataDialog = gtk_file_chooser_dialog_new (_("Select GPS Data..."),
@@ -1017,65 +1104,26 @@ void SelectGPSButtonPress( GtkWidget *Widget, gpointer Data )
 	/* Run the dialog... */
 	if (gtk_dialog_run (GTK_DIALOG (GPSDataDialog)) == GTK_RESPONSE_ACCEPT)
 	{
-		/* Sanity check: free the GPS tracks in case we already have one.
-		 * Note: we check this now, because if we cancelled the dialog,
-		 * we should run with the old data. */
-		while (NumTracks > 0)
-		{
-			--NumTracks;
-			FreeTrack(&GPSData[NumTracks]);
-		}
-
 		/* Hide the "open" dialog. */
 		gtk_widget_hide(GPSDataDialog);
 
-		/* Display a dialog so the user knows whats going down. */
-		ErrorDialog = gtk_message_dialog_new (GTK_WINDOW(MatchWindow),
-			(GtkDialogFlags) (GTK_DIALOG_DESTROY_WITH_PARENT | GTK_DIALOG_MODAL),
-			GTK_MESSAGE_INFO,
-			GTK_BUTTONS_NONE,
-			_("Loading GPS data from file... Won't be a moment..."));
-		gtk_widget_show(ErrorDialog);
-		GtkGUIUpdate();
-
-		char *FirstOrBadFileName = NULL;
-		int ReadOk = 1;
-
-		/* GTK returns a GSList - a singly-linked list of filenames. */
-		/* Process the result of the dialog... */
+		/* GTK returns a GSList - a singly-linked list of filenames.
+		 * Take them over, and find out how much there is to read. */
 		GSList* FileNames = gtk_file_chooser_get_filenames (GTK_FILE_CHOOSER(GPSDataDialog));
+		struct GPXLoad* Load = (struct GPXLoad*) calloc(1, sizeof(*Load));
+		int Count = g_slist_length(FileNames);
+		if (Load)
+			Load->Files = (struct GPXFile*) calloc(Count ? Count : 1, sizeof(*Load->Files));
 		GSList* Run;
 		for (Run = FileNames; Run; Run = Run->next)
 		{
-			/* Read in the new data, but stop trying after the first failure. */
-			if (ReadOk)
+			if (Load && Load->Files)
 			{
-				if (FirstOrBadFileName == NULL)
-				{
-					/* If only one file is given, this is it */
-					FirstOrBadFileName = strdup((char *)Run->data);
-				}
-				else
-				{
-					/* If more than one file is given, say so */
-					free(FirstOrBadFileName);
-					/* This string must look like a file path */
-					FirstOrBadFileName = strdup(_(G_DIR_SEPARATOR_S "multiple files"));
-				}
-
-				ReadOk = ReadGPX((char*)Run->data, &GPSData[NumTracks]);
-				if (ReadOk)
-				{
-					/* Make room for a new end-of-array entry */
-					++NumTracks;
-					GPSData = (struct GPSTrack*) realloc(GPSData, sizeof(*GPSData)*(NumTracks+1));
-					memset(&GPSData[NumTracks], 0, sizeof(*GPSData));
-				} else
-				{
-					/* If a file could not be read, give the name */
-					free(FirstOrBadFileName);
-					FirstOrBadFileName = strdup((char *)Run->data);
-				}
+				struct GPXFile* File = &Load->Files[Load->NumFiles++];
+				struct stat FileStat;
+				File->Name = strdup((char*)Run->data);
+				if (stat(File->Name, &FileStat) == 0)
+					Load->TotalBytes += FileStat.st_size;
 			}
 
 			/* Free the memory passed to us. */
@@ -1085,47 +1133,46 @@ void SelectGPSButtonPress( GtkWidget *Widget, gpointer Data )
 		/* We're done with the list - free it. */
 		g_slist_free(FileNames);
 
-		/* Close the dialog now that we're done. */
-		gtk_widget_destroy(ErrorDialog);
-
-		/* Prepare our "scratch" for rewriting labels. */
-		const size_t ScratchLength = strlen(FirstOrBadFileName) + 100;
-		char* Scratch = (char*) malloc(sizeof(char) * ScratchLength);
+		/* One thread a file, up to one a CPU. */
+		int Threads = Count;
+		long Cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		if (Cpus > 0 && Threads > Cpus)
+			Threads = 0;
 
-		/* Check if all the data was read ok. */
-		if (ReadOk)
+		InitGPX();
+		if (Load && Load->Files && Count)
+			Load->Pool = StartWorkPool("gpx", Threads, 0, ReadGPXWork, Load);
+		if (!Load || !Load->Pool)
 		{
-			/* It's all good!
-			 * Adjust the label to say so. */
-			snprintf(Scratch, ScratchLength,
-				 _("Read from: %s"), strrchr(FirstOrBadFileName, G_DIR_SEPARATOR)+1);
-			gtk_label_set_text(GTK_LABEL(GPSSelectedLabel), Scratch);
+			if (Load)
+			{
+				int i;
+				for (i = 0; i < Load->NumFiles; i++)
+					free(Load->Files[i].Name);
+				free(Load->Files);
+				free(Load);
+			}
 		} else {
-			/* Not good. Say so. */
-			/* Set the label... */
-			snprintf(Scratch, ScratchLength, _("Reading from: No file"));
-			gtk_label_set_text(GTK_LABEL(GPSSelectedLabel), Scratch);
-			/* Show an error dialog. */
-			ErrorDialog = gtk_message_dialog_new (GTK_WINDOW(MatchWindow),
-					GTK_DIALOG_DESTROY_WITH_PARENT,
-					GTK_MESSAGE_ERROR,
-					GTK_BUTTONS_CLOSE,
-					_("Unable to read file %s for some reason. Please try again"),
-					FirstOrBadFileName);
-			gtk_dialog_run (GTK_DIALOG (ErrorDialog));
-			gtk_widget_destroy (ErrorDialog);
-
-			/* Clean up the tracks already read in */
-			while (NumTracks > 0)
+			LoadingGPX = Load;
+			SetBusy(1);
+
+			gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ProgressBar), 0);
+			gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ProgressBar), "");
+			gtk_widget_set_sensitive(CancelButton, TRUE);
+			gtk_widget_show(ProgressHBox);
+			Load->Timer = g_timeout_add(GPX_PROGRESS_MS, ShowGPXProgress, Load);
+
+			/* Whichever thread finishes last hands the lot
+			 * back to GPXLoaded. */
+			Load->Remaining = Load->NumFiles;
+			int i;
+			for (i = 0; i < Load->NumFiles; i++)
 			{
-				--NumTracks;
-				FreeTrack(&GPSData[NumTracks]);
+				if (!AddWork(Load->Pool, &Load->Files[i]) &&
+				    __atomic_sub_fetch(&Load->Remaining, 1, __ATOMIC_ACQ_REL) == 0)
+					g_idle_add(GPXLoaded, Load);
 			}
 		}
-		
-		/* Clean up... */
-		free(Scratch);
-		free(FirstOrBadFileName);
 	}
 
 	/* Make a note of the directory we stopped at. */
@@ -1143,7 +1190,7 @@ void CorrelateButtonPress( GtkWidget *Widget, gpointer Data )
 	GtkWidget *ErrorDialog;
 
 	/* Check to see we have everything we need... */
-	if (FirstPhoto == NULL)
+	if (NumPhotos == 0)
 	{
 		/* No photos... */
 		ErrorDialog = gtk_message_dialog_new (GTK_WINDOW(MatchWindow),
@@ -1171,6 +1218,32 @@ void CorrelateButtonPress( GtkWidget *Widget, gpointer Data )
 
 	/* Assemble the settings for the correlation run. */
 	struct CorrelateOptions Options;
+	ReadCorrelateOptions(&Options);
+
+	/* Hand every photo over to the threads. What they make of
+	 * them turns up in ShowCorrelated. */
+	struct PhotoRun* Run = StartPhotoRun(CorrelateOne, ShowCorrelated, 1);
+	if (!Run)
+	{
+		free(Options.Datum);
+		return;
+	}
+	Run->Options = Options;
+
+	/* The real thing replaces any preview. */
+	gtk_widget_hide(PreviewLabel);
+
+	int i;
+	for (i = 0; i < NumPhotos; i++)
+		QueuePhoto(Run, i);
+	AllQueued(Run);
+}
+
+/* Fills in Options from the settings in the window. Options->Datum
+ * is allocated. */
+void ReadCorrelateOptions(struct CorrelateOptions* Options)
+{
+	memset(Options, 0, sizeof(*Options));
 
 	/* Interpolation. */
 	/* This is confusing. I should have thought more about the Interpolate
@@ -1178,53 +1251,53 @@ void CorrelateButtonPress( GtkWidget *Widget, gpointer Data )
 	 * it for a bit, it can make sense. Enough sense to use.  */
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(InterpolateCheck)))
 	{
-		Options.NoInterpolate = 0;
+		Options->NoInterpolate = 0;
 	} else {
-		Options.NoInterpolate = 1;
+		Options->NoInterpolate = 1;
 	}
 
 	/* Write or no write. */
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(NoWriteCheck)))
 	{
-		Options.NoWriteExif = 1;
+		Options->NoWriteExif = 1;
 	} else {
-		Options.NoWriteExif = 0;
+		Options->NoWriteExif = 0;
 	}
 
 	/* No change MTime. */
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(NoMtimeCheck)))
 	{
-		Options.NoChangeMtime = 1;
+		Options->NoChangeMtime = 1;
 	} else {
-		Options.NoChangeMtime = 0;
+		Options->NoChangeMtime = 0;
 	}
 
 	/* Between segments? */
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(BetweenSegmentsCheck)))
 	{
-		Options.DoBetweenTrkSeg = 1;
+		Options->DoBetweenTrkSeg = 1;
 	} else {
-		Options.DoBetweenTrkSeg = 0;
+		Options->DoBetweenTrkSeg = 0;
 	}
 
 	/* DD MM.MM or DD MM SS.SS? */
 	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(DegMinSecsCheck)))
 	{
-		Options.DegMinSecs = 1;
+		Options->DegMinSecs = 1;
 	} else {
-		Options.DegMinSecs = 0;
+		Options->DegMinSecs = 0;
 	}
 	
 	/* Feather time. */
-	Options.FeatherTime = atof(gtk_entry_get_text(GTK_ENTRY(GapTimeEntry)));
+	Options->FeatherTime = atof(gtk_entry_get_text(GTK_ENTRY(GapTimeEntry)));
 
 	/* GPS Datum. */
-	Options.Datum = strdup(gtk_entry_get_text(GTK_ENTRY(GPSDatumEntry)));
+	Options->Datum = strdup(gtk_entry_get_text(GTK_ENTRY(GPSDatumEntry)));
 		
 	/* TimeZone. We may need to extract the timezone from a string. */
-	Options.AutoTimeZone = 0; /* TODO: make this selectable in the GUI somehow */
-	Options.TimeZoneHours = 0;
-	Options.TimeZoneMins = 0;
+	Options->AutoTimeZone = 0; /* TODO: make this selectable in the GUI somehow */
+	Options->TimeZoneHours = 0;
+	Options->TimeZoneMins = 0;
 	char* TZString = (char*) gtk_entry_get_text(GTK_ENTRY(TimeZoneEntry));
 	/* Check the string. If there is a colon, then it's a time in xx:xx format.
 	 * If not, it's probably just a +/-xx format. In all other cases,
@@ -1232,111 +1305,514 @@ void CorrelateButtonPress( GtkWidget *Widget, gpointer Data )
 	if (strstr(TZString, ":"))
 	{
 		/* Found colon. Split into two. */
-		sscanf(TZString, "%d:%d", &Options.TimeZoneHours, &Options.TimeZoneMins);
-		if (Options.TimeZoneHours < 0)
-		    Options.TimeZoneMins *= -1;
+		sscanf(TZString, "%d:%d", &Options->TimeZoneHours, &Options->TimeZoneMins);
+		if (Options->TimeZoneHours < 0)
+		    Options->TimeZoneMins *= -1;
 	} else {
 		/* No colon. Just parse. */
-		Options.TimeZoneHours = atoi(TZString);
+		Options->TimeZoneHours = atoi(TZString);
 	}
 
 	/* Photo Offset time */
-	Options.PhotoOffset = atoi(gtk_entry_get_text(GTK_ENTRY(PhotoOffsetEntry)));
+	Options->PhotoOffset = atoi(gtk_entry_get_text(GTK_ENTRY(PhotoOffsetEntry)));
 
 	/* Store the GPS track */
-	Options.Track = GPSData;
+	Options->Track = GPSData;
+	Options->Cache = PhotoCache;
+	Options->ReplaceGPS = 0;
+}
+
+void MatchOptionChanged( GtkWidget *Widget, gpointer Data )
+{
+	/* Once the typing has stopped for long enough for the window
+	 * to catch up, that is. */
+	if (!PreviewPosted)
+	{
+		PreviewPosted = 1;
+		g_idle_add(PreviewMatches, NULL);
+	}
+}
+
+/* Shows where each photo would go with the options as they are
+ * now, so the time zone and offset can be tried out. The times
+ * read from the photos when they were added are matched again,
+ * in memory: nothing is read or written. Correlate Photos does
+ * that. Photos with GPS data of their own are left alone, as
+ * correlating them would. */
+gboolean PreviewMatches(gpointer Data)
+{
+	PreviewPosted = 0;
+
+	/* Not while the threads have the photos or the tracks. */
+	if (Running || LoadingGPX || NumTracks == 0 || NumPhotos == 0)
+		return FALSE;
+
+	struct CorrelateOptions Options;
+	ReadCorrelateOptions(&Options);
+
+	int Counts[CORR_UNCHANGED+1];
+	memset(Counts, 0, sizeof(Counts));
+	int i;
+	for (i = 0; i < NumPhotos; i++)
+	{
+		struct GUIPhoto* Photo = &Photos[i];
+		if (!Photo->Time || Photo->GPSInFile)
+			continue;
+
+		struct GPSPoint* Point = CorrelateLocalTime(Photo->Epoch, &Options);
+		if (Point)
+		{
+			Photo->Lat = Point->Lat;
+			Photo->Long = Point->Long;
+			Photo->Elev = Point->Elev;
+			Photo->IncludesGPS = 1;
+			free(Point);
+		} else {
+			Photo->IncludesGPS = 0;
+		}
+		switch (Options.Result)
+		{
+			case CORR_OK:
+				Photo->State = _("Would Match Exactly");
+				break;
+			case CORR_INTERPOLATED:
+				Photo->State = _("Would Interpolate");
+				break;
+			case CORR_ROUND:
+				Photo->State = _("Would Round");
+				break;
+			case CORR_TOOFAR:
+				Photo->State = _("Too far");
+				break;
+			default:
+				Photo->State = _("No Match");
+				break;
+		}
+		if (Options.Result > 0 && Options.Result <= CORR_UNCHANGED)
+			Counts[Options.Result]++;
+	}
+	free(Options.Datum);
+
+	ShowRows(0, NumPhotos-1);
+
+	char Summary[200];
+	snprintf(Summary, sizeof(Summary),
+		_("Would match %d exactly, %d interpolated and %d rounded; "
+		  "%d no match, %d too far"),
+		Counts[CORR_OK], Counts[CORR_INTERPOLATED], Counts[CORR_ROUND],
+		Counts[CORR_NOMATCH], Counts[CORR_TOOFAR]);
+	gtk_label_set_text(GTK_LABEL(PreviewLabel), Summary);
+	gtk_widget_show(PreviewLabel);
+
+	return FALSE;
+}
 
-	/* Walk through the list, correlating, and updating the screen. */
-	struct GUIPhotoList* Walk;
-	struct GPSPoint* Result;
+/* Runs on one of the pool's threads: correlates one photo. */
+void CorrelateOne(struct PhotoRun* Run, struct PhotoJob* Job)
+{
+	struct CorrelateOptions Options = Run->Options;
+	Job->Point = CorrelatePhoto(Photos[Job->Photo].Filename, &Options);
+	Job->Result = Options.Result;
+}
+
+/* Puts what correlating a photo came to on the screen. */
+void ShowCorrelated(struct PhotoJob* Job)
+{
+	struct GUIPhoto* Photo = &Photos[Job->Photo];
 	const char* State = _("Internal error");
-	GtkTreePath* ShowPath;
-	for (Walk = FirstPhoto; Walk; Walk = Walk->Next)
+
+	/* Figure out if it worked. */
+	if (Job->Skipped)
+	{
+		/* Cancelled before it was started: leave it be. */
+		return;
+	}
+	if (Job->Point)
+	{
+		/* Result was not null. That means that we
+		 * matched to a point. But that's not the whole
+		 * story. Read on... */
+		switch (Job->Result)
+		{
+			case CORR_OK:
+				/* All cool! Exact match! */
+				State = _("Exact Match");
+				break;
+			case CORR_INTERPOLATED:
+				/* All cool! Interpolated match. */
+				State = _("Interpolated Match");
+				break;
+			case CORR_ROUND:
+				/* All cool! Rounded match. */
+				State = _("Rounded Match");
+				break;
+			case CORR_UNCHANGED:
+				/* All cool! And it was already there. */
+				State = _("Unchanged");
+				break;
+			case CORR_EXIFWRITEFAIL:
+				/* Not cool - matched, not written. */
+				State = _("Write Failure");
+				break;
+		}
+		/* Now update the screen with the numbers. */
+		Photo->Lat = Job->Point->Lat;
+		Photo->Long = Job->Point->Long;
+		Photo->Elev = Job->Point->Elev;
+		Photo->IncludesGPS = 1;
+		Photo->GPSInFile = Photo->GPSInFile ||
+			Job->Result == CORR_UNCHANGED ||
+			(Job->Result != CORR_EXIFWRITEFAIL && !Running->Options.NoWriteExif);
+		Photo->State = State;
+	} else {
+		/* Result was null. This means something
+		 * really went wrong. Find out and put that
+		 * on the screen. */
+		if (Job->Result == CORR_GPSDATAEXISTS)
+		{
+			/* Do nothing... */
+			Photo->GPSInFile = 1;
+			Photo->State = _("Data Already Present");
+			return;
+		}
+		switch (Job->Result)
+		{
+			case CORR_NOMATCH:
+				/* No match: outside data. */
+				State = _("No Match");
+				break;
+			case CORR_TOOFAR:
+				/* Too far from any point. */
+				State = _("Too far");
+				break;
+			case CORR_NOEXIFINPUT:
+				/* No exif data input. */
+				State = _("No data");
+				break;
+		}
+		/* Now update the screen with the changed state. */
+		Photo->IncludesGPS = 0;
+		Photo->State = State;
+	} /* End if Result */
+}
+
+/* Gets ready to do something to a batch of photos on the pool of
+ * threads: Do on a thread for each photo queued, then Show with the
+ * job on the main loop. Returns NULL if it can't. */
+struct PhotoRun* StartPhotoRun(
+		void (*Do)(struct PhotoRun* Run, struct PhotoJob* Job),
+		void (*Show)(struct PhotoJob* Job), int Follow)
+{
+	struct PhotoRun* Run = (struct PhotoRun*) calloc(1, sizeof(*Run));
+	if (!Run)
+		return NULL;
+	Run->Do = Do;
+	Run->Show = Show;
+	Run->Follow = Follow;
+	InitExif();
+	pthread_mutex_init(&Run->Lock, NULL);
+	Run->Pool = StartWorkPool("photo", 0, 0, PhotoWork, Run);
+	if (!Run->Pool)
+	{
+		pthread_mutex_destroy(&Run->Lock);
+		free(Run);
+		return NULL;
+	}
+	Running = Run;
+	SetBusy(1);
+
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ProgressBar), 0);
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ProgressBar), "");
+	gtk_widget_set_sensitive(CancelButton, TRUE);
+	gtk_widget_show(ProgressHBox);
+	return Run;
+}
+
+void QueuePhoto(struct PhotoRun* Run, int Photo)
+{
+	struct PhotoJob* Job = (struct PhotoJob*) calloc(1, sizeof(*Job));
+	if (!Job)
+		return;
+	Job->Photo = Photo;
+	if (!AddWork(Run->Pool, Job))
+	{
+		free(Job);
+		return;
+	}
+	/* Total is only read in ShowDone, which can't run until
+	 * we're back in the main loop. */
+	Run->Total++;
+}
+
+/* Says there are no more photos to come. */
+void AllQueued(struct PhotoRun* Run)
+{
+	if (!Run->Total)
+		FinishPhotoRun(Run);
+}
+
+void CancelButtonPress( GtkWidget *Widget, gpointer Data )
+{
+	/* The photos being done now are finished off, and the rest
+	 * come straight back to ShowDone untouched. GPX files stop
+	 * being read part way through. */
+	if (LoadingGPX)
+	{
+		__atomic_store_n(&LoadingGPX->Progress.Cancel, 1, __ATOMIC_RELAXED);
+		gtk_widget_set_sensitive(CancelButton, FALSE);
+		return;
+	}
+	if (!Running)
+		return;
+	pthread_mutex_lock(&Running->Lock);
+	Running->Cancelled = 1;
+	pthread_mutex_unlock(&Running->Lock);
+	gtk_widget_set_sensitive(CancelButton, FALSE);
+}
+
+/* Runs on one of the pool's threads: does one photo, and queues
+ * the job for the main loop. No GTK calls in here. */
+void PhotoWork(void* Data, void* RunData)
+{
+	struct PhotoJob* Job = (struct PhotoJob*) Data;
+	struct PhotoRun* Run = (struct PhotoRun*) RunData;
+
+	pthread_mutex_lock(&Run->Lock);
+	Job->Skipped = Run->Cancelled;
+	pthread_mutex_unlock(&Run->Lock);
+
+	if (!Job->Skipped)
+		Run->Do(Run, Job);
+
+	pthread_mutex_lock(&Run->Lock);
+	Job->Next = Run->Done;
+	Run->Done = Job;
+	if (!Run->Posted)
+	{
+		/* Not more than once a frame. */
+		long long Wait = RESULTS_FRAME_MS -
+			(MonotonicNanos() - Run->LastShown) / 1000000;
+		Run->Posted = 1;
+		if (Wait > 0)
+			g_timeout_add((guint) Wait, ShowDone, Run);
+		else
+			g_idle_add(ShowDone, Run);
+	}
+	pthread_mutex_unlock(&Run->Lock);
+}
+
+/* Runs on the main loop: puts everything done since last time on
+ * the screen. */
+gboolean ShowDone(gpointer Data)
+{
+	struct PhotoRun* Run = (struct PhotoRun*) Data;
+
+	pthread_mutex_lock(&Run->Lock);
+	struct PhotoJob* Done = Run->Done;
+	Run->Done = NULL;
+	Run->Posted = 0;
+	Run->LastShown = MonotonicNanos();
+	pthread_mutex_unlock(&Run->Lock);
+
+	/* The window is closing. */
+	if (!Run->Pool)
+		return FALSE;
+
+	/* Put them back in the order they were done in. */
+	struct PhotoJob* Ordered = NULL;
+	while (Done)
 	{
-		/* Say that we're doing it... */
-		SetState(&Walk->ListPointer, _("Correlating..."));
+		struct PhotoJob* Next = Done->Next;
+		Done->Next = Ordered;
+		Ordered = Done;
+		Done = Next;
+	}
+
+	int Latest = -1;
+	int First = NumPhotos, Last = -1;
+	while (Ordered)
+	{
+		struct PhotoJob* Job = Ordered;
+		Ordered = Job->Next;
+		Run->Shown++;
+
+		Run->Show(Job);
+		if (!Job->Skipped)
+			Latest = Job->Photo;
+		if (Job->Photo < First)
+			First = Job->Photo;
+		if (Job->Photo > Last)
+			Last = Job->Photo;
+
+		free(Job->Time);
+		free(Job->Point);
+		free(Job);
+	}
 
-		/* Point to the cell, too... ie, scroll the tree view
-		 * to ensure that the one we're playing with can be seen on screen. */
-		ShowPath = gtk_tree_model_get_path(GTK_TREE_MODEL(PhotoListStore), &Walk->ListPointer);
+	/* Scroll the tree view so the last one done can be seen, once
+	 * for the lot rather than once a photo. */
+	if (Run->Follow && Latest >= 0)
+	{
+		GtkTreePath* ShowPath = gtk_tree_path_new_from_indices(Latest, -1);
 		gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(PhotoList),
 				ShowPath, NULL, FALSE, 0, 0);
 		gtk_tree_path_free(ShowPath);
-		GtkGUIUpdate();
-		
-		/* Do the correlation. */
-		Result = CorrelatePhoto(Walk->Filename, &Options);
-		
-		/* Figure out if it worked. */
-		if (Result)
+	}
+	ShowRows(First, Last);
+
+	char Progress[100];
+	snprintf(Progress, sizeof(Progress), _("%d of %d"), Run->Shown, Run->Total);
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ProgressBar), Progress);
+	gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ProgressBar),
+			(double) Run->Shown / Run->Total);
+
+	if (Run->Shown == Run->Total)
+		FinishPhotoRun(Run);
+
+	return FALSE;
+}
+
+/* Every photo has come back, so the threads are idle. */
+void FinishPhotoRun(struct PhotoRun* Run)
+{
+	FinishWorkPool(Run->Pool);
+	pthread_mutex_destroy(&Run->Lock);
+	free(Run->Options.Datum);
+	free(Run);
+	Running = NULL;
+
+	gtk_widget_hide(ProgressHBox);
+	SetBusy(0);
+}
+
+/* Runs on one of the pool's threads: reads one GPX file. No GTK
+ * calls in here. */
+void ReadGPXWork(void* Data, void* LoadData)
+{
+	struct GPXFile* File = (struct GPXFile*) Data;
+	struct GPXLoad* Load = (struct GPXLoad*) LoadData;
+
+	File->Ok = ReadGPXWatched(File->Name, &File->Track, &Load->Progress);
+
+	if (__atomic_sub_fetch(&Load->Remaining, 1, __ATOMIC_ACQ_REL) == 0)
+		g_idle_add(GPXLoaded, Load);
+}
+
+/* Runs on the main loop while GPX files are being read. */
+gboolean ShowGPXProgress(gpointer Data)
+{
+	struct GPXLoad* Load = (struct GPXLoad*) Data;
+	long long Done = __atomic_load_n(&Load->Progress.Done, __ATOMIC_RELAXED);
+
+	char Progress[100];
+	snprintf(Progress, sizeof(Progress), _("%.1f of %.1f MB of GPS data read"),
+			Done / 1048576.0, Load->TotalBytes / 1048576.0);
+	gtk_progress_bar_set_text(GTK_PROGRESS_BAR(ProgressBar), Progress);
+	if (Load->TotalBytes > 0 && Done <= Load->TotalBytes)
+		gtk_progress_bar_set_fraction(GTK_PROGRESS_BAR(ProgressBar),
+				(double) Done / Load->TotalBytes);
+
+	return TRUE;
+}
+
+/* Runs on the main loop once every GPX file has been read, or given
+ * up on: swaps the new tracks in, if they were all read. */
+gboolean GPXLoaded(gpointer Data)
+{
+	struct GPXLoad* Load = (struct GPXLoad*) Data;
+
+	/* The window is closing. */
+	if (!Load->Pool)
+		return FALSE;
+
+	g_source_remove(Load->Timer);
+	FinishWorkPool(Load->Pool);
+	LoadingGPX = NULL;
+
+	struct GPXFile* Bad = NULL;
+	int i;
+	for (i = 0; i < Load->NumFiles && !Bad; i++)
+	{
+		if (!Load->Files[i].Ok)
+			Bad = &Load->Files[i];
+	}
+
+	struct GPSTrack* Tracks = NULL;
+	if (!Bad)
+		Tracks = (struct GPSTrack*) calloc(Load->NumFiles+1, sizeof(*Tracks));
+
+	if (Tracks)
+	{
+		/* It's all good! Out with the old tracks, and in with
+		 * the new. */
+		while (NumTracks > 0)
 		{
-			/* Result was not null. That means that we
-			 * matched to a point. But that's not the whole
-			 * story. Read on... */
-			switch (Options.Result)
-			{
-				case CORR_OK:
-					/* All cool! Exact match! */
-					State = _("Exact Match");
-					break;
-				case CORR_INTERPOLATED:
-					/* All cool! Interpolated match. */
-					State = _("Interpolated Match");
-					break;
-				case CORR_ROUND:
-					/* All cool! Rounded match. */
-					State = _("Rounded Match");
-					break;
-				case CORR_EXIFWRITEFAIL:
-					/* Not cool - matched, not written. */
-					State = _("Write Failure");
-					break;
-			}
-			/* Now update the screen with the numbers. */
-			SetListItem(&Walk->ListPointer, Walk->Filename,
-					Walk->Time, Result->Lat, Result->Long,
-					Result->Elev, State, 1);
-		} else {
-			/* Result was null. This means something
-			 * really went wrong. Find out and put that
-			 * on the screen. */
-			if (Options.Result == CORR_GPSDATAEXISTS)
-			{
-				/* Do nothing... */
-				SetState(&Walk->ListPointer, _("Data Already Present"));
-				continue;
-			}
-			switch (Options.Result)
-			{
-				case CORR_NOMATCH:
-					/* No match: outside data. */
-					State = _("No Match");
-					break;
-				case CORR_TOOFAR:
-					/* Too far from any point. */
-					State = _("Too far");
-					break;
-				case CORR_NOEXIFINPUT:
-					/* No exif data input. */
-					State = _("No data");
-					break;
-			}
-			/* Now update the screen with the changed state. */
-			SetListItem(&Walk->ListPointer, Walk->Filename,
-					Walk->Time, 0, 0, 0,
-					State, 0);
-		} /* End if Result */
-	} /* End for Walk the list ... */
+			--NumTracks;
+			FreeTrack(&GPSData[NumTracks]);
+		}
+		free(GPSData);
+		for (i = 0; i < Load->NumFiles; i++)
+			Tracks[i] = Load->Files[i].Track;
+		GPSData = Tracks;
+		NumTracks = Load->NumFiles;
+		gtk_widget_hide(PreviewLabel);
+
+		/* Adjust the label to say so. If more than one file
+		 * is given, say so. This string must look like a file
+		 * path. */
+		const char* Name = Load->NumFiles == 1 ? Load->Files[0].Name :
+			_(G_DIR_SEPARATOR_S "multiple files");
+		const size_t ScratchLength = strlen(Name) + 100;
+		char* Scratch = (char*) malloc(sizeof(char) * ScratchLength);
+		snprintf(Scratch, ScratchLength,
+			 _("Read from: %s"), strrchr(Name, G_DIR_SEPARATOR)+1);
+		gtk_label_set_text(GTK_LABEL(GPSSelectedLabel), Scratch);
+		free(Scratch);
+	} else {
+		/* Not good. Clean up the tracks read in; the ones we had
+		 * before are still there. */
+		for (i = 0; i < Load->NumFiles; i++)
+			FreeTrack(&Load->Files[i].Track);
 
-	free(Options.Datum);
+		/* Being cancelled is not an error. */
+		if (Bad && !Load->Progress.Cancel)
+		{
+			GtkWidget* ErrorDialog = gtk_message_dialog_new (GTK_WINDOW(MatchWindow),
+					GTK_DIALOG_DESTROY_WITH_PARENT,
+					GTK_MESSAGE_ERROR,
+					GTK_BUTTONS_CLOSE,
+					_("Unable to read file %s for some reason. Please try again"),
+					Bad->Name);
+			gtk_dialog_run (GTK_DIALOG (ErrorDialog));
+			gtk_widget_destroy (ErrorDialog);
+		}
+	}
+
+	for (i = 0; i < Load->NumFiles; i++)
+		free(Load->Files[i].Name);
+	free(Load->Files);
+	free(Load);
+
+	gtk_widget_hide(ProgressHBox);
+	SetBusy(0);
+	return FALSE;
+}
+
+/* Stops the photo list and the GPS data from being changed while
+ * the threads are using them. */
+void SetBusy(int Busy)
+{
+	gtk_widget_set_sensitive(PhotoAddButton, !Busy);
+	gtk_widget_set_sensitive(PhotoRemoveButton, !Busy);
+	gtk_widget_set_sensitive(SelectGPSButton, !Busy);
+	gtk_widget_set_sensitive(CorrelateButton, !Busy);
+	gtk_widget_set_sensitive(StripGPSButton, !Busy);
 }
 
 void StripGPSButtonPress( GtkWidget *Widget, gpointer Data )
 {
 	/* Someone clicked the Strip GPS Data button. So make it happen!
 	 * First, query out what was selected. */
-	GtkTreeIter Iter;
-
 	GtkTreeSelection* Selection;
 	Selection = gtk_tree_view_get_selection(GTK_TREE_VIEW(PhotoList));
 
@@ -1349,72 +1825,87 @@ void StripGPSButtonPress( GtkWidget *Widget, gpointer Data )
 		return;
 	}
 
-	/* No change MTime. */
-	int NoChangeMtime;
-	if (gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(NoMtimeCheck)))
-	{
-		NoChangeMtime = 1;
-	} else {
-		NoChangeMtime = 0;
-	}
-
-	/* Walk through and remove the items from our internal list. */
+	/* Make a note of them all first, and show that they're on the
+	 * way, so the selection can change while they're being done. */
+	int* Indexes = (int*) malloc(g_list_length(Selected) * sizeof(int));
+	int Count = 0;
+	int First = NumPhotos, Last = -1;
 	GList* Walk;
-	struct GUIPhotoList* PhotoData = NULL;
-	GtkTreePath* ShowPath;
-	for (Walk = Selected; Walk; Walk = Walk->next)
+	for (Walk = Selected; Indexes && Walk; Walk = Walk->next)
 	{
-		/* Get an Iter for this selected row. */
-		if (gtk_tree_model_get_iter(GTK_TREE_MODEL(PhotoListStore), &Iter,
-					    (GtkTreePath*) Walk->data)) {
-			/* Fetch out the data... */
-			gtk_tree_model_get(GTK_TREE_MODEL(PhotoListStore), &Iter, LIST_POINTER, &PhotoData, -1);
-		} else {
-			/* Unable to get the iter...
-			 * Try again, later. */
+		/* A row's number is its index in Photos. */
+		int Index = gtk_tree_path_get_indices((GtkTreePath*) Walk->data)[0];
+		if (Index < 0 || Index >= NumPhotos)
 			continue;
-		}
-
-		/* Say that we're doing it... */
-		SetState(&PhotoData->ListPointer, _("Stripping..."));
+		Photos[Index].State = _("Stripping...");
+		Indexes[Count++] = Index;
+		if (Index < First)
+			First = Index;
+		if (Index > Last)
+			Last = Index;
+	}
+	ShowRows(First, Last);
 
-		/* Point to the cell, too... ie, scroll the tree view
-		 * to ensure that the one we're playing with can be seen on screen. */
-		ShowPath = gtk_tree_model_get_path(GTK_TREE_MODEL(PhotoListStore), &PhotoData->ListPointer);
-		gtk_tree_view_scroll_to_cell(GTK_TREE_VIEW(PhotoList),
-				ShowPath, NULL, FALSE, 0, 0);
-		gtk_tree_path_free(ShowPath);
-		GtkGUIUpdate();
-		
-		/* Strip the tags. */
-		if (RemoveGPSExif(PhotoData->Filename, NoChangeMtime))
-		{
-			SetListItem(&PhotoData->ListPointer, PhotoData->Filename,
-				PhotoData->Time, 200, 200, -7000000, "", 1);
-		} else {
-			SetListItem(&PhotoData->ListPointer, PhotoData->Filename,
-				PhotoData->Time, 200, 200, -7000000, _("Error Stripping"), 1);
-		}
+	/* Free the memory used by GList. */
+	g_list_foreach(Selected, (GFunc)gtk_tree_path_free, NULL);
+	g_list_free(Selected);
 
-	} /* End for Walk the GList. */
+	if (!Indexes)
+		return;
 
-	/* Debug: walk the photo list tree. */
-	/*struct GUIPhotoList* List;
-	for (List = FirstPhoto; List; List = List->Next)
+	/* Strip the tags on the threads; a file each. */
+	struct PhotoRun* Run = StartPhotoRun(StripOne, ShowStripped, 1);
+	int i;
+	if (Run)
 	{
-		printf("List Filename: %s\n", List->Filename);
+		/* No change MTime. */
+		Run->Options.NoChangeMtime =
+			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(NoMtimeCheck));
+		for (i = 0; i < Count; i++)
+			QueuePhoto(Run, Indexes[i]);
+		AllQueued(Run);
+	} else {
+		/* No threads; do them here and now. */
+		struct PhotoRun Serial;
+		memset(&Serial, 0, sizeof(Serial));
+		Serial.Options.NoChangeMtime =
+			gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(NoMtimeCheck));
+		for (i = 0; i < Count; i++)
+		{
+			struct PhotoJob Job;
+			memset(&Job, 0, sizeof(Job));
+			Job.Photo = Indexes[i];
+			StripOne(&Serial, &Job);
+			ShowStripped(&Job);
+		}
+		ShowRows(First, Last);
 	}
-	printf("--------------------------------------------------------------\n");*/
-
+	free(Indexes);
 }
 
+/* Runs on one of the pool's threads: takes the GPS tags out of one
+ * photo. */
+void StripOne(struct PhotoRun* Run, struct PhotoJob* Job)
+{
+	Job->Result = RemoveGPSExif(Photos[Job->Photo].Filename,
+			Run->Options.NoChangeMtime);
+}
 
-void GtkGUIUpdate(void)
+/* Puts what stripping a photo came to on the screen. */
+void ShowStripped(struct PhotoJob* Job)
 {
-	/* Process all GUI events that need to happen. */
-	/* This lets us "update" the screen while things are
-	 * in motion. Might generate slowdowns with heaps of data,
-	 * but generally, it's a good thing. */
-	while (gtk_events_pending ())
-		gtk_main_iteration ();
+	struct GUIPhoto* Photo = &Photos[Job->Photo];
+
+	if (Job->Skipped)
+	{
+		/* Cancelled before it was started: it's as it was. */
+		Photo->State = NULL;
+	} else if (Job->Result) {
+		Photo->IncludesGPS = 0;
+		Photo->GPSInFile = 0;
+		Photo->State = "";
+	} else {
+		Photo->State = _("Error Stripping");
+	}
 }
+
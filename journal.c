@@ -0,0 +1,245 @@
+/* journal.c
+ *
+ * This file contains the progress journal, which lets an
+ * interrupted correlation run carry on where it left off.
+ *
+ * The journal is a text file with one line per finished photo:
+ * the CORR_* result code, a space, and the file name. It's only
+ * ever appended to, and is flushed out every so often rather than
+ * after every photo. A crash loses at most the last batch, and
+ * those photos are simply done again.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "i18n.h"
+#include "journal.h"
+
+/* Flush the journal after this many photos, or this many
+ * seconds, whichever comes first. */
+#define JOURNAL_BATCH   64
+#define JOURNAL_SECONDS 1
+
+struct JournalEntry {
+	char* Path;
+	int Result;
+};
+
+struct Journal {
+	FILE* Out;
+	struct JournalEntry* Entries; /* Hash table of files done before. */
+	size_t NumSlots;
+	size_t NumEntries;
+	int Pending;                  /* Lines written since the last flush. */
+	time_t LastFlush;
+};
+
+static size_t HashPath(const char* Path)
+{
+	/* FNV-1a */
+	size_t Hash = 2166136261U;
+	while (*Path)
+	{
+		Hash ^= (unsigned char)*Path++;
+		Hash *= 16777619U;
+	}
+	return Hash;
+}
+
+static struct JournalEntry* FindEntry(const struct Journal* Journal, const char* Path)
+{
+	size_t Mask = Journal->NumSlots - 1;
+	size_t i = HashPath(Path) & Mask;
+	while (Journal->Entries[i].Path && strcmp(Journal->Entries[i].Path, Path) != 0)
+		i = (i + 1) & Mask;
+	return &Journal->Entries[i];
+}
+
+/* Remembers the result for a file from an earlier run. A later
+ * line for the same file wins. */
+static int AddEntry(struct Journal* Journal, const char* Path, int Result)
+{
+	if ((Journal->NumEntries + 1) * 2 > Journal->NumSlots)
+	{
+		struct JournalEntry* OldEntries = Journal->Entries;
+		size_t OldNumSlots = Journal->NumSlots;
+		size_t i;
+
+		Journal->NumSlots = OldNumSlots ? OldNumSlots * 2 : 1024;
+		Journal->Entries = (struct JournalEntry*)
+			calloc(Journal->NumSlots, sizeof(struct JournalEntry));
+		if (!Journal->Entries)
+		{
+			Journal->Entries = OldEntries;
+			Journal->NumSlots = OldNumSlots;
+			return 0;
+		}
+		for (i = 0; i < OldNumSlots; i++)
+		{
+			if (OldEntries[i].Path)
+				*FindEntry(Journal, OldEntries[i].Path) = OldEntries[i];
+		}
+		free(OldEntries);
+	}
+
+	struct JournalEntry* Entry = FindEntry(Journal, Path);
+	if (!Entry->Path)
+	{
+		Entry->Path = strdup(Path);
+		if (!Entry->Path)
+			return 0;
+		Journal->NumEntries++;
+	}
+	Entry->Result = Result;
+	return 1;
+}
+
+/* Reads in the files done by earlier runs. Returns 0 if the
+ * journal doesn't end with a complete line. */
+static int LoadJournal(struct Journal* Journal, FILE* In)
+{
+	char* Line = NULL;
+	size_t LineSize = 0;
+	ssize_t Length;
+	int Complete = 1;
+
+	while ((Length = getline(&Line, &LineSize, In)) > 0)
+	{
+		char* Path;
+		long Result;
+
+		if (Line[Length - 1] != '\n')
+		{
+			/* Cut short by a crash. That photo will be done again. */
+			Complete = 0;
+			break;
+		}
+		Line[Length - 1] = '\0';
+
+		if (Line[0] == '#')
+			continue;
+		/* Exactly one space separates the result from the name. */
+		Result = strtol(Line, &Path, 10);
+		if (Path == Line || *Path != ' ' || Result <= 0)
+			continue;
+
+		if (!AddEntry(Journal, Path + 1, (int)Result))
+			break;
+	}
+
+	free(Line);
+	return Complete;
+}
+
+struct Journal* OpenJournal(const char* File)
+{
+	struct Journal* Journal = (struct Journal*) calloc(1, sizeof(*Journal));
+	if (!Journal)
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		return NULL;
+	}
+
+	int Complete = 1;
+	FILE* In = fopen(File, "r");
+	if (In)
+	{
+		Complete = LoadJournal(Journal, In);
+		fclose(In);
+	}
+
+	Journal->Out = fopen(File, "a");
+	if (!Journal->Out)
+	{
+		fprintf(stderr, _("Unable to open journal %s.\n"), File);
+		CloseJournal(Journal);
+		return NULL;
+	}
+	if (!Complete)
+	{
+		/* Finish off the broken line so ours start cleanly. */
+		fputs("\n", Journal->Out);
+	}
+	Journal->LastFlush = time(NULL);
+
+	return Journal;
+}
+
+static void FlushJournal(struct Journal* Journal)
+{
+	fflush(Journal->Out);
+	/* Make sure it survives a reboot, too. */
+	fsync(fileno(Journal->Out));
+	Journal->Pending = 0;
+	Journal->LastFlush = time(NULL);
+}
+
+void CloseJournal(struct Journal* Journal)
+{
+	size_t i;
+
+	if (!Journal)
+		return;
+
+	if (Journal->Out)
+	{
+		FlushJournal(Journal);
+		fclose(Journal->Out);
+	}
+	for (i = 0; i < Journal->NumSlots; i++)
+		free(Journal->Entries[i].Path);
+	free(Journal->Entries);
+	free(Journal);
+}
+
+int JournalLookup(const struct Journal* Journal, const char* Path)
+{
+	if (!Journal || !Journal->NumEntries)
+		return 0;
+	return FindEntry(Journal, Path)->Result;
+}
+
+int JournalPreviousCount(const struct Journal* Journal)
+{
+	return Journal ? (int)Journal->NumEntries : 0;
+}
+
+void JournalRecord(struct Journal* Journal, const char* Path, int Result)
+{
+	if (!Journal)
+		return;
+
+	/* A newline in the name would break the format. Such photos
+	 * just don't get journalled, and are done again next time. */
+	if (strchr(Path, '\n'))
+		return;
+
+	fprintf(Journal->Out, "%d %s\n", Result, Path);
+
+	if (++Journal->Pending >= JOURNAL_BATCH ||
+	    time(NULL) - Journal->LastFlush >= JOURNAL_SECONDS)
+	{
+		FlushJournal(Journal);
+	}
+}
@@ -0,0 +1,34 @@
+/* journal.h
+ *
+ * This file contains the prototypes for the progress journal
+ * functions in journal.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct Journal;
+
+struct Journal* OpenJournal(const char* File);
+void CloseJournal(struct Journal* Journal);
+
+/* Returns the CORR_* result recorded for the file, or 0 if the
+ * file hasn't been done yet. */
+int JournalLookup(const struct Journal* Journal, const char* Path);
+/* Returns the number of files recorded in earlier runs. */
+int JournalPreviousCount(const struct Journal* Journal);
+void JournalRecord(struct Journal* Journal, const char* Path, int Result);
@@ -0,0 +1,372 @@
+/* legacy-correlate.c
+ *
+ * This file keeps the original ConvertToUnixTime and photo matching,
+ * exactly as they were before anything was done to make them faster,
+ * for the differential tests in main-difftest.c to check the real
+ * ones against. It isn't built into gpscorrelate itself.
+ *
+ * Don't change anything here to follow changes in unixtime.c or
+ * correlate.c. The whole point is that it stays the same.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <string.h>
+
+#include "gpsstructure.h"
+#include "correlate.h"
+#include "unixtime.h"
+#include "legacy-correlate.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+static void LegacyRound(const struct GPSPoint* First, struct GPSPoint* Result,
+			time_t PhotoTime);
+static void LegacyInterpolate(const struct GPSPoint* First, struct GPSPoint* Result,
+			      time_t PhotoTime);
+
+/* Some systems have a version of this called timegm(), but it's not portable */
+static time_t portable_timegm(struct tm *tm)
+{
+	static const char *tz;
+
+        if (!tz) {
+		tz = getenv("TZ");
+		if (tz)
+			/* Copy the string, since it's only guaranteed to be
+			 * valid until the next getenv or setenv */
+			tz = strdup(tz);
+	}
+
+	/* Set an empty TZ to force UTC */
+	setenv("TZ", "", 1);
+	tzset();
+	time_t ret = mktime(tm);
+
+	/* Restore the original TZ */
+	if (tz)
+	   setenv("TZ", tz, 1);
+	else
+	   unsetenv("TZ");
+	tzset();
+	return ret;
+}
+
+time_t LegacyConvertToUnixTime(const char* StringTime, const char* Format,
+		int TZOffsetHours, int TZOffsetMinutes)
+{
+	/* Read the time using the specified format. 
+	 * The format and string being read from must
+	 * have the most significant time on the left,
+	 * and the least significant on the right:
+	 * ie, Year on the left, seconds on the right. */
+
+	/* Sanity check... */
+	if (StringTime == NULL || Format == NULL)
+	{
+		return 0;
+	}
+
+	/* Define and set up our structure. */
+	struct tm Time;
+	Time.tm_wday = 0;
+	Time.tm_yday = 0;
+	Time.tm_isdst = 0; // there is no DST in UTC
+
+	/* Read out the time from the string using our format. */
+	sscanf(StringTime, Format, &Time.tm_year, &Time.tm_mon,
+			&Time.tm_mday, &Time.tm_hour,
+			&Time.tm_min, &Time.tm_sec);
+
+	/* Adjust the years for the mktime function to work. */
+	Time.tm_year -= 1900;
+	Time.tm_mon  -= 1;
+
+	/* Calculate and return the Unix time. */
+	time_t thetime = portable_timegm(&Time);
+
+	/* Add our timezone offset to the time.
+	 * Note also that we SUBTRACT these times. We want the
+	 * result to be in UTC. */
+	thetime -= TZOffsetHours * 60 * 60;
+	thetime -= TZOffsetMinutes * 60;
+
+	return thetime;
+}
+
+struct GPSPoint* LegacyCorrelateTime(const char* TimeTemp,
+		struct CorrelateOptions* Options)
+{
+	Options->MatchTrack = -1;
+	Options->MatchPoint = -1;
+
+	if (Options->AutoTimeZone)
+	{
+		/* Use the local time zone as of the date of first picture
+		 * as the time for correlating all the remainder. */
+		time_t RealTime;
+
+		/* PhotoTime isn't a true epoch time, but is rather out
+		 * by the local offset from UTC */
+		time_t PhotoTime =
+			LegacyConvertToUnixTime(TimeTemp, EXIF_DATE_FORMAT, 0, 0);
+
+		/* Extract the component time values */
+		struct tm *PhotoTm = gmtime(&PhotoTime);
+
+		/* Then create a true epoch-based local time, including DST */
+		PhotoTm->tm_isdst = -1;
+		RealTime = mktime(PhotoTm);
+
+		/* Finally, RealTime is the proper Epoch time of the photo.
+		 * The difference from PhotoTime is the time zone offset. */
+		Options->TimeZoneHours = (PhotoTime - RealTime) / 3600;
+		Options->TimeZoneMins = ((PhotoTime - RealTime) % 3600) / 60;
+		Options->AutoTimeZone = 0;
+	}
+	//printf("Using offset %02d:%02d\n", Options->TimeZoneHours, Options->TimeZoneMins);
+
+	/* Now convert the time into Unixtime. */
+	time_t PhotoTime =
+		LegacyConvertToUnixTime(TimeTemp, EXIF_DATE_FORMAT,
+			Options->TimeZoneHours, Options->TimeZoneMins);
+
+	/* Add the PhotoOffset time. This is to make the Photo time match
+	 * the GPS time - ie, it is (GPS - Photo). */
+	PhotoTime += Options->PhotoOffset;
+
+	/* Search the list of GPS tracks to find one containing the range
+	 * we're interested in. Options points to an array with the last
+	 * entry denoted by a NULL Points pointer. */
+	int TrackNum;
+	for (TrackNum = 0; Options->Track[TrackNum].Points; ++TrackNum)
+	{
+		/* Check that the photo is within the times that
+		 * our tracks are for. Can't really match it if
+		 * we were not logging when it was taken.
+		 * Note: photos taken between logging sessions of the
+		 * same file will still make it inside of this. In
+		 * some cases, it won't matter, but if it does, then
+		 * keep this in mind!! */
+		if ((PhotoTime >= Options->Track[TrackNum].MinTime) &&
+		    (PhotoTime <= Options->Track[TrackNum].MaxTime))
+			break;
+	}
+	if (!Options->Track[TrackNum].Points) {
+		/* All tracks were outside the time range. Abort. */
+		Options->Result = CORR_NOMATCH;
+		return NULL;
+	}
+
+	/* Time to run through the list, and see if our PhotoTime
+	 * is in between two points. Alternately, it might be
+	 * exactly on a point... even better... */
+	const struct GPSPoint* Search;
+	int PointNum;
+	struct GPSPoint* Actual = (struct GPSPoint*) malloc(sizeof(struct GPSPoint));
+
+	Options->Result = CORR_NOMATCH; /* For convenience later */
+	Options->MatchTrack = TrackNum;
+
+	for (Search = Options->Track[TrackNum].Points, PointNum = 0; Search;
+	     Search = Search->Next, PointNum++)
+	{
+		/* First test: is it exactly this point? */
+		if (PhotoTime == Search->Time)
+		{
+			/* This is the point, exactly.
+			 * Copy out the data and return that. */
+			Actual->Lat = Search->Lat;
+			Actual->LatDecimals = Search->LatDecimals;
+			Actual->Long = Search->Long;
+			Actual->LongDecimals = Search->LongDecimals;
+			Actual->Elev = Search->Elev;
+			Actual->ElevDecimals = Search->ElevDecimals;
+			Actual->Time = Search->Time;
+
+			Options->Result = CORR_OK;
+			Options->MatchPoint = PointNum;
+			break;
+		}
+
+		/* Sanity check / track segment fix: is the photo time before
+		 * the current point? If so, we've gone past it. Hrm. */
+		if (Search->Time > PhotoTime)
+		{
+			Options->Result = CORR_NOMATCH;
+			break;
+		}
+
+		/* Sanity check: we need to peek at the next point.
+		 * Make sure we can. */
+		if (Search->Next == NULL) break;
+		/* Sanity check: does this point have the same
+		 * timestamp as the next? If so, skip onward. */
+		if (Search->Time == Search->Next->Time) continue;
+		/* Sanity check: does this point have a later
+		 * timestamp than the next point? If so, skip. */
+		if (Search->Time > Search->Next->Time) continue;
+
+		if (Options->DoBetweenTrkSeg)
+		{
+			/* Righto, we are interpolating between segments.
+			 * So simply do nothing! Simple! */
+		} else {
+			/* Don't check between track segments.
+			 * If the end of segment marker is set, then simply
+			 * "jump" over this point. */
+			if (Search->EndOfSegment)
+			{
+				continue;
+			}
+		}
+
+		/* Sort of sanity check: is this photo inside our
+		 * "feather" time? If not, abort. */
+		if (Options->FeatherTime)
+		{
+			/* Is the point between these two? */
+			if ((PhotoTime > Search->Time) &&
+				(PhotoTime < Search->Next->Time))
+			{
+				/* It is. Now is it too far
+				 * from these two? */
+				if (((Search->Time + Options->FeatherTime) < PhotoTime) &&
+					((Search->Next->Time - Options->FeatherTime) > PhotoTime))
+				{ 
+					/* We are inside the feather
+					 * time between two points.
+					 * Abort. */
+					Options->Result = CORR_TOOFAR;
+					Options->MatchPoint = PointNum;
+					free(Actual);
+					return NULL;
+				} 
+			}
+		} /* endif (Options->Feather) */
+		
+		/* Second test: is it between this and the
+		 * next point? */
+		if ((PhotoTime > Search->Time) &&
+				(PhotoTime < Search->Next->Time))
+		{
+			/* It is between these points.
+			 * Unless told otherwise, we interpolate.
+			 * If not interpolating, we round to nearest.
+			 * If points are equidistant, we round down. */
+			if (Options->NoInterpolate)
+			{
+				/* No interpolation. Round. */
+				LegacyRound(Search, Actual, PhotoTime);
+				Options->Result = CORR_ROUND;
+				Options->MatchPoint = PointNum;
+				break;
+			} else {
+				/* Interpolate away! */
+				LegacyInterpolate(Search, Actual, PhotoTime);
+				Options->Result = CORR_INTERPOLATED;
+				Options->MatchPoint = PointNum;
+				break;
+			}
+		}
+	} /* End for() loop to search. */
+
+	/* Did we actually match it at all? */
+	if (Options->Result == CORR_NOMATCH)
+	{
+		/* Nope, no match at all. */
+		/* Return with nothing. */
+		free(Actual);
+		return NULL;
+	}
+
+	return Actual;
+}
+
+static void LegacyRound(const struct GPSPoint* First, struct GPSPoint* Result,
+		  time_t PhotoTime)
+{
+	/* Round the point between the two points - ie, it will end
+	 * up being one or the other point. */
+	const struct GPSPoint* CopyFrom = NULL;
+
+	/* Determine the difference between the two points. 
+	 * We're using the scale function used by interpolate.
+	 * This gives us a good view of where we are... */
+	double Scale = (double)First->Next->Time - (double)First->Time;
+	Scale = ((double)PhotoTime - (double)First->Time) / Scale;
+
+	/* Compare our scale. */
+	if (Scale <= 0.5)
+	{
+		/* Closer to the first point. */
+		CopyFrom = First;
+	} else {
+		/* Closer to the second point. */
+		CopyFrom = First->Next;
+	}
+
+	/* Copy the numbers over... */
+	Result->Lat = CopyFrom->Lat;
+	Result->LatDecimals = CopyFrom->LatDecimals;
+	Result->Long = CopyFrom->Long;
+	Result->LongDecimals = CopyFrom->LongDecimals;
+	Result->Elev = CopyFrom->Elev;
+	Result->ElevDecimals = CopyFrom->ElevDecimals;
+	Result->Time = CopyFrom->Time;
+
+	/* Done! */
+	
+}
+
+static void LegacyInterpolate(const struct GPSPoint* First, struct GPSPoint* Result,
+		 time_t PhotoTime)
+{
+	/* Interpolate between the two points. The first point
+	 * is First, the other First->Next. Results into Result. */
+
+	/* Calculate the "scale": a decimal giving the relative distance
+	 * in time between the two points. Ie, a number between 0 and 1 - 
+	 * 0 is the first point, 1 is the next point, and 0.5 would be
+	 * half way. */
+	double Scale = (double)First->Next->Time - (double)First->Time;
+	Scale = ((double)PhotoTime - (double)First->Time) / Scale;
+
+	/* Now calculate the Latitude. */
+	Result->Lat = First->Lat + ((First->Next->Lat - First->Lat) * Scale);
+	Result->LatDecimals = MIN(First->LatDecimals, First->Next->LatDecimals);
+
+	/* And the longitude. */
+	Result->Long = First->Long + ((First->Next->Long - First->Long) * Scale);
+	Result->LongDecimals = MIN(First->LongDecimals, First->Next->LongDecimals);
+
+	/* And the elevation. If elevation wasn't set, it should be zero with
+	 * a negative ElevDecimals, which will cause it to be dropped
+	 * when written. */
+	Result->Elev = First->Elev + ((First->Next->Elev - First->Elev) * Scale);
+	Result->ElevDecimals = MIN(First->ElevDecimals, First->Next->ElevDecimals);
+
+	/* The time is not interpolated, but matches photo. */
+	Result->Time = PhotoTime;
+
+	/* And that should have fixed us... */
+
+}
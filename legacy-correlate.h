@@ -0,0 +1,30 @@
+/* legacy-correlate.h
+ *
+ * This file contains the prototypes for the reference versions of
+ * the time conversion and matching in legacy-correlate.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* ConvertToUnixTime, as it was. */
+time_t LegacyConvertToUnixTime(const char* StringTime, const char* Format,
+		int TZOffsetHours, int TZOffsetMinutes);
+
+/* CorrelateTime, as it was: a walk along the linked list of points. */
+struct GPSPoint* LegacyCorrelateTime(const char* TimeTemp,
+		struct CorrelateOptions* Options);
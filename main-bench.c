@@ -0,0 +1,660 @@
+/* main-bench.c
+ *
+ * This file is the benchmark program run by "make bench". It times
+ * the parts of gpscorrelate that matter for speed, on made-up data
+ * from bench-gen.c, so that changes can be measured the same way
+ * every time.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#include "gpsstructure.h"
+#include "gpx-read.h"
+#include "exif-gps.h"
+#include "correlate.h"
+#include "unixtime.h"
+#include "bench-gen.h"
+#include "bench-baseline.h"
+
+/* All the made-up data starts at 2010-01-01 00:00:00 UTC. */
+#define BENCH_START    1262304000
+#define BENCH_INTERVAL 5 /* Seconds between track points */
+#define BENCH_SEED     12345
+
+struct BenchResult {
+	long Ops;          /* Number of things done, */
+	long long Nanos;   /* the time taken to do them, */
+	long long Bytes;   /* and the size of the data, where that means anything. */
+	long Allocs;       /* Allocations made while doing them. */
+	long PeakRSS;      /* Most memory used by the run, in KiB. */
+};
+
+struct Scenario {
+	const char* Name;
+	int (*Run)(const struct Scenario* Scenario, struct BenchResult* Result);
+	long Size;         /* Points, calls or photos. */
+	long Extra;        /* Segment length, track points or photo size. */
+	int Default;       /* Run when no scenarios are named. */
+	const char* Description;
+};
+
+static char* Dir;                  /* Where the data goes. */
+static const char* CliPath = "./gpscorrelate";
+
+static unsigned long Allocations;
+static unsigned long AllocationsBegan;
+static long long ClockBegan;
+
+#ifdef __GLIBC__
+/* Count every allocation, whoever makes it: us, libxml2 or Exiv2. */
+extern void* __libc_malloc(size_t Size);
+extern void* __libc_calloc(size_t Count, size_t Size);
+extern void* __libc_realloc(void* Pointer, size_t Size);
+
+void* malloc(size_t Size)
+{
+	__sync_fetch_and_add(&Allocations, 1);
+	return __libc_malloc(Size);
+}
+
+void* calloc(size_t Count, size_t Size)
+{
+	__sync_fetch_and_add(&Allocations, 1);
+	return __libc_calloc(Count, Size);
+}
+
+void* realloc(void* Pointer, size_t Size)
+{
+	__sync_fetch_and_add(&Allocations, 1);
+	return __libc_realloc(Pointer, Size);
+}
+#endif
+
+/* Brackets the part of a scenario being measured. */
+static void StartClock(void)
+{
+	AllocationsBegan = Allocations;
+	ClockBegan = MonotonicNanos();
+}
+
+static void StopClock(struct BenchResult* Result)
+{
+	Result->Nanos = MonotonicNanos() - ClockBegan;
+	Result->Allocs = (long)(Allocations - AllocationsBegan);
+}
+
+/* Returns the name of a file in the scratch directory. Free it. */
+static char* ScratchPath(const char* Format, long A, long B)
+{
+	char Name[100];
+	snprintf(Name, sizeof(Name), Format, A, B);
+	char* Path = (char*) malloc(strlen(Dir) + strlen(Name) + 2);
+	if (!Path)
+	{
+		fprintf(stderr, "Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	sprintf(Path, "%s/%s", Dir, Name);
+	return Path;
+}
+
+static long long FileSize(const char* File)
+{
+	struct stat Info;
+	return stat(File, &Info) == 0 ? (long long)Info.st_size : 0;
+}
+
+/* Returns a GPX file of the given size, making it the first time. */
+static char* BenchTrack(long Points, long SegmentEvery)
+{
+	char* File = ScratchPath("track-%ld-%ld.gpx", Points, SegmentEvery);
+	struct stat Info;
+	if (stat(File, &Info) != 0 &&
+	    !WriteBenchGPX(File, Points, SegmentEvery, BENCH_START,
+			   BENCH_INTERVAL, BENCH_SEED))
+	{
+		exit(EXIT_FAILURE);
+	}
+	return File;
+}
+
+/* Makes Count photos of Size bytes, spread over a track of
+ * TrackPoints, and a list of their names. Returns the list's name. */
+static char* BenchPhotos(long Count, long Size, long TrackPoints)
+{
+	char* PhotoDir = ScratchPath("photos-%ld-%ld", Count, Size);
+	char* List = ScratchPath("photos-%ld-%ld.list", Count, Size);
+	unsigned long long State = BENCH_SEED;
+	char* Photo = (char*) malloc(strlen(PhotoDir) + 32);
+	long Span = TrackPoints * BENCH_INTERVAL;
+	long i;
+
+	mkdir(PhotoDir, 0700);
+	FILE* Names = fopen(List, "w");
+	if (!Photo || !Names)
+	{
+		fprintf(stderr, "Unable to create %s.\n", List);
+		exit(EXIT_FAILURE);
+	}
+	for (i = 0; i < Count; i++)
+	{
+		sprintf(Photo, "%s/photo-%06ld.jpg", PhotoDir, i);
+		time_t PhotoTime = BENCH_START + (time_t)(BenchRandom(&State) % Span);
+		if (!WriteBenchJPEG(Photo, PhotoTime, Size))
+			exit(EXIT_FAILURE);
+		fprintf(Names, "%s\n", Photo);
+	}
+	fclose(Names);
+	free(Photo);
+	free(PhotoDir);
+	return List;
+}
+
+/* Reads the names written by BenchPhotos. */
+static char** ReadPhotoList(const char* List, long Count)
+{
+	char** Names = (char**) calloc(Count, sizeof(char*));
+	char Line[1024];
+	long i = 0;
+	FILE* In = fopen(List, "r");
+	if (!Names || !In)
+	{
+		fprintf(stderr, "Unable to read %s.\n", List);
+		exit(EXIT_FAILURE);
+	}
+	while (i < Count && fgets(Line, sizeof(Line), In))
+	{
+		Line[strcspn(Line, "\n")] = '\0';
+		Names[i++] = strdup(Line);
+	}
+	fclose(In);
+	return Names;
+}
+
+static void FreePhotoList(char** Names, long Count)
+{
+	long i;
+	for (i = 0; i < Count; i++)
+		free(Names[i]);
+	free(Names);
+}
+
+static void SetUpOptions(struct CorrelateOptions* Options, struct GPSTrack* Track)
+{
+	memset(Options, 0, sizeof(*Options));
+	Options->Datum = (char*) "WGS-84";
+	Options->DegMinSecs = 1;
+	Options->NoWriteExif = 1;
+	Options->Track = Track;
+}
+
+static int BenchReadGPX(const struct Scenario* Scenario, struct BenchResult* Result)
+{
+	char* File = BenchTrack(Scenario->Size, Scenario->Extra);
+	struct GPSTrack Track;
+
+	memset(&Track, 0, sizeof(Track));
+	StartClock();
+	int Ok = ReadGPX(File, &Track);
+	StopClock(Result);
+	Result->Ops = Scenario->Size;
+	Result->Bytes = FileSize(File);
+
+	FreeTrack(&Track);
+	free(File);
+	return Ok;
+}
+
+static int BenchUnixTime(const struct Scenario* Scenario, struct BenchResult* Result)
+{
+	unsigned long long State = BENCH_SEED;
+	char Times[1024][20];
+	volatile time_t Sink = 0;
+	long i;
+
+	for (i = 0; i < 1024; i++)
+		FormatExifTime(BENCH_START + (time_t)(BenchRandom(&State) % 400000000), Times[i]);
+
+	StartClock();
+	for (i = 0; i < Scenario->Size; i++)
+		Sink += ConvertToUnixTime(Times[i % 1024], EXIF_DATE_FORMAT, 0, 0);
+	StopClock(Result);
+	Result->Ops = Scenario->Size;
+	return 1;
+}
+
+static int BenchMatch(const struct Scenario* Scenario, struct BenchResult* Result)
+{
+	char* File = BenchTrack(Scenario->Extra, 0);
+	struct GPSTrack Track[2];
+	struct CorrelateOptions Options;
+	unsigned long long State = BENCH_SEED;
+	long Span = Scenario->Extra * BENCH_INTERVAL;
+	long i;
+
+	char (*Times)[20] = (char (*)[20]) malloc(Scenario->Size * 20);
+	memset(Track, 0, sizeof(Track));
+	if (!Times || !ReadGPX(File, &Track[0]))
+		return 0;
+	for (i = 0; i < Scenario->Size; i++)
+		FormatExifTime(BENCH_START + (time_t)(BenchRandom(&State) % Span), Times[i]);
+	SetUpOptions(&Options, Track);
+
+	StartClock();
+	for (i = 0; i < Scenario->Size; i++)
+		free(CorrelateTime(Times[i], &Options));
+	StopClock(Result);
+	Result->Ops = Scenario->Size;
+
+	FreeTrack(&Track[0]);
+	free(Times);
+	free(File);
+	return 1;
+}
+
+static int BenchExifRead(const struct Scenario* Scenario, struct BenchResult* Result)
+{
+	char* List = BenchPhotos(Scenario->Size, Scenario->Extra, 1000);
+	char** Names = ReadPhotoList(List, Scenario->Size);
+	int IncludesGPS;
+	long i;
+	int Ok = 1;
+
+	StartClock();
+	for (i = 0; i < Scenario->Size; i++)
+	{
+		char* Time = ReadExifDate(Names[i], &IncludesGPS);
+		if (!Time)
+			Ok = 0;
+		free(Time);
+	}
+	StopClock(Result);
+	Result->Ops = Scenario->Size;
+	Result->Bytes = (long long)Scenario->Size * Scenario->Extra;
+
+	FreePhotoList(Names, Scenario->Size);
+	free(List);
+	return Ok;
+}
+
+static int BenchExifWrite(const struct Scenario* Scenario, struct BenchResult* Result)
+{
+	/* Fresh photos each time, so that there's something to write. */
+	char* List = BenchPhotos(Scenario->Size, Scenario->Extra, 1000);
+	char** Names = ReadPhotoList(List, Scenario->Size);
+	struct GPSPoint Point;
+	long i;
+	int Ok = 1;
+
+	memset(&Point, 0, sizeof(Point));
+	Point.Lat = -31.952345;
+	Point.LatDecimals = 6;
+	Point.Long = 115.861234;
+	Point.LongDecimals = 6;
+	Point.Elev = 21.5;
+	Point.ElevDecimals = 1;
+	Point.Time = BENCH_START;
+
+	StartClock();
+	for (i = 0; i < Scenario->Size; i++)
+	{
+		if (!WriteGPSData(Names[i], &Point, "WGS-84", 0, 1))
+			Ok = 0;
+	}
+	StopClock(Result);
+	Result->Ops = Scenario->Size;
+	Result->Bytes = (long long)Scenario->Size * Scenario->Extra;
+
+	FreePhotoList(Names, Scenario->Size);
+	free(List);
+	return Ok;
+}
+
+static int BenchCli(const struct Scenario* Scenario, struct BenchResult* Result)
+{
+	char* Track = BenchTrack(10000, 0);
+	char* List = BenchPhotos(Scenario->Size, Scenario->Extra, 10000);
+
+	size_t Length = strlen(CliPath) + strlen(Track) + strlen(List) + 64;
+	char* Command = (char*) malloc(Length);
+	if (!Command)
+		return 0;
+	snprintf(Command, Length, "%s -g %s -z 0 --files-from %s > /dev/null",
+		 CliPath, Track, List);
+
+	StartClock();
+	int Status = system(Command);
+	StopClock(Result);
+	Result->Ops = Scenario->Size;
+	Result->Bytes = (long long)Scenario->Size * Scenario->Extra;
+
+	free(Command);
+	free(List);
+	free(Track);
+	/* Exit code 2 just means some photos didn't match. */
+	return Status != -1 && WIFEXITED(Status) &&
+		(WEXITSTATUS(Status) == 0 || WEXITSTATUS(Status) == 2);
+}
+
+static const struct Scenario Scenarios[] = {
+	{ "gpx-1k",          BenchReadGPX,   1000,     0,      1, "ReadGPX, 1k points" },
+	{ "gpx-100k",        BenchReadGPX,   100000,   0,      1, "ReadGPX, 100k points" },
+	{ "gpx-1m",          BenchReadGPX,   1000000,  0,      1, "ReadGPX, 1M points" },
+	{ "gpx-1m-segments", BenchReadGPX,   1000000,  100,    1, "ReadGPX, 1M points in segments of 100" },
+	{ "gpx-50m",         BenchReadGPX,   50000000, 0,      0, "ReadGPX, 50M points (about 5 GB)" },
+	{ "unixtime",        BenchUnixTime,  1000000,  0,      1, "ConvertToUnixTime, 1M calls" },
+	{ "match-sparse",    BenchMatch,     1000,     1000000, 1, "CorrelateTime, 1k photos on a 1M point track" },
+	{ "match-dense",     BenchMatch,     100000,   10000,  1, "CorrelateTime, 100k photos on a 10k point track" },
+	{ "exif-read",       BenchExifRead,  1000,     65536,  1, "ReadExifDate, 1k 64 KiB photos" },
+	{ "exif-write",      BenchExifWrite, 1000,     65536,  1, "WriteGPSData, 1k 64 KiB photos" },
+	{ "cli",             BenchCli,       1000,     65536,  1, "gpscorrelate, 1k 64 KiB photos, 10k point track" },
+	{ NULL, NULL, 0, 0, 0, NULL }
+};
+
+static const struct Scenario* FindScenario(const char* Name)
+{
+	const struct Scenario* Scenario;
+	for (Scenario = Scenarios; Scenario->Name; Scenario++)
+	{
+		if (strcmp(Scenario->Name, Name) == 0)
+			return Scenario;
+	}
+	return NULL;
+}
+
+static int CompareLongLong(const void* A, const void* B)
+{
+	long long a = *(const long long*)A;
+	long long b = *(const long long*)B;
+	return a < b ? -1 : a > b;
+}
+
+/* Returns the median of Count values, putting them in order. */
+static long long Median(long long* Values, int Count)
+{
+	qsort(Values, Count, sizeof(*Values), CompareLongLong);
+	return Values[Count / 2];
+}
+
+/* Runs a scenario once in a child process, so that its memory use
+ * can be measured on its own and nothing it leaves behind affects
+ * the next run. */
+static int RunOnce(const struct Scenario* Scenario, struct BenchResult* Result)
+{
+	struct rusage Usage;
+	int Pipe[2];
+	int Status;
+
+	if (pipe(Pipe) != 0)
+		return 0;
+	fflush(stdout);
+	pid_t Child = fork();
+	if (Child < 0)
+	{
+		close(Pipe[0]);
+		close(Pipe[1]);
+		return 0;
+	}
+	if (Child == 0)
+	{
+		close(Pipe[0]);
+		memset(Result, 0, sizeof(*Result));
+		int Ok = Scenario->Run(Scenario, Result) &&
+			write(Pipe[1], Result, sizeof(*Result)) == sizeof(*Result);
+		_exit(Ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close(Pipe[1]);
+	ssize_t Got = read(Pipe[0], Result, sizeof(*Result));
+	close(Pipe[0]);
+	if (wait4(Child, &Status, 0, &Usage) != Child)
+		return 0;
+	/* Linux gives this in KiB. */
+	Result->PeakRSS = Usage.ru_maxrss;
+	return Got == sizeof(*Result) && WIFEXITED(Status) &&
+		WEXITSTATUS(Status) == EXIT_SUCCESS;
+}
+
+/* Runs a scenario Repeat times, fills in Summary, and prints the
+ * median run. */
+static int RunScenario(const struct Scenario* Scenario, int Repeat,
+		       struct BenchSummary* Summary)
+{
+	long long* Nanos = (long long*) calloc(Repeat, sizeof(long long));
+	long long* Allocs = (long long*) calloc(Repeat, sizeof(long long));
+	struct BenchResult Result;
+	int i;
+
+	if (!Nanos || !Allocs)
+	{
+		free(Nanos);
+		free(Allocs);
+		return 0;
+	}
+
+	memset(Summary, 0, sizeof(*Summary));
+	snprintf(Summary->Name, sizeof(Summary->Name), "%s", Scenario->Name);
+	for (i = 0; i < Repeat; i++)
+	{
+		if (!RunOnce(Scenario, &Result))
+		{
+			printf("%-16s failed\n", Scenario->Name);
+			free(Nanos);
+			free(Allocs);
+			return 0;
+		}
+		Nanos[i] = Result.Nanos;
+		Allocs[i] = Result.Allocs;
+		if (Result.PeakRSS > Summary->PeakRSS)
+			Summary->PeakRSS = Result.PeakRSS;
+	}
+
+	Summary->Ops = Result.Ops;
+	Summary->Bytes = Result.Bytes;
+	Summary->Median = Median(Nanos, Repeat);
+	Summary->Allocs = (long) Median(Allocs, Repeat);
+	/* The median absolute deviation: like the standard deviation,
+	 * but one unlucky run can't throw it off. */
+	for (i = 0; i < Repeat; i++)
+		Nanos[i] = llabs(Nanos[i] - Summary->Median);
+	Summary->MAD = Median(Nanos, Repeat);
+
+	double Seconds = Summary->Median / 1e9;
+	printf("%-16s %10ld %10.3f s %10.3f us %12.0f/s", Scenario->Name,
+	       Summary->Ops, Seconds, Summary->Median / 1e3 / Summary->Ops,
+	       Seconds > 0 ? Summary->Ops / Seconds : 0.0);
+	if (Summary->Bytes)
+		printf(" %8.1f MB/s", Seconds > 0 ? Summary->Bytes / 1e6 / Seconds : 0.0);
+	printf("\n");
+
+	free(Nanos);
+	free(Allocs);
+	return 1;
+}
+
+/* Removes Path and, if it's a directory, everything in it. */
+static void RemoveTree(const char* Path)
+{
+	DIR* Dir = opendir(Path);
+	struct dirent* Entry;
+
+	if (Dir)
+	{
+		while ((Entry = readdir(Dir)))
+		{
+			if (strcmp(Entry->d_name, ".") == 0 || strcmp(Entry->d_name, "..") == 0)
+				continue;
+			char* Full = (char*) malloc(strlen(Path) + strlen(Entry->d_name) + 2);
+			if (!Full)
+				break;
+			sprintf(Full, "%s/%s", Path, Entry->d_name);
+			RemoveTree(Full);
+			free(Full);
+		}
+		closedir(Dir);
+	}
+	remove(Path);
+}
+
+static void PrintUsage(const char* ProgramName)
+{
+	const struct Scenario* Scenario;
+
+	printf("Usage: %s [options] [scenario ...]\n", ProgramName);
+	puts("-d DIR     Keep the generated data in DIR, and reuse it next time");
+	puts("-c PATH    The gpscorrelate to run for the cli scenario (./gpscorrelate)");
+	puts("-r N       Run each scenario N times and show the median (3)");
+	puts("-o FILE    Save the results in FILE, as a baseline");
+	puts("-b FILE    Compare the results with the baseline in FILE, and fail");
+	puts("           if any got worse by more than the threshold");
+	puts("-t PERCENT The threshold for -b (10)");
+	puts("-h         Show this message");
+	puts("\nScenarios (* = run by default):");
+	for (Scenario = Scenarios; Scenario->Name; Scenario++)
+		printf("  %c %-16s %s\n", Scenario->Default ? '*' : ' ',
+		       Scenario->Name, Scenario->Description);
+}
+
+int main(int argc, char** argv)
+{
+	const struct Scenario* Chosen[sizeof(Scenarios) / sizeof(Scenarios[0])];
+	struct BenchSummary Summaries[sizeof(Scenarios) / sizeof(Scenarios[0])];
+	const struct Scenario* Scenario;
+	const char* SaveFile = NULL;
+	const char* BaselineFile = NULL;
+	double Threshold = 10.0;
+	int Repeat = 3;
+	int KeepDir = 0;
+	int NumChosen = 0;
+	int NumRun = 0;
+	int Ok = 1;
+	int c;
+
+	while ((c = getopt(argc, argv, "d:c:r:o:b:t:h")) != -1)
+	{
+		switch (c)
+		{
+			case 'd':
+				Dir = strdup(optarg);
+				KeepDir = 1;
+				mkdir(Dir, 0700);
+				break;
+			case 'c':
+				CliPath = optarg;
+				break;
+			case 'r':
+				Repeat = atoi(optarg);
+				if (Repeat < 1)
+					Repeat = 1;
+				break;
+			case 'o':
+				SaveFile = optarg;
+				break;
+			case 'b':
+				BaselineFile = optarg;
+				break;
+			case 't':
+				Threshold = atof(optarg);
+				break;
+			default:
+				PrintUsage(argv[0]);
+				exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	for (c = optind; c < argc; c++)
+	{
+		if (!(Scenario = FindScenario(argv[c])))
+		{
+			fprintf(stderr, "Unknown scenario %s.\n", argv[c]);
+			exit(EXIT_FAILURE);
+		}
+		if (NumChosen < (int)(sizeof(Chosen) / sizeof(Chosen[0])))
+			Chosen[NumChosen++] = Scenario;
+	}
+	if (optind == argc)
+	{
+		for (Scenario = Scenarios; Scenario->Name; Scenario++)
+		{
+			if (Scenario->Default)
+				Chosen[NumChosen++] = Scenario;
+		}
+	}
+
+	if (!Dir)
+	{
+		const char* Tmp = getenv("TMPDIR");
+		char Template[1024];
+		snprintf(Template, sizeof(Template), "%s/gpscorrelate-bench.XXXXXX",
+			 Tmp ? Tmp : "/tmp");
+		if (!mkdtemp(Template))
+		{
+			fprintf(stderr, "Unable to create %s.\n", Template);
+			exit(EXIT_FAILURE);
+		}
+		Dir = strdup(Template);
+	}
+
+	printf("%-16s %10s %12s %13s %14s\n", "Scenario", "Ops", "Time",
+	       "Per op", "Rate");
+	for (c = 0; c < NumChosen; c++)
+	{
+		if (RunScenario(Chosen[c], Repeat, &Summaries[NumRun]))
+			NumRun++;
+		else
+			Ok = 0;
+	}
+
+	if (SaveFile && !WriteBaseline(SaveFile, Summaries, NumRun))
+		Ok = 0;
+
+	if (BaselineFile)
+	{
+		int NumBase;
+		struct BenchSummary* Base = ReadBaseline(BaselineFile, &NumBase);
+		if (!Base)
+			Ok = 0;
+		printf("\nCompared with %s (threshold %.1f%%):\n", BaselineFile, Threshold);
+		for (c = 0; Base && c < NumRun; c++)
+		{
+			const struct BenchSummary* Then =
+				FindSummary(Base, NumBase, Summaries[c].Name);
+			if (Then)
+				Ok = CompareSummary(&Summaries[c], Then, Threshold, stdout) && Ok;
+			else
+				printf("%-16s not in the baseline\n", Summaries[c].Name);
+		}
+		free(Base);
+	}
+
+	if (!KeepDir)
+		RemoveTree(Dir);
+	free(Dir);
+
+	return Ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
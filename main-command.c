@@ -32,13 +32,26 @@
 #include <getopt.h>
 #include <string.h>
 #include <locale.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <pthread.h>
 
 #include "i18n.h"
 #include "gpsstructure.h"
 #include "exif-gps.h"
+#include "photo-cache.h"
+#include "journal.h"
+#include "dirwalk.h"
+#include "report.h"
+#include "stats.h"
+#include "trace.h"
 #include "unixtime.h"
 #include "gpx-read.h"
 #include "correlate.h"
+#include "watch.h"
+#include "workpool.h"
+#include "pipeline.h"
 
 #define GPS_EXIT_WARNING 2
 
@@ -61,6 +74,21 @@ static const struct option program_options[] = {
 	{ "fix-datestamps", no_argument, 0, 'f'},
 	{ "degmins", no_argument, 0, 'p'},
 	{ "photooffset", required_argument, 0, 'O'},
+	{ "cache", required_argument, 0, 'c'},
+	{ "journal", required_argument, 0, 'j'},
+	{ "replace", no_argument, 0, 'R'},
+	{ "recursive", no_argument, 0, 'D'},
+	{ "files-from", required_argument, 0, 'F'},
+	{ "null", no_argument, 0, '0'},
+	{ "report", required_argument, 0, 'J'},
+	{ "stats", no_argument, 0, 'S'},
+	{ "trace", required_argument, 0, 'T'},
+	{ "watch", required_argument, 0, 'W'},
+	{ "threads", required_argument, 0, 'P'},
+	{ "read-threads", required_argument, 0, 'E'},
+	{ "match-threads", required_argument, 0, 'K'},
+	{ "write-threads", required_argument, 0, 'Y'},
+	{ "max-write-rate", required_argument, 0, 'L'},
 	{ 0, 0, 0, 0 }
 };
 
@@ -86,14 +114,163 @@ static void PrintUsage(const char* ProgramName)
 	puts(  _("-r, --remove             Strip GPS tags from the given files"));
 	puts(  _("-t, --ignore-tracksegs   Interpolate between track segments, too"));
 	puts(  _("-M, --no-mtime           Don't change mtime of modified files"));
+	puts(  _("    --replace            Replace GPS data already in the files"));
 	puts(  _("-f, --fix-datestamps     Fix broken GPS datestamps written with ver. < 1.5.2"));
 	puts(  _("    --degmins            Write location as DD MM.MM (was default before v1.5.3)"));
 	puts(  _("-O, --photooffset SECS   Offset added to photo time to make it match the GPS"));
+	puts(  _("    --cache FILE         Remember photo details in FILE to speed up later runs"));
+	puts(  _("    --journal FILE       Record progress in FILE, and skip files it lists as done"));
+	puts(  _("    --recursive          Look for photos in the directories given, and below"));
+	puts(  _("    --files-from FILE    Read the names of more files from FILE (- for stdin),\n"
+	         "                         one per line"));
+	puts(  _("-0, --null               Names read with --files-from end with NUL, not newline"));
+	puts(  _("    --report jsonl       Write a line of JSON about each file to standard output;\n"
+	         "                         other output goes to standard error"));
+	puts(  _("    --stats              Show where the time went at the end"));
+	puts(  _("    --trace FILE         Write a trace of the run to FILE, for chrome://tracing"));
+	puts(  _("    --watch DIR          Then correlate new photos as they arrive in DIR,\n"
+	         "                         and reread GPX files that change, until interrupted"));
+	puts(  _("    --threads N          Strip tags from up to N files at once with --remove\n"
+	         "                         (default: one for each CPU)"));
+	puts(  _("    --read-threads N     Read up to N photos at once (default: one for each CPU)"));
+	puts(  _("    --match-threads N    Match up to N photos at once (default: 1)"));
+	puts(  _("    --write-threads N    Write up to N photos at once; MIN-N writes as many as\n"
+	         "                         turn out quickest (default: 1 to one for each CPU)"));
+	puts(  _("    --max-write-rate MB  Write no more than MB megabytes a second"));
 	puts(  _("-h, --help               Display usage/help message"));
 	puts(  _("-v, --verbose            Show more detailed output"));
 	puts(  _("-V, --version            Display version information"));
 }
 
+/* Reads the number of threads given with Option, which must be at
+ * least 1. */
+static int ThreadCount(const char* Option, const char* Arg)
+{
+	int Threads = atoi(Arg);
+	if (Threads < 1)
+	{
+		printf(_("%s needs a number above 0.\n"), Option);
+		exit(EXIT_FAILURE);
+	}
+	return Threads;
+}
+
+/* Tally of the results of correlation, for the summary at the end. */
+struct ResultCounts {
+	int MatchExact;
+	int MatchInter;
+	int MatchRound;
+	int NotMatched;
+	int WriteFail;
+	int TooFar;
+	int NoDate;
+	int GPSPresent;
+	int Unchanged;
+};
+
+static void CountResult(struct ResultCounts* Counts, int Result)
+{
+	switch (Result)
+	{
+		case CORR_OK:            Counts->MatchExact++; break;
+		case CORR_INTERPOLATED:  Counts->MatchInter++; break;
+		case CORR_ROUND:         Counts->MatchRound++; break;
+		case CORR_NOMATCH:       Counts->NotMatched++; break;
+		case CORR_TOOFAR:        Counts->TooFar++;     break;
+		case CORR_EXIFWRITEFAIL: Counts->WriteFail++;  break;
+		case CORR_NOEXIFINPUT:   Counts->NoDate++;     break;
+		case CORR_GPSDATAEXISTS: Counts->GPSPresent++; break;
+		case CORR_UNCHANGED:     Counts->Unchanged++;  break;
+	}
+}
+
+/* Where the names of the files to work on come from: the command
+ * line, then the --files-from list, with any directories walked if
+ * --recursive was given. */
+struct FileList {
+	char** Args;
+	int NumArgs;
+	FILE* From;               /* --files-from list, if any. */
+	int Delimiter;            /* What ends each name in it. */
+	char* Line;
+	size_t LineSize;
+	int Recursive;
+	struct DirWalker* Walker; /* Directory being walked, if any. */
+};
+
+/* Reads the next name from the --files-from list. Names are read
+ * one at a time, so that the list can be any length. */
+static const char* ReadListedFile(struct FileList* List)
+{
+	ssize_t Length;
+
+	while (List->From &&
+	       (Length = getdelim(&List->Line, &List->LineSize, List->Delimiter, List->From)) > 0)
+	{
+		if (List->Line[Length - 1] == List->Delimiter)
+			List->Line[--Length] = '\0';
+		if (Length)
+			return List->Line;
+	}
+	return NULL;
+}
+
+/* Returns the next file to work on, or NULL when there are no more.
+ * The name is only valid until the next call. */
+static const char* NextFile(struct FileList* List)
+{
+	struct stat Info;
+	const char* File;
+
+	for (;;)
+	{
+		if (List->Walker)
+		{
+			File = NextWalkedFile(List->Walker);
+			if (File)
+				return File;
+			StopDirWalker(List->Walker);
+			List->Walker = NULL;
+		}
+
+		if (List->NumArgs)
+		{
+			File = *List->Args++;
+			List->NumArgs--;
+		} else if (!(File = ReadListedFile(List))) {
+			return NULL;
+		}
+
+		if (List->Recursive && stat(File, &Info) == 0 && S_ISDIR(Info.st_mode))
+		{
+			/* Carry on with what's in here, if anything. */
+			List->Walker = StartDirWalker(File, 0);
+			continue;
+		}
+		return File;
+	}
+}
+
+static void CloseFileList(struct FileList* List)
+{
+	StopDirWalker(List->Walker);
+	List->Walker = NULL;
+	if (List->From && List->From != stdin)
+		fclose(List->From);
+	List->From = NULL;
+	free(List->Line);
+	List->Line = NULL;
+}
+
+/* Set when we're asked to stop, so that the journal can be
+ * brought up to date before we go. */
+static volatile sig_atomic_t Interrupted = 0;
+
+static void Interrupt(int Signal)
+{
+	Interrupted = 1;
+}
+
 /* CSV escape a string by doubling quotation marks.
  * A pointer to a malloced string is returned which must be freed by the caller.
  */
@@ -112,12 +289,13 @@ static char *CsvEscape(const char *str)
 }
 
 /* Display the information from an existing file. */
-static int ShowFileDetails(const char* File, int MachineReadable)
+static int ShowFileDetails(const char* File, int MachineReadable,
+			   struct PhotoCache* Cache)
 {
 	double Lat, Long, Elev;
 	int IncludesGPS = 0;
 	Lat = Long = Elev = 0;
-	char* Time = ReadExifData(File, &Lat, &Long, &Elev, &IncludesGPS);
+	char* Time = ReadExifDataCached(Cache, File, &Lat, &Long, &Elev, &IncludesGPS);
 	int rc = 1;
 	char* OldLocale = NULL;
 
@@ -187,6 +365,60 @@ static int RemoveGPSTags(const char* File, int NoChangeMtime)
 	}
 }
 
+/* Stripping is mostly rewriting files, so several are done at once
+ * on a pool of threads. No more than this many names wait for a
+ * thread, however long the list of files. */
+#define STRIP_QUEUE 256
+
+struct StripRun {
+	int NoChangeMtime;
+	int Failed;       /* Set, atomically, if any file failed. */
+};
+
+/* Runs on one of the pool's threads. */
+static void StripWork(void* Job, void* Data)
+{
+	char* File = (char*) Job;
+	struct StripRun* Run = (struct StripRun*) Data;
+
+	if (!RemoveGPSTags(File, Run->NoChangeMtime))
+		__atomic_store_n(&Run->Failed, 1, __ATOMIC_RELAXED);
+	free(File);
+}
+
+/* Strips the GPS tags from every file, Threads at a time. Returns 1
+ * if they all worked. */
+static int RemoveAllGPSTags(struct FileList* Files, int NoChangeMtime,
+			    int Threads)
+{
+	struct StripRun Run;
+	Run.NoChangeMtime = NoChangeMtime;
+	Run.Failed = 0;
+
+	InitExif();
+	struct WorkPool* Pool = NULL;
+	if (Threads != 1)
+		Pool = StartWorkPool("strip", Threads, STRIP_QUEUE, StripWork, &Run);
+
+	const char* File;
+	while ((File = NextFile(Files)))
+	{
+		/* The name is only good until the next one. */
+		char* Copy = Pool ? strdup(File) : NULL;
+		if (Copy && AddWork(Pool, Copy))
+			continue;
+		free(Copy);
+
+		/* No threads; do it here and now. */
+		if (!RemoveGPSTags(File, NoChangeMtime))
+			Run.Failed = 1;
+	}
+
+	if (Pool)
+		FinishWorkPool(Pool);
+	return !Run.Failed;
+}
+
 /* Fix GPSDatestamp tags, if they were incorrect, as found with versions
  * earlier than 1.5.2. */
 static int FixDatestamp(const char* File, int AdjustmentHours, int AdjustmentMinutes, int NoWriteExif)
@@ -246,6 +478,158 @@ static int FixDatestamp(const char* File, int AdjustmentHours, int AdjustmentMin
 	return rc;
 }
 
+/* Where the results of correlation go. Photos may be finished on
+ * several threads at once, so they take turns. */
+struct ResultSink {
+	pthread_mutex_t Lock;
+	struct ResultCounts Counts;
+	struct Report* Report;
+	struct Journal* Journal;
+	int ShowDetails;
+};
+
+/* Was File done by an earlier run? Then just count it the way it
+ * was counted then, and return 1. */
+static int AlreadyDone(struct ResultSink* Sink, const char* File)
+{
+	int PreviousResult = JournalLookup(Sink->Journal, File);
+	if (!PreviousResult)
+		return 0;
+	pthread_mutex_lock(&Sink->Lock);
+	CountResult(&Sink->Counts, PreviousResult);
+	pthread_mutex_unlock(&Sink->Lock);
+	return 1;
+}
+
+/* Counts, records and shows the result of correlating one photo, and
+ * frees it. This is the pipeline's PipelineDone. */
+static void ShowResult(const char* File, struct GPSPoint* Result,
+		       struct CorrelateOptions* Options, void* Data)
+{
+	struct ResultSink* Sink = (struct ResultSink*) Data;
+	int ShowDetails = Sink->ShowDetails;
+
+	pthread_mutex_lock(&Sink->Lock);
+	CountResult(&Sink->Counts, Options->Result);
+	ReportResult(Sink->Report, File, Result, Options);
+	/* Write failures are worth another try next time. */
+	if (Options->Result != CORR_EXIFWRITEFAIL)
+		JournalRecord(Sink->Journal, File, Options->Result);
+
+	/* Was result NULL? */
+	if (Result)
+	{
+		/* Result not null. But what did happen? */
+		if (Options->Result == CORR_OK)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: Exact match: "), File);
+			} else {
+				printf(".");
+			}
+		}
+		if (Options->Result == CORR_INTERPOLATED)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: Interpolated: "), File);
+			} else {
+				printf("/");
+			}
+		}
+		if (Options->Result == CORR_ROUND)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: Rounded: "), File);
+			} else {
+				printf("<");
+			}
+		}
+		if (Options->Result == CORR_UNCHANGED)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: Unchanged: "), File);
+			} else {
+				printf("=");
+			}
+		}
+		if (Options->Result == CORR_EXIFWRITEFAIL)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: EXIF write failure: "), File);
+			} else {
+				printf("w");
+			}
+		}
+		if (ShowDetails)
+		{
+			/* Print out the "point". */
+			printf(_("Lat %f, Long %f, Elev %.3f.\n"),
+				Result->Lat, Result->Long,
+				Result->Elev);
+		}
+		free(Result);
+		/* Ok, that's all from this part... */
+	} else {
+		/* We got nothing back. One of a few errors. */
+		if (Options->Result == CORR_NOMATCH)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: No match.\n"), File);
+			} else {
+				printf("-");
+			}
+		}
+		if (Options->Result == CORR_TOOFAR)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: Too far from nearest point.\n"), File);
+			} else {
+				printf("^");
+			}
+		}
+		if (Options->Result == CORR_NOEXIFINPUT)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: No EXIF date tag present.\n"), File);
+			} else {
+				printf("?");
+			}
+		}
+		if (Options->Result == CORR_GPSDATAEXISTS)
+		{
+			if (ShowDetails)
+			{
+				printf(_("%s: GPS Data already present.\n"), File);
+			} else {
+				printf("!");
+			}
+		}
+		/* Handled all those errors, now... */
+	} /* End if Result. */
+	pthread_mutex_unlock(&Sink->Lock);
+}
+
+/* Correlates one photo here and now, counting, recording and showing
+ * the result. */
+static void CorrelateFile(const char* File, struct CorrelateOptions* Options,
+			  struct ResultSink* Sink)
+{
+	if (AlreadyDone(Sink, File))
+		return;
+
+	/* Pass the file along to Correlate and see what happens. */
+	struct GPSPoint* Result = CorrelatePhoto(File, Options);
+	ShowResult(File, Result, Options, Sink);
+}
+
 int main(int argc, char** argv)
 {
 	/* Initialize locale & gettext */
@@ -268,6 +652,8 @@ int main(int argc, char** argv)
 					 final entry of all 0 signals the end. */
 	int NumTracks = 0;	     /* Number of track structures at Track,
 					not including the terminating entry. */
+	struct GPSTrack* Matching = NULL; /* Those with points, to match
+					     against. */
 	int HaveTimeAdjustment = 0;  /* Whether -z option was given. */
 	int TimeZoneHours = 0;       /* Integer version of the timezone. */
 	int TimeZoneMins = 0;
@@ -283,8 +669,24 @@ int main(int argc, char** argv)
 	int NoChangeMtime = 0;
 	int FixDatestamps = 0;
 	int DegMinSecs = 1;
+	int ReplaceGPS = 0;
+	int Recursive = 0;
+	char* FilesFrom = NULL;      /* File with a list of more files. */
+	int NulSeparated = 0;
 	int PhotoOffset = 0;
 	int HaveTrack = 0;
+	char** GPXFiles = NULL;      /* GPX files to read, once all options are in. */
+	int NumGPXFiles = 0;
+	char* ReportFormat = NULL;   /* Per-file report format, if any. */
+	struct PhotoCache* Cache = NULL; /* Photo metadata cache, if any. */
+	char* JournalFile = NULL;    /* Progress journal, if any. */
+	char* WatchDir = NULL;       /* Directory to watch for new photos. */
+	int Threads = 0;             /* For --remove; 0 is one per CPU. */
+	int ReadThreads = 0;         /* Threads for each stage of correlation. */
+	int MatchThreads = 1;
+	int MinWriteThreads = 1;     /* Below WriteThreads, writers are tuned. */
+	int WriteThreads = 0;
+	double MaxWriteRate = 0;     /* MB/s; 0 for no limit. */
 
 	/* Create the empty terminating array entry */
 	Track = (struct GPSTrack*) calloc(1, sizeof(*Track));
@@ -298,7 +700,7 @@ int main(int argc, char** argv)
 	{
 		/* Call getopt to do all the hard work
 		 * for us... */
-		c = getopt_long(argc, argv, "g:z:ihvd:m:nsortMVfO:",
+		c = getopt_long(argc, argv, "g:z:ihvd:m:nsortMVfO:0",
 				program_options, 0);
 
 		if (c == -1) break;
@@ -311,25 +713,15 @@ int main(int argc, char** argv)
 				 * It must be present at least once. */
 				if (optarg)
 				{
-					/* Read the XML file into memory and extract the "points". */
-					printf(_("Reading GPS Data..."));
-					fflush(stdout);
-					HaveTrack = ReadGPX(optarg, &Track[NumTracks]);
-					printf("\n");
-					if (!HaveTrack)
-					{
-						exit(EXIT_FAILURE);
-					}
-
-					/* Make room for a new end-of-array entry */
-					++NumTracks;
-					Track = (struct GPSTrack*) realloc(Track, sizeof(*Track)*(NumTracks+1));
-					if (!Track)
+					/* Remember it; it's read once we know
+					 * it's needed. */
+					GPXFiles = (char**) realloc(GPXFiles, sizeof(*GPXFiles)*(NumGPXFiles+1));
+					if (!GPXFiles)
 					{
 						printf(_("Out of memory\n"));
 						exit(EXIT_FAILURE);
 					}
-					memset(&Track[NumTracks], 0, sizeof(*Track));
+					GPXFiles[NumGPXFiles++] = optarg;
 				}
 				break;
 			case 'z':
@@ -356,6 +748,17 @@ int main(int argc, char** argv)
 			case 'O':
 				PhotoOffset = atoi(optarg);
 				break;
+			case 'j':
+				/* Record progress in a journal file. */
+				free(JournalFile);
+				JournalFile = strdup(optarg);
+				break;
+			case 'c':
+				/* Keep photo details in a cache file.
+				 * Carry on without one if it can't be used. */
+				ClosePhotoCache(Cache);
+				Cache = OpenPhotoCache(optarg);
+				break;
 			case 'i':
 				/* This option disables interpolation. */
 				Interpolate = 0;
@@ -414,6 +817,81 @@ int main(int argc, char** argv)
 			case 'M':
 				NoChangeMtime = 1;
 				break;
+			case 'R':
+				/* Overwrite existing GPS tags rather than skipping. */
+				ReplaceGPS = 1;
+				break;
+			case 'D':
+				/* Walk through any directories given. */
+				Recursive = 1;
+				break;
+			case 'F':
+				/* Read more file names from a file. */
+				free(FilesFrom);
+				FilesFrom = strdup(optarg);
+				break;
+			case '0':
+				NulSeparated = 1;
+				break;
+			case 'J':
+				/* Report on each file in a machine readable format. */
+				ReportFormat = optarg;
+				break;
+			case 'S':
+				/* Count how long everything takes. */
+				EnableStats();
+				break;
+			case 'T':
+				/* Record what happened when. Only the once:
+				 * the trace is kept until the program exits. */
+				if (TraceEnabled())
+				{
+					printf(_("--trace can only be given once.\n"));
+					exit(EXIT_FAILURE);
+				}
+				if (!StartTrace(optarg))
+				{
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'W':
+				/* Keep correlating photos as they arrive. */
+				WatchDir = optarg;
+				break;
+			case 'P':
+				/* How many files to strip at once. */
+				Threads = ThreadCount("--threads", optarg);
+				break;
+			case 'E':
+				ReadThreads = ThreadCount("--read-threads", optarg);
+				break;
+			case 'K':
+				MatchThreads = ThreadCount("--match-threads", optarg);
+				break;
+			case 'Y':
+				/* Either a fixed number, or a range to pick from. */
+				if (strchr(optarg, '-'))
+				{
+					MinWriteThreads = ThreadCount("--write-threads", optarg);
+					WriteThreads = ThreadCount("--write-threads", strchr(optarg, '-') + 1);
+					if (MinWriteThreads > WriteThreads)
+					{
+						printf(_("--write-threads needs the smaller number first.\n"));
+						exit(EXIT_FAILURE);
+					}
+				} else {
+					WriteThreads = ThreadCount("--write-threads", optarg);
+					MinWriteThreads = WriteThreads;
+				}
+				break;
+			case 'L':
+				MaxWriteRate = atof(optarg);
+				if (MaxWriteRate <= 0)
+				{
+					printf(_("--max-write-rate needs a number above 0.\n"));
+					exit(EXIT_FAILURE);
+				}
+				break;
 			case 'p':
 				/* Write in old DegMins format. */
 				DegMinSecs = 0;
@@ -433,7 +911,7 @@ int main(int argc, char** argv)
 	
 	/* Check to see if the user passed some files to work with. Not much
 	 * good if they didn't. */
-	if (optind < argc)
+	if (optind < argc || FilesFrom || WatchDir)
 	{
 		/* You passed some files. Handy! */
 	} else {
@@ -442,25 +920,45 @@ int main(int argc, char** argv)
 		exit(EXIT_FAILURE);
 	}
 
+	struct FileList Files;
+	memset(&Files, 0, sizeof(Files));
+	Files.Args = argv + optind;
+	Files.NumArgs = argc - optind;
+	Files.Recursive = Recursive;
+	Files.Delimiter = NulSeparated ? '\0' : '\n';
+	if (FilesFrom)
+	{
+		if (strcmp(FilesFrom, "-") == 0)
+		{
+			Files.From = stdin;
+		} else {
+			Files.From = fopen(FilesFrom, "r");
+			if (!Files.From)
+			{
+				fprintf(stderr, _("Unable to open file list %s.\n"), FilesFrom);
+				exit(EXIT_FAILURE);
+			}
+		}
+		free(FilesFrom);
+	}
+	const char* File;
+
 	/* If we only wanted to display info on the passed photos, do so now. */
 	if (ShowOnlyDetails)
 	{
 		int result = 1;
-		while (optind < argc)
+		while ((File = NextFile(&Files)))
 		{
-			result = ShowFileDetails(argv[optind++], MachineReadable) && result;
+			result = ShowFileDetails(File, MachineReadable, Cache) && result;
 		}
+		ClosePhotoCache(Cache);
 		exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
 	}
 
 	/* If we wanted to delete tags, do this now. */
 	if (RemoveTags)
 	{
-		int result = 1;
-		while (optind < argc)
-		{
-			result = RemoveGPSTags(argv[optind++], NoChangeMtime) && result;
-		}
+		int result = RemoveAllGPSTags(&Files, NoChangeMtime, Threads);
 		exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
 	}
 
@@ -476,19 +974,75 @@ int main(int argc, char** argv)
 		}
 		
 		int result = 1;
-		while (optind < argc)
+		while ((File = NextFile(&Files)))
 		{
-			result = FixDatestamp(argv[optind++], TimeZoneHours, TimeZoneMins, NoWriteExif) && result;
+			result = FixDatestamp(File, TimeZoneHours, TimeZoneMins, NoWriteExif) && result;
 		}
 		exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
 	}
 
+	/* The time zone would be taken from the first photo, and which
+	 * is first in a directory tree is down to the walk's threads. */
+	if (Recursive && !HaveTimeAdjustment)
+	{
+		printf(_("You must give a time adjustment for the photos with -z to use --recursive.\n"));
+		exit(EXIT_FAILURE);
+	}
+
 	/* Set up any other command line options... */
 	if (!Datum)
 	{
 		Datum = strdup("WGS-84");
 	}
 
+	/* The report gets standard output to itself. Everything else
+	 * that would have gone there goes to standard error instead. */
+	struct Report* Report = NULL;
+	if (ReportFormat)
+	{
+		FILE* ReportOut = NULL;
+		int ReportFd;
+
+		fflush(stdout);
+		ReportFd = dup(fileno(stdout));
+		if (ReportFd >= 0)
+			ReportOut = fdopen(ReportFd, "w");
+		if (!ReportOut || !(Report = OpenReport(ReportFormat, ReportOut)))
+		{
+			exit(EXIT_FAILURE);
+		}
+		dup2(fileno(stderr), fileno(stdout));
+	}
+
+	/* Read the XML files into memory and extract the "points". */
+	int GPXNum;
+	for (GPXNum = 0; GPXNum < NumGPXFiles; GPXNum++)
+	{
+		printf(_("Reading GPS Data..."));
+		fflush(stdout);
+		/* A log still being written is fine if we'll be
+		 * following it. */
+		if (WatchDir)
+			HaveTrack = UpdateGPX(GPXFiles[GPXNum], &Track[NumTracks]);
+		else
+			HaveTrack = ReadGPX(GPXFiles[GPXNum], &Track[NumTracks]);
+		printf("\n");
+		if (!HaveTrack)
+		{
+			exit(EXIT_FAILURE);
+		}
+
+		/* Make room for a new end-of-array entry */
+		++NumTracks;
+		Track = (struct GPSTrack*) realloc(Track, sizeof(*Track)*(NumTracks+1));
+		if (!Track)
+		{
+			printf(_("Out of memory\n"));
+			exit(EXIT_FAILURE);
+		}
+		memset(&Track[NumTracks], 0, sizeof(*Track));
+	}
+
 	if (!HaveTrack)
 	{
 		/* GPS Data was not read correctly... */
@@ -498,13 +1052,21 @@ int main(int argc, char** argv)
 		printf(_("Cannot continue since no GPS data is available.\n"));
 		exit(EXIT_FAILURE);
 	}
+	Matching = (struct GPSTrack*) calloc(NumTracks + 1, sizeof(*Matching));
+	if (!Matching)
+	{
+		printf(_("Out of memory\n"));
+		exit(EXIT_FAILURE);
+	}
+	GatherTracks(Track, NumTracks, Matching);
 
 	/* Print a legend for the matching process.
 	 * If we're not being verbose. Otherwise, this would be pointless. */
 	if (!ShowDetails)
 	{
 		printf(_("Legend: . = Ok, / = Interpolated, < = Rounded, - = No match, ^ = Too far.\n"
-			 "        w = Write Fail, ? = No EXIF date, ! = GPS already present.\n"));
+			 "        w = Write Fail, ? = No EXIF date, ! = GPS already present,\n"
+			 "        = = Unchanged.\n"));
 	}
 
 	/* Set up our options structure for the correlation function. */
@@ -519,9 +1081,48 @@ int main(int argc, char** argv)
 	Options.DoBetweenTrkSeg = DoBetweenTrackSegs;
 	Options.NoChangeMtime = NoChangeMtime;
 	Options.DegMinSecs    = DegMinSecs;
+	Options.ReplaceGPS    = ReplaceGPS;
 	Options.PhotoOffset   = PhotoOffset;
 
-	Options.Track         = Track;
+	Options.Track         = Matching;
+	Options.Cache         = Cache;
+
+	/* Pick up where an earlier run left off, if asked. */
+	struct Journal* Journal = NULL;
+	if (JournalFile)
+	{
+		Journal = OpenJournal(JournalFile);
+		if (!Journal)
+		{
+			exit(EXIT_FAILURE);
+		}
+		if (JournalPreviousCount(Journal))
+		{
+			printf(_("Resuming: %d files already done.\n"),
+			       JournalPreviousCount(Journal));
+		}
+
+		/* Stop cleanly between files if interrupted, so
+		 * that the journal is complete. */
+		signal(SIGINT, Interrupt);
+		signal(SIGTERM, Interrupt);
+	}
+
+	/* Start watching before the files given are done, so that
+	 * nothing arriving meanwhile is missed. */
+	struct Watcher* Watcher = NULL;
+	if (WatchDir)
+	{
+		Watcher = StartWatcher(WatchDir, GPXFiles, NumGPXFiles);
+		if (!Watcher)
+		{
+			exit(EXIT_FAILURE);
+		}
+
+		/* Being interrupted is how watching ends. */
+		signal(SIGINT, Interrupt);
+		signal(SIGTERM, Interrupt);
+	}
 
 	if (!ShowDetails)
 	{
@@ -533,132 +1134,69 @@ int main(int argc, char** argv)
 	printf(_("\nCorrelate: "));
 	if (ShowDetails) printf("\n");
 	
-	/* A few variables that we'll require later. */
-	struct GPSPoint* Result;
-	char* File;
-	/* Including stats on what happened. */
-	int MatchExact = 0;
-	int MatchInter = 0;
-	int MatchRound = 0;
-	int NotMatched = 0;
-	int WriteFail  = 0;
-	int TooFar     = 0;
-	int NoDate     = 0;
-	int GPSPresent = 0;
-
-	/* Now it is time to correlate the photos. Feed one in at a time, and
-	 * see what happens.*/
+	/* Stats on what happened. */
+	struct ResultSink Sink;
+	memset(&Sink, 0, sizeof(Sink));
+	pthread_mutex_init(&Sink.Lock, NULL);
+	Sink.Report = Report;
+	Sink.Journal = Journal;
+	Sink.ShowDetails = ShowDetails;
+	struct ResultCounts* Counts = &Sink.Counts;
+
+	/* Now it is time to correlate the photos. Feed them into the
+	 * pipeline, and see what happens. */
 	/* We already checked to make sure that files were passed on the
 	 * command line, so just go for it... */
 	/* printf("Remaining non-option arguments: %d.\n", argc - optind); */
-	while (optind < argc)
+	struct Pipeline* Pipeline = StartPipeline(&Options, ReadThreads,
+			MatchThreads, MinWriteThreads, WriteThreads, MaxWriteRate,
+			ShowResult, &Sink);
+	while (!Interrupted && (File = NextFile(&Files)))
+	{
+		if (AlreadyDone(&Sink, File))
+			continue;
+		/* No threads; do it here and now. */
+		if (!Pipeline || !PipelinePhoto(Pipeline, File))
+			CorrelateFile(File, &Options, &Sink);
+	} /* End while parse command line files. */
+	if (Pipeline)
 	{
-		File = argv[optind++];
-		/* Pass the file along to Correlate and see what happens. */
-		Result = CorrelatePhoto(File, &Options);
+		/* Stop between files if interrupted, as without it. */
+		if (Interrupted)
+			CancelPipeline(Pipeline);
+		FinishPipeline(Pipeline, &Options);
+	}
+
+	/* Then do photos as they arrive, if asked, and keep the tracks
+	 * up to date as they grow. */
+	if (Watcher && !Interrupted)
+	{
+		int Event;
+		int Changed;
 
-		/* Was result NULL? */
-		if (Result)
+		if (ShowDetails)
+			printf(_("Watching %s for new photos.\n"), WatchDir);
+		while (!Interrupted &&
+		       (Event = NextWatchEvent(Watcher, &File, &Changed)) != WATCH_FAILED)
 		{
-			/* Result not null. But what did happen? */
-			if (Options.Result == CORR_OK)
-			{
-				MatchExact++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Exact match: "), File);
-				} else {
-					printf(".");
-				}
-			}
-			if (Options.Result == CORR_INTERPOLATED)
-			{
-				MatchInter++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Interpolated: "), File);
-				} else {
-					printf("/");
-				}
-			}
-			if (Options.Result == CORR_ROUND)
-			{
-				MatchRound++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Rounded: "), File);
-				} else {
-					printf("<");
-				}
-			}
-			if (Options.Result == CORR_EXIFWRITEFAIL)
-			{
-				WriteFail++;
-				if (ShowDetails)
-				{
-					printf(_("%s: EXIF write failure: "), File);
-				} else {
-					printf("w");
-				}
-			}
-			if (ShowDetails)
-			{
-				/* Print out the "point". */
-				printf(_("Lat %f, Long %f, Elev %.3f.\n"),
-					Result->Lat, Result->Long,
-					Result->Elev);
-			}
-			free(Result);
-			/* Ok, that's all from this part... */
-		} else {
-			/* We got nothing back. One of a few errors. */
-			if (Options.Result == CORR_NOMATCH)
-			{
-				NotMatched++;
-				if (ShowDetails)
-				{
-					printf(_("%s: No match.\n"), File);
-				} else {
-					printf("-");
-				}
-			}
-			if (Options.Result == CORR_TOOFAR)
-			{
-				TooFar++;
-				if (ShowDetails)
-				{
-					printf(_("%s: Too far from nearest point.\n"), File);
-				} else {
-					printf("^");
-				}
-			}
-			if (Options.Result == CORR_NOEXIFINPUT)
+			if (Event == WATCH_PHOTO)
 			{
-				NoDate++;
-				if (ShowDetails)
-				{
-					printf(_("%s: No EXIF date tag present.\n"), File);
-				} else {
-					printf("?");
-				}
+				CorrelateFile(File, &Options, &Sink);
+				/* Don't come back to it just because we wrote it. */
+				WatchIgnore(Watcher, File);
 			}
-			if (Options.Result == CORR_GPSDATAEXISTS)
+			if (Event == WATCH_TRACK)
 			{
-				GPSPresent++;
-				if (ShowDetails)
-				{
-					printf(_("%s: GPS Data already present.\n"), File);
-				} else {
-					printf("!");
-				}
+				/* Usually just points added on the end. The
+				 * old track is kept if the file won't read. */
+				printf(_("\nReading GPS Data..."));
+				UpdateGPX(GPXFiles[Changed], &Track[Changed]);
+				GatherTracks(Track, NumTracks, Matching);
+				printf("\n");
 			}
-			/* Handled all those errors, now... */
-		} /* End if Result. */
-
-		/* And, once we've got here, we've finished with that file.
-		 * We can now do the next one. Now wasn't that too easy? */
-		
-	} /* End while parse command line files. */
+		}
+		StopWatcher(Watcher);
+	}
 	
 	/* Right, so now we're done. That really wasn't that hard. Right? */
 
@@ -669,6 +1207,11 @@ int main(int argc, char** argv)
 		setvbuf(stdout, NULL, _IOLBF, 0);
 	}
 
+	if (Interrupted && Journal)
+	{
+		printf(_("\nInterrupted. Run again with the same journal to continue.\n"));
+	}
+
 	/* Print details of what happened. */
 	printf(_("\nCompleted correlation process.\n"));
 	if (ShowDetails)
@@ -677,14 +1220,18 @@ int main(int argc, char** argv)
 		 * is processed. */
 		printf(_("Used time zone offset %d:%02d\n"),
 		       Options.TimeZoneHours, abs(Options.TimeZoneMins));
-	printf(_("Matched: %5d (%d Exact, %d Interpolated, %d Rounded).\n"),
-			MatchExact + MatchInter + MatchRound,
-			MatchExact, MatchInter, MatchRound);
+	printf(_("Matched: %5d (%d Exact, %d Interpolated, %d Rounded, %d Unchanged).\n"),
+			Counts->MatchExact + Counts->MatchInter + Counts->MatchRound +
+			Counts->Unchanged,
+			Counts->MatchExact, Counts->MatchInter, Counts->MatchRound,
+			Counts->Unchanged);
 	printf(_("Failed:  %5d (%d Not matched, %d Write failure, %d Too Far,\n"),
-			NotMatched + WriteFail + TooFar + NoDate + GPSPresent,
-			NotMatched, WriteFail, TooFar);
+			Counts->NotMatched + Counts->WriteFail + Counts->TooFar +
+			Counts->NoDate + Counts->GPSPresent,
+			Counts->NotMatched, Counts->WriteFail, Counts->TooFar);
 	printf(_("                %d No Date, %d GPS Already Present.)\n"),
-			NoDate, GPSPresent);
+			Counts->NoDate, Counts->GPSPresent);
+	PrintStats(stdout);
 
 
 	/* Clean up! */
@@ -694,15 +1241,24 @@ int main(int argc, char** argv)
 		FreeTrack(&Track[NumTracks]);
 	}
 	free(Track);
+	free(Matching);
+	free(GPXFiles);
 	free(Datum);
+	CloseFileList(&Files);
+	CloseReport(Report);
+	ClosePhotoCache(Cache);
+	CloseJournal(Journal);
+	free(JournalFile);
+	pthread_mutex_destroy(&Sink.Lock);
 	
-	if (WriteFail)
+	if (Counts->WriteFail || (Interrupted && !WatchDir))
 		/* A write failure is considered serious */
 		return EXIT_FAILURE;
 
 	/* Other failures aren't necessarily bad, depending on the input,
 	 * so provide a different return code to distinguish them.
 	 */
-	return(NotMatched + TooFar + NoDate + GPSPresent ? GPS_EXIT_WARNING : EXIT_SUCCESS);
+	return(Counts->NotMatched + Counts->TooFar + Counts->NoDate + Counts->GPSPresent ?
+	       GPS_EXIT_WARNING : EXIT_SUCCESS);
 }
 
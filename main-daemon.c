@@ -0,0 +1,678 @@
+/* main-daemon.c
+ *
+ * gpscorrelated: a server that keeps GPS tracks in memory and
+ * correlates photos for clients that connect to a Unix socket. Each
+ * batch of photos then costs only the photos themselves, rather than
+ * starting a program and reading all the tracks again.
+ *
+ * Clients send jobs as lines of text. Each line is a request name,
+ * and for some, a space and a value:
+ *
+ *   file PATH          a photo to correlate (as many as wanted)
+ *   timeadd +HH[:MM]   as for gpscorrelate, and so are these:
+ *   photooffset SECS
+ *   max-dist SECS
+ *   datum DATUM
+ *   no-interpolation
+ *   ignore-tracksegs
+ *   no-write
+ *   no-mtime
+ *   replace
+ *   degmins
+ *
+ * An empty line (or the end of the connection) runs the job. Back
+ * comes a line of JSON per photo, as from gpscorrelate --report jsonl,
+ * then {"done":N,"matched":N,"failed":N}. A job that can't be run gets
+ * {"error":"..."} instead. Any number of jobs can be sent on one
+ * connection. Each connection is served on its own thread, and one
+ * that sends nothing for a while is dropped, so a client that stalls
+ * holds up nobody else.
+ *
+ * The tracks are brought up to date whenever one of the GPX files has
+ * changed since it was last read, before the next job is run. For a
+ * log still being written, only the points added are read. Jobs read
+ * the tracks under a shared lock, and updating them takes it
+ * exclusively.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <getopt.h>
+#include <locale.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "i18n.h"
+#include "gpsstructure.h"
+#include "gpx-read.h"
+#include "photo-cache.h"
+#include "report.h"
+#include "correlate.h"
+
+static const struct option program_options[] = {
+	{ "gps", required_argument, 0, 'g' },
+	{ "socket", required_argument, 0, 'l' },
+	{ "cache", required_argument, 0, 'c' },
+	{ "help", no_argument, 0, 'h' },
+	{ "version", no_argument, 0, 'V' },
+	{ 0, 0, 0, 0 }
+};
+
+/* A client that sends nothing, or reads nothing, for this long is
+ * dropped. */
+#define CLIENT_TIMEOUT 60
+
+/* The GPX files being served, and the tracks read from them. */
+struct TrackSet {
+	pthread_rwlock_t Lock;    /* Over Seen, Tracks and Matching. */
+	char** Files;
+	int NumFiles;
+	struct stat* Seen;        /* Each file as it was when last read. */
+	struct GPSTrack* Tracks;  /* One per file. */
+	struct GPSTrack* Matching; /* Those with points, then one of all
+				      zeros, for CorrelateOptions. */
+};
+
+/* A connection being served, on its own thread. */
+struct Client {
+	int Fd;
+	struct TrackSet* Set;
+	struct PhotoCache* Cache;
+	struct Client* Next;
+};
+
+/* Every connection being served, so that they can be told to stop. */
+static pthread_mutex_t ClientsLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ClientGone = PTHREAD_COND_INITIALIZER;
+static struct Client* Clients;
+
+/* One job from a client. */
+struct Job {
+	struct CorrelateOptions Options;
+	char** Files;
+	int NumFiles;
+	const char* Error;
+	int ErrorLine;
+};
+
+static volatile sig_atomic_t Interrupted = 0;
+
+static void Interrupt(int Signal)
+{
+	__atomic_store_n(&Interrupted, 1, __ATOMIC_RELAXED);
+}
+
+/* The client threads look too. */
+static int Stopping(void)
+{
+	return __atomic_load_n(&Interrupted, __ATOMIC_RELAXED);
+}
+
+static void PrintVersion(const char* ProgramName)
+{
+	printf(_("%s, ver. %s. Daniel Foote, et. al. 2005-2012. GNU GPL.\n"), ProgramName, PACKAGE_VERSION);
+}
+
+static void PrintUsage(const char* ProgramName)
+{
+	printf(_("Usage: %s [options] -g file.gpx ...\n"), ProgramName);
+	puts(  _("-g, --gps file.gpx       Specifies GPX file with GPS data"));
+	puts(  _("-l, --socket PATH        Listen on the Unix socket PATH"));
+	puts(  _("-c, --cache FILE         Remember photo details in FILE between runs"));
+	puts(  _("-h, --help               Display usage/help message"));
+	puts(  _("-V, --version            Display version information"));
+}
+
+static void FreeTracks(struct GPSTrack* Tracks, int Count)
+{
+	int i;
+	if (!Tracks)
+		return;
+	for (i = 0; i < Count; i++)
+		FreeTrack(&Tracks[i]);
+	free(Tracks);
+}
+
+/* Reads all the GPX files. If any can't be read, the tracks already
+ * loaded (if any) are kept, and 0 is returned. */
+static int LoadTracks(struct TrackSet* Set)
+{
+	struct GPSTrack* Tracks = (struct GPSTrack*)
+		calloc(Set->NumFiles, sizeof(*Tracks));
+	struct GPSTrack* Matching = (struct GPSTrack*)
+		calloc(Set->NumFiles + 1, sizeof(*Matching));
+	struct stat* Seen = (struct stat*) calloc(Set->NumFiles, sizeof(*Seen));
+	int i;
+
+	if (!Tracks || !Matching || !Seen)
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		free(Tracks);
+		free(Matching);
+		free(Seen);
+		return 0;
+	}
+
+	for (i = 0; i < Set->NumFiles; i++)
+	{
+		/* Note the file as it was before reading it, so that a
+		 * change made while reading it is seen next time. */
+		if (stat(Set->Files[i], &Seen[i]) != 0 ||
+		    !UpdateGPX(Set->Files[i], &Tracks[i]) ||
+		    !Tracks[i].Points)
+		{
+			fprintf(stderr, _("Unable to read GPS data from %s.\n"),
+				Set->Files[i]);
+			FreeTracks(Tracks, Set->NumFiles);
+			free(Matching);
+			free(Seen);
+			return 0;
+		}
+	}
+
+	FreeTracks(Set->Tracks, Set->NumFiles);
+	free(Set->Matching);
+	free(Set->Seen);
+	Set->Tracks = Tracks;
+	Set->Matching = Matching;
+	Set->Seen = Seen;
+	GatherTracks(Set->Tracks, Set->NumFiles, Set->Matching);
+	fprintf(stderr, _("Read %d GPX files.\n"), Set->NumFiles);
+	return 1;
+}
+
+/* Has File changed since it was read as Seen? */
+static int TrackChanged(const char* File, const struct stat* Seen, struct stat* Now)
+{
+	if (stat(File, Now) != 0)
+		return 0;
+	return Now->st_mtime != Seen->st_mtime ||
+	       Now->st_size != Seen->st_size ||
+	       Now->st_ino != Seen->st_ino;
+}
+
+/* Brings the tracks from any GPX files that have changed since they
+ * were read up to date. For a log being written, that's just reading
+ * the points added to it. A file that can't be read keeps its track.
+ * Called with the lock held exclusively. */
+static void UpdateTracks(struct TrackSet* Set)
+{
+	struct stat Now;
+	int i;
+
+	for (i = 0; i < Set->NumFiles; i++)
+	{
+		if (TrackChanged(Set->Files[i], &Set->Seen[i], &Now) &&
+		    UpdateGPX(Set->Files[i], &Set->Tracks[i]))
+			Set->Seen[i] = Now;
+	}
+	/* A file written again from the start may have no points yet. */
+	GatherTracks(Set->Tracks, Set->NumFiles, Set->Matching);
+}
+
+/* Takes the lock for reading the tracks, having brought them up to
+ * date first if need be. */
+static void LockTracks(struct TrackSet* Set)
+{
+	struct stat Now;
+	int i;
+
+	pthread_rwlock_rdlock(&Set->Lock);
+	for (i = 0; i < Set->NumFiles; i++)
+	{
+		if (TrackChanged(Set->Files[i], &Set->Seen[i], &Now))
+			break;
+	}
+	if (i == Set->NumFiles)
+		return;
+
+	/* Another job may get in between, and update them first;
+	 * UpdateTracks then finds nothing to do. */
+	pthread_rwlock_unlock(&Set->Lock);
+	pthread_rwlock_wrlock(&Set->Lock);
+	UpdateTracks(Set);
+	pthread_rwlock_unlock(&Set->Lock);
+	pthread_rwlock_rdlock(&Set->Lock);
+}
+
+static void StartJob(struct Job* Job)
+{
+	memset(Job, 0, sizeof(*Job));
+	Job->Options.AutoTimeZone = 1;
+	Job->Options.DegMinSecs = 1;
+}
+
+static void EndJob(struct Job* Job)
+{
+	int i;
+	for (i = 0; i < Job->NumFiles; i++)
+		free(Job->Files[i]);
+	free(Job->Files);
+	free(Job->Options.Datum);
+}
+
+/* Adds one request line to the job. */
+static void ReadRequest(struct Job* Job, char* Line, int LineNum)
+{
+	struct CorrelateOptions* Options = &Job->Options;
+	char* Value = strchr(Line, ' ');
+
+	if (Value)
+		*Value++ = '\0';
+	if (Job->Error)
+		return;
+
+	if (strcmp(Line, "file") == 0 && Value && *Value)
+	{
+		char** Files = (char**) realloc(Job->Files,
+			(Job->NumFiles + 1) * sizeof(*Files));
+		if (!Files || !(Value = strdup(Value)))
+		{
+			Job->Error = "out of memory";
+			Job->ErrorLine = LineNum;
+			return;
+		}
+		Job->Files = Files;
+		Job->Files[Job->NumFiles++] = Value;
+	} else if (strcmp(Line, "timeadd") == 0 && Value) {
+		/* The same as gpscorrelate -z. */
+		Options->TimeZoneHours = Options->TimeZoneMins = 0;
+		if (strstr(Value, ":"))
+		{
+			sscanf(Value, "%d:%d", &Options->TimeZoneHours, &Options->TimeZoneMins);
+			if (Options->TimeZoneHours < 0)
+				Options->TimeZoneMins *= -1;
+		} else {
+			Options->TimeZoneHours = atoi(Value);
+		}
+		Options->AutoTimeZone = 0;
+	} else if (strcmp(Line, "photooffset") == 0 && Value) {
+		Options->PhotoOffset = atoi(Value);
+	} else if (strcmp(Line, "max-dist") == 0 && Value) {
+		Options->FeatherTime = atoi(Value);
+	} else if (strcmp(Line, "datum") == 0 && Value) {
+		free(Options->Datum);
+		Options->Datum = strdup(Value);
+	} else if (strcmp(Line, "no-interpolation") == 0) {
+		Options->NoInterpolate = 1;
+	} else if (strcmp(Line, "ignore-tracksegs") == 0) {
+		Options->DoBetweenTrkSeg = 1;
+	} else if (strcmp(Line, "no-write") == 0) {
+		Options->NoWriteExif = 1;
+	} else if (strcmp(Line, "no-mtime") == 0) {
+		Options->NoChangeMtime = 1;
+	} else if (strcmp(Line, "replace") == 0) {
+		Options->ReplaceGPS = 1;
+	} else if (strcmp(Line, "degmins") == 0) {
+		Options->DegMinSecs = 0;
+	} else {
+		Job->Error = "unknown request";
+		Job->ErrorLine = LineNum;
+	}
+}
+
+/* Correlates the photos in a job, and sends back what happened. */
+static void RunJob(struct Job* Job, struct TrackSet* Set,
+		   struct PhotoCache* Cache, struct Report* Report, FILE* Out)
+{
+	struct CorrelateOptions* Options = &Job->Options;
+	int Matched = 0;
+	int i;
+
+	LockTracks(Set);
+	if (!Set->Tracks)
+	{
+		pthread_rwlock_unlock(&Set->Lock);
+		fprintf(Out, "{\"error\":\"no GPS data\"}\n");
+		return;
+	}
+
+	if (!Options->Datum)
+		Options->Datum = strdup("WGS-84");
+	Options->Track = Set->Matching;
+	Options->Cache = Cache;
+
+	for (i = 0; i < Job->NumFiles; i++)
+	{
+		struct GPSPoint* Point = CorrelatePhoto(Job->Files[i], Options);
+		ReportResult(Report, Job->Files[i], Point, Options);
+		switch (Options->Result)
+		{
+			case CORR_OK:
+			case CORR_INTERPOLATED:
+			case CORR_ROUND:
+			case CORR_UNCHANGED:
+				Matched++;
+				break;
+		}
+		free(Point);
+	}
+	pthread_rwlock_unlock(&Set->Lock);
+	fprintf(Out, "{\"done\":%d,\"matched\":%d,\"failed\":%d}\n",
+		Job->NumFiles, Matched, Job->NumFiles - Matched);
+}
+
+/* Serves the client on Fd until it goes away. Fd is left open. */
+static void ServeClient(int Fd, struct TrackSet* Set, struct PhotoCache* Cache)
+{
+	int InFd = dup(Fd);
+	FILE* In = InFd >= 0 ? fdopen(InFd, "r") : NULL;
+	int OutFd = dup(Fd);
+	FILE* Out = OutFd >= 0 ? fdopen(OutFd, "w") : NULL;
+	struct Report* Report = Out ? OpenReport("jsonl", Out) : NULL;
+	char* Line = NULL;
+	size_t LineSize = 0;
+	ssize_t Length = 0;
+
+	if (!In || !Report)
+	{
+		if (In)
+			fclose(In);
+		else if (InFd >= 0)
+			close(InFd);
+		if (Out)
+			fclose(Out);
+		else if (OutFd >= 0)
+			close(OutFd);
+		return;
+	}
+
+	while (!Stopping() && Length >= 0)
+	{
+		struct Job Job;
+		int LineNum = 0;
+
+		StartJob(&Job);
+		while ((Length = getline(&Line, &LineSize, In)) >= 0)
+		{
+			while (Length && (Line[Length - 1] == '\n' || Line[Length - 1] == '\r'))
+				Line[--Length] = '\0';
+			if (!Length)
+				break;
+			ReadRequest(&Job, Line, ++LineNum);
+		}
+
+		/* A job cut short by the client going quiet, or by us
+		 * stopping, isn't run. */
+		if (ferror(In) || Stopping())
+		{
+			EndJob(&Job);
+			break;
+		}
+		if (Job.Error)
+			fprintf(Out, "{\"error\":\"%s\",\"line\":%d}\n",
+				Job.Error, Job.ErrorLine);
+		else if (LineNum)
+			RunJob(&Job, Set, Cache, Report, Out);
+		fflush(Out);
+		EndJob(&Job);
+	}
+
+	free(Line);
+	fclose(In);
+	CloseReport(Report);
+}
+
+static void* ClientThread(void* Data)
+{
+	struct Client* Client = (struct Client*) Data;
+	struct Client** Link;
+
+	ServeClient(Client->Fd, Client->Set, Client->Cache);
+
+	pthread_mutex_lock(&ClientsLock);
+	for (Link = &Clients; *Link != Client; Link = &(*Link)->Next)
+		;
+	*Link = Client->Next;
+	pthread_cond_signal(&ClientGone);
+	pthread_mutex_unlock(&ClientsLock);
+
+	close(Client->Fd);
+	free(Client);
+	return NULL;
+}
+
+/* Starts serving the client on Fd on a thread of its own. */
+static void StartClient(int Fd, struct TrackSet* Set, struct PhotoCache* Cache)
+{
+	struct Client* Client = (struct Client*) calloc(1, sizeof(*Client));
+	struct timeval Timeout;
+	pthread_attr_t Attr;
+	pthread_t Thread;
+	sigset_t Signals, OldSignals;
+
+	if (!Client)
+	{
+		close(Fd);
+		return;
+	}
+	Client->Fd = Fd;
+	Client->Set = Set;
+	Client->Cache = Cache;
+
+	Timeout.tv_sec = CLIENT_TIMEOUT;
+	Timeout.tv_usec = 0;
+	setsockopt(Fd, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+	setsockopt(Fd, SOL_SOCKET, SO_SNDTIMEO, &Timeout, sizeof(Timeout));
+
+	pthread_mutex_lock(&ClientsLock);
+	Client->Next = Clients;
+	Clients = Client;
+	pthread_mutex_unlock(&ClientsLock);
+
+	/* Signals are left to the main thread, to interrupt accept(). */
+	sigemptyset(&Signals);
+	sigaddset(&Signals, SIGINT);
+	sigaddset(&Signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &Signals, &OldSignals);
+	pthread_attr_init(&Attr);
+	pthread_attr_setdetachstate(&Attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&Thread, &Attr, ClientThread, Client) != 0)
+	{
+		/* Serve it here instead. */
+		fprintf(stderr, _("Unable to start a thread for a client.\n"));
+		ClientThread(Client);
+	}
+	pthread_attr_destroy(&Attr);
+	pthread_sigmask(SIG_SETMASK, &OldSignals, NULL);
+}
+
+/* Tells every client being served to stop once its job is done, and
+ * waits for them to. */
+static void StopClients(void)
+{
+	struct Client* Client;
+
+	pthread_mutex_lock(&ClientsLock);
+	for (Client = Clients; Client; Client = Client->Next)
+		shutdown(Client->Fd, SHUT_RD);
+	while (Clients)
+		pthread_cond_wait(&ClientGone, &ClientsLock);
+	pthread_mutex_unlock(&ClientsLock);
+}
+
+/* Makes the socket to listen on, replacing one left behind by an
+ * earlier run, but not one that's still being listened on. */
+static int Listen(const char* Path)
+{
+	struct sockaddr_un Address;
+	int Fd;
+
+	if (strlen(Path) >= sizeof(Address.sun_path))
+	{
+		fprintf(stderr, _("Socket name %s is too long.\n"), Path);
+		return -1;
+	}
+	memset(&Address, 0, sizeof(Address));
+	Address.sun_family = AF_UNIX;
+	strcpy(Address.sun_path, Path);
+
+	Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (Fd < 0)
+		return -1;
+	if (connect(Fd, (struct sockaddr*) &Address, sizeof(Address)) == 0)
+	{
+		fprintf(stderr, _("Something is already listening on %s.\n"), Path);
+		close(Fd);
+		return -1;
+	}
+	close(Fd);
+	unlink(Path);
+
+	/* Only we get to use it. */
+	mode_t OldMask = umask(077);
+	Fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (Fd < 0 ||
+	    bind(Fd, (struct sockaddr*) &Address, sizeof(Address)) != 0 ||
+	    listen(Fd, 16) != 0)
+	{
+		fprintf(stderr, _("Unable to listen on %s: %s\n"), Path, strerror(errno));
+		if (Fd >= 0)
+			close(Fd);
+		Fd = -1;
+	}
+	umask(OldMask);
+	return Fd;
+}
+
+int main(int argc, char** argv)
+{
+	struct TrackSet Set;
+	struct PhotoCache* Cache = NULL;
+	char* SocketPath = NULL;
+	struct sigaction Action;
+	int Listener;
+	int c;
+
+	/* Initialize locale & gettext */
+	setlocale (LC_ALL, "");
+	textdomain(TEXTDOMAIN);
+
+	memset(&Set, 0, sizeof(Set));
+	pthread_rwlock_init(&Set.Lock, NULL);
+	while ((c = getopt_long(argc, argv, "g:l:c:hV", program_options, 0)) != -1)
+	{
+		switch (c)
+		{
+			case 'g':
+				Set.Files = (char**) realloc(Set.Files, sizeof(*Set.Files)*(Set.NumFiles+1));
+				if (!Set.Files)
+				{
+					fprintf(stderr, _("Out of memory\n"));
+					exit(EXIT_FAILURE);
+				}
+				Set.Files[Set.NumFiles++] = optarg;
+				break;
+			case 'l':
+				free(SocketPath);
+				SocketPath = strdup(optarg);
+				break;
+			case 'c':
+				ClosePhotoCache(Cache);
+				Cache = OpenPhotoCache(optarg);
+				break;
+			case 'V':
+				PrintVersion(argv[0]);
+				exit(EXIT_SUCCESS);
+			case 'h':
+				PrintUsage(argv[0]);
+				exit(EXIT_SUCCESS);
+			default:
+				PrintUsage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (!Set.NumFiles || optind < argc)
+	{
+		PrintUsage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!SocketPath)
+	{
+		/* Somewhere private to this user, by default. */
+		const char* RuntimeDir = getenv("XDG_RUNTIME_DIR");
+		SocketPath = (char*) malloc(PATH_MAX);
+		if (!SocketPath)
+		{
+			fprintf(stderr, _("Out of memory\n"));
+			exit(EXIT_FAILURE);
+		}
+		if (RuntimeDir && *RuntimeDir)
+			snprintf(SocketPath, PATH_MAX, "%s/gpscorrelated.sock", RuntimeDir);
+		else
+			snprintf(SocketPath, PATH_MAX, "/tmp/gpscorrelated-%ld.sock", (long)getuid());
+	}
+
+	if (!LoadTracks(&Set))
+		exit(EXIT_FAILURE);
+
+	Listener = Listen(SocketPath);
+	if (Listener < 0)
+		exit(EXIT_FAILURE);
+
+	/* A client going away mid-reply is no reason to stop. Being
+	 * asked to stop interrupts accept(), rather than waiting. */
+	signal(SIGPIPE, SIG_IGN);
+	memset(&Action, 0, sizeof(Action));
+	Action.sa_handler = Interrupt;
+	sigaction(SIGINT, &Action, NULL);
+	sigaction(SIGTERM, &Action, NULL);
+
+	fprintf(stderr, _("Listening on %s.\n"), SocketPath);
+	while (!Interrupted)
+	{
+		int Client = accept(Listener, NULL, NULL);
+		if (Client < 0)
+		{
+			if (errno != EINTR && errno != ECONNABORTED)
+			{
+				fprintf(stderr, _("Unable to accept connection: %s\n"),
+					strerror(errno));
+				break;
+			}
+			continue;
+		}
+		StartClient(Client, &Set, Cache);
+	}
+
+	close(Listener);
+	unlink(SocketPath);
+	StopClients();
+	free(SocketPath);
+	FreeTracks(Set.Tracks, Set.NumFiles);
+	free(Set.Matching);
+	free(Set.Seen);
+	free(Set.Files);
+	pthread_rwlock_destroy(&Set.Lock);
+	ClosePhotoCache(Cache);
+
+	return Interrupted ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,438 @@
+/* main-difftest.c
+ *
+ * This file is the differential test run by "make difftest". It puts
+ * random tracks and photo times through both the real time conversion
+ * and matching, and the original versions kept in legacy-correlate.c,
+ * and complains about any difference at all in what comes out: the
+ * result code, the point, or the text of the GPS tags that would be
+ * written for it.
+ *
+ * Anything done to make matching faster has to pass this.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "gpsstructure.h"
+#include "gpx-read.h"
+#include "correlate.h"
+#include "unixtime.h"
+#include "exif-rational.h"
+#include "legacy-correlate.h"
+#include "bench-gen.h"
+
+#define MAX_TRACKS 4
+
+/* Time zones to try AutoTimeZone in, with and without DST. The
+ * original ConvertToUnixTime only reads TZ the first time it's called,
+ * so each zone gets a process of its own, with TZ set before anything
+ * else happens. */
+static const char* const Zones[] = {
+	"UTC", "Australia/Perth", "Australia/Adelaide", "Europe/London",
+	"America/New_York", "Asia/Kathmandu", "Pacific/Chatham", NULL
+};
+#define NUM_ZONES (sizeof(Zones) / sizeof(Zones[0]) - 1)
+
+static const char* Zone;   /* The one this process is in. */
+static unsigned long long State;
+static int Verbose;
+static long Failures;
+
+/* Returns a random number from 0 to Range - 1. */
+static long Random(long Range)
+{
+	return Range > 0 ? (long)(BenchRandom(&State) % (unsigned long)Range) : 0;
+}
+
+/* Returns a random number that looks as if it was read from a GPX
+ * file with Decimals decimal places. */
+static double RandomDecimal(double Low, double High, int Decimals)
+{
+	double Scale = pow(10, Decimals);
+	double Value = Low + (High - Low) * (BenchRandom(&State) / 4294967296.0);
+	char Text[64];
+	/* Going through text is how the real ones get made. */
+	snprintf(Text, sizeof(Text), "%.*f", Decimals, floor(Value * Scale) / Scale);
+	return atof(Text);
+}
+
+static void MakeTrack(struct GPSTrack* Track)
+{
+	long Points = 1 + Random(Random(10) ? 60 : 400);
+	time_t Time = 946684800 + Random(30L * 365 * 86400); /* 2000 to 2030 */
+	struct GPSPoint** Last = &Track->Points;
+	long i;
+
+	Track->MinTime = Time;
+	Track->MaxTime = 0;
+	for (i = 0; i < Points; i++)
+	{
+		struct GPSPoint* Point = (struct GPSPoint*) calloc(1, sizeof(*Point));
+		if (!Point)
+		{
+			fprintf(stderr, "Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		Point->LatDecimals = Random(10);
+		Point->Lat = RandomDecimal(-90, 90, Point->LatDecimals);
+		Point->LongDecimals = Random(10);
+		Point->Long = RandomDecimal(-180, 180, Point->LongDecimals);
+		if (Random(8))
+		{
+			Point->ElevDecimals = Random(5);
+			Point->Elev = RandomDecimal(-400, 8800, Point->ElevDecimals);
+		} else {
+			Point->ElevDecimals = -1;
+		}
+		Point->Time = Time;
+		Point->EndOfSegment = Random(20) == 0 || i == Points - 1;
+
+		/* Mostly steady, but with repeated times, gaps and the
+		 * odd step backwards, as real logs have. */
+		switch (Random(20))
+		{
+			case 0:  break;
+			case 1:  Time -= Random(30); break;
+			case 2:  Time += Random(7200); break;
+			default: Time += 1 + Random(30); break;
+		}
+
+		if (Point->Time < Track->MinTime)
+			Track->MinTime = Point->Time;
+		if (Point->Time > Track->MaxTime)
+			Track->MaxTime = Point->Time;
+		*Last = Point;
+		Last = &Point->Next;
+	}
+
+	/* Check both ways of finding points. */
+	if (Random(4))
+		IndexTrack(Track);
+}
+
+/* Picks a time for a photo: often right on a point, often somewhere
+ * in a track, and sometimes nowhere near any. */
+static time_t PhotoTime(const struct GPSTrack* Tracks, int NumTracks)
+{
+	const struct GPSTrack* Track = &Tracks[Random(NumTracks)];
+	switch (Random(5))
+	{
+		case 0:
+		case 1:
+		{
+			const struct GPSPoint* Point = Track->Points;
+			long Skip = Random(50);
+			while (Skip-- && Point->Next)
+				Point = Point->Next;
+			return Point->Time + (Random(4) ? 0 : Random(3) - 1);
+		}
+		case 2:
+		case 3:
+			return Track->MinTime + Random(Track->MaxTime - Track->MinTime + 1);
+		default:
+			return Track->MinTime - 86400 + Random(Track->MaxTime - Track->MinTime + 2 * 86400);
+	}
+}
+
+static void RandomOptions(struct CorrelateOptions* Options)
+{
+	memset(Options, 0, sizeof(*Options));
+	Options->NoWriteExif = 1;
+	Options->Datum = (char*) "WGS-84";
+	Options->NoInterpolate = Random(4) == 0;
+	Options->DoBetweenTrkSeg = Random(2);
+	Options->DegMinSecs = Random(4) != 0;
+	if (Random(3) == 0)
+		Options->FeatherTime = 1 + Random(600);
+	if (Random(4) == 0)
+		Options->PhotoOffset = Random(7201) - 3600;
+	if (Random(10) == 0)
+	{
+		Options->AutoTimeZone = 1;
+	} else {
+		static const int Minutes[] = { 0, 0, 0, 30, 45 };
+		Options->TimeZoneHours = Random(27) - 12;
+		Options->TimeZoneMins = Minutes[Random(5)];
+		if (Options->TimeZoneHours < 0)
+			Options->TimeZoneMins = -Options->TimeZoneMins;
+	}
+}
+
+static void Describe(const char* What, const struct CorrelateOptions* Options,
+		     const struct GPSPoint* Point)
+{
+	printf("  %s: result %d, track %d, point %d, zone %d:%d", What,
+	       Options->Result, Options->MatchTrack, Options->MatchPoint,
+	       Options->TimeZoneHours, Options->TimeZoneMins);
+	if (Point)
+		printf(", %.17g/%d %.17g/%d %.17g/%d at %ld", Point->Lat,
+		       Point->LatDecimals, Point->Long, Point->LongDecimals,
+		       Point->Elev, Point->ElevDecimals, (long)Point->Time);
+	printf("\n");
+}
+
+/* Compares the text of every GPS tag that would be written for the two
+ * points. Returns 1 if they're the same. */
+static int SameTags(const struct GPSPoint* A, const struct GPSPoint* B,
+		    char* Which, int WhichSize)
+{
+	char TextA[100], TextB[100];
+
+#define SAME_TAG(Tag, Convert) \
+	Convert(A, TextA); Convert(B, TextB); \
+	if (strcmp(TextA, TextB) != 0) \
+	{ \
+		snprintf(Which, WhichSize, "%s: %s and %s", Tag, TextA, TextB); \
+		return 0; \
+	}
+#define ALTITUDE(P, T)    ConvertToRational(fabs((P)->Elev), (P)->ElevDecimals < 3 ? (P)->ElevDecimals : 3, T, sizeof(T))
+#define LATITUDE(P, T)    ConvertToLatLongRational((P)->Lat, (P)->LatDecimals, T, sizeof(T))
+#define LONGITUDE(P, T)   ConvertToLatLongRational((P)->Long, (P)->LongDecimals, T, sizeof(T))
+#define OLDLATITUDE(P, T) ConvertToOldLatLongRational((P)->Lat, T, sizeof(T))
+#define OLDLONGITUDE(P, T) ConvertToOldLatLongRational((P)->Long, T, sizeof(T))
+#define TIMESTAMP(P, T)   ConvertToGPSTimeStamp((P)->Time, T, sizeof(T))
+#define DATESTAMP(P, T)   ConvertToGPSDateStamp((P)->Time, T, sizeof(T))
+
+	if (A->ElevDecimals >= 0)
+	{
+		SAME_TAG("GPSAltitude", ALTITUDE);
+	}
+	SAME_TAG("GPSLatitude", LATITUDE);
+	SAME_TAG("GPSLongitude", LONGITUDE);
+	SAME_TAG("GPSLatitude (old style)", OLDLATITUDE);
+	SAME_TAG("GPSLongitude (old style)", OLDLONGITUDE);
+	SAME_TAG("GPSTimeStamp", TIMESTAMP);
+	SAME_TAG("GPSDateStamp", DATESTAMP);
+	return 1;
+}
+
+/* Puts one photo time through both. Returns 1 if they agree. */
+static int CheckMatch(long Round, struct GPSTrack* Tracks, int NumTracks)
+{
+	struct CorrelateOptions New, Old;
+	char ExifTime[20];
+	char Which[300];
+	const char* Problem = NULL;
+
+	RandomOptions(&New);
+	New.Track = Tracks;
+
+	/* Write the time as the camera would have, in local time and
+	 * out by however much PhotoOffset says. */
+	time_t Time = PhotoTime(Tracks, NumTracks) - New.PhotoOffset +
+		New.TimeZoneHours * 3600 + New.TimeZoneMins * 60;
+	FormatExifTime(Time, ExifTime);
+	Old = New;
+	int Auto = New.AutoTimeZone;   /* Matching clears it. */
+
+	struct GPSPoint* NewPoint = CorrelateTime(ExifTime, &New);
+	struct GPSPoint* OldPoint = LegacyCorrelateTime(ExifTime, &Old);
+
+	if (New.Result != Old.Result)
+		Problem = "result";
+	else if (!NewPoint != !OldPoint)
+		Problem = "point returned";
+	else if (New.MatchTrack != Old.MatchTrack || New.MatchPoint != Old.MatchPoint)
+		Problem = "track or point index";
+	else if (New.TimeZoneHours != Old.TimeZoneHours || New.TimeZoneMins != Old.TimeZoneMins)
+		Problem = "time zone";
+	else if (NewPoint &&
+		 (memcmp(&NewPoint->Lat, &OldPoint->Lat, sizeof(double)) != 0 ||
+		  memcmp(&NewPoint->Long, &OldPoint->Long, sizeof(double)) != 0 ||
+		  (OldPoint->ElevDecimals >= 0 &&
+		   memcmp(&NewPoint->Elev, &OldPoint->Elev, sizeof(double)) != 0) ||
+		  NewPoint->LatDecimals != OldPoint->LatDecimals ||
+		  NewPoint->LongDecimals != OldPoint->LongDecimals ||
+		  NewPoint->ElevDecimals != OldPoint->ElevDecimals ||
+		  NewPoint->Time != OldPoint->Time))
+		Problem = "point";
+	else if (NewPoint && !SameTags(NewPoint, OldPoint, Which, sizeof(Which)))
+		Problem = Which;
+
+	if (Problem || Verbose)
+	{
+		printf("%s match %ld: photo at %s, zone %d:%d%s%s, offset %d, "
+		       "feather %d, %s, %s\n", Problem ? "Different" : "Same",
+		       Round, ExifTime, Old.TimeZoneHours, Old.TimeZoneMins,
+		       Auto ? " auto in " : "", Auto ? Zone : "", New.PhotoOffset,
+		       New.FeatherTime, New.NoInterpolate ? "rounding" : "interpolating",
+		       New.DoBetweenTrkSeg ? "between segments" : "within segments");
+		if (Problem)
+			printf("  (%s)\n", Problem);
+		Describe("now", &New, NewPoint);
+		Describe("was", &Old, OldPoint);
+	}
+
+	free(NewPoint);
+	free(OldPoint);
+	return !Problem;
+}
+
+/* Puts one date and time through both ConvertToUnixTimes, including
+ * ones out of range that mktime() has to tidy up. */
+static int CheckTime(long Round)
+{
+	char Text[64];
+	int TZHours = Random(27) - 12;
+	int TZMins = Random(4) ? 0 : Random(120) - 60;
+	int Year = Random(4) ? 1970 + Random(68) : 1900 + Random(300);
+	int Odd = Random(10) == 0;
+	int Exif = Random(2);
+	const char* Format = Exif ? EXIF_DATE_FORMAT : GPX_DATE_FORMAT;
+
+	snprintf(Text, sizeof(Text),
+		 Exif ? "%04d:%02d:%02d %02d:%02d:%02d" :
+		 "%04d-%02d-%02dT%02d:%02d:%02dZ", Year,
+		 Odd ? (int)Random(14) : 1 + (int)Random(12),
+		 Odd ? (int)Random(33) : 1 + (int)Random(28),
+		 (int)Random(Odd ? 25 : 24), (int)Random(Odd ? 61 : 60),
+		 (int)Random(Odd ? 62 : 60));
+
+	time_t New = ConvertToUnixTime(Text, Format, TZHours, TZMins);
+	time_t Old = LegacyConvertToUnixTime(Text, Format, TZHours, TZMins);
+
+	if (New != Old || Verbose)
+		printf("%s time %ld: %s, zone %d:%d: now %ld, was %ld\n",
+		       New == Old ? "Same" : "Different", Round, Text,
+		       TZHours, TZMins, (long)New, (long)Old);
+	return New == Old;
+}
+
+/* Makes up the tracks for one round and checks 50 photos and times
+ * against them. */
+static void RunRound(long Round)
+{
+	struct GPSTrack Tracks[MAX_TRACKS + 1];
+	int NumTracks = 1 + Random(MAX_TRACKS);
+	int i;
+
+	memset(Tracks, 0, sizeof(Tracks));
+	for (i = 0; i < NumTracks; i++)
+		MakeTrack(&Tracks[i]);
+
+	for (i = 0; i < 50; i++)
+	{
+		if (!CheckMatch(Round, Tracks, NumTracks))
+			Failures++;
+		if (!CheckTime(Round))
+			Failures++;
+	}
+
+	for (i = 0; i < NumTracks; i++)
+		FreeTrack(&Tracks[i]);
+}
+
+/* Runs every NUM_ZONES'th round, from Which, in a child process with
+ * TZ set to Zones[Which]. Returns the number of differences, or -1 if
+ * it couldn't be run. */
+static long RunZone(unsigned Which, unsigned long long Seed, long Rounds)
+{
+	int Pipe[2];
+	int Status;
+	long Differences;
+
+	if (pipe(Pipe) != 0)
+		return -1;
+	fflush(stdout);
+	pid_t Child = fork();
+	if (Child < 0)
+	{
+		close(Pipe[0]);
+		close(Pipe[1]);
+		return -1;
+	}
+	if (Child == 0)
+	{
+		long Round;
+
+		close(Pipe[0]);
+		Zone = Zones[Which];
+		setenv("TZ", Zone, 1);
+		tzset();
+		State = Seed + Which;
+		for (Round = Which; Round < Rounds; Round += NUM_ZONES)
+			RunRound(Round);
+		fflush(stdout);
+		int Ok = write(Pipe[1], &Failures, sizeof(Failures)) == sizeof(Failures);
+		_exit(Ok ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+
+	close(Pipe[1]);
+	ssize_t Got = read(Pipe[0], &Differences, sizeof(Differences));
+	close(Pipe[0]);
+	if (waitpid(Child, &Status, 0) != Child || Got != sizeof(Differences) ||
+	    !WIFEXITED(Status) || WEXITSTATUS(Status) != EXIT_SUCCESS)
+		return -1;
+	return Differences;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned long long Seed = (unsigned long long) time(NULL);
+	long Rounds = 2000;
+	unsigned i;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:s:vh")) != -1)
+	{
+		switch (c)
+		{
+			case 'n':
+				Rounds = atol(optarg);
+				break;
+			case 's':
+				Seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'v':
+				Verbose++;
+				break;
+			default:
+				printf("Usage: %s [-n rounds] [-s seed] [-v]\n", argv[0]);
+				puts("Each round makes up some tracks and matches 50 photos against them.");
+				puts("Differences are always shown; -v shows every check.");
+				exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+		}
+	}
+
+	printf("Seed %llu, %ld rounds\n", Seed, Rounds);
+	for (i = 0; i < NUM_ZONES; i++)
+	{
+		long Differences = RunZone(i, Seed, Rounds);
+		if (Differences < 0)
+		{
+			fprintf(stderr, "Unable to run the checks in %s.\n", Zones[i]);
+			return EXIT_FAILURE;
+		}
+		Failures += Differences;
+	}
+
+	if (Failures)
+	{
+		printf("%ld differences; -s %llu repeats this run\n", Failures, Seed);
+		return EXIT_FAILURE;
+	}
+	printf("No differences\n");
+	return EXIT_SUCCESS;
+}
@@ -43,6 +43,11 @@ int main(int argc, char* argv[])
 	textdomain(TEXTDOMAIN);
 	bind_textdomain_codeset(TEXTDOMAIN, "UTF-8");
 
+#if !GLIB_CHECK_VERSION(2,32,0)
+	/* Correlation hands its results back from other threads. */
+	g_thread_init(NULL);
+#endif
+
 	/* Get GTK ready, as appropriate.
 	 * (We ignore passed parameters) */
 	gtk_init(&argc, &argv);
@@ -0,0 +1,290 @@
+/* main-striptest.c
+ *
+ * This file is the test run by "make striptest". It makes up small
+ * JPEGs, little- and big-endian, with the GPS pointer in different
+ * places in IFD0, takes the GPS tags out of them with StripGPSInPlace,
+ * and checks every byte of what's left. It also checks that files
+ * where the GPS tags share bytes with anything else are left alone
+ * for Exiv2.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "exif-strip.h"
+
+#define TEST_FILE "gpscorrelate-striptest.jpg"
+
+/* Where everything goes in the TIFF data. There are gaps between them
+ * so that a value can be put over the end of any one alone. */
+#define IFD0_AT    8
+#define IFD0_SIZE  (2 + 4 * 12 + 4)
+#define MAKE_AT    88
+#define MAKE_SIZE  12
+#define EXIF_AT    124
+#define EXIF_SIZE  (2 + 1 * 12 + 4)
+#define DATE_AT    168
+#define DATE_SIZE  20
+#define GPS_AT     212
+#define GPS_SIZE   (2 + 3 * 12 + 4)
+#define LAT_AT     280
+#define LAT_SIZE   24
+#define IFD1_AT    328
+#define IFD1_SIZE  (2 + 2 * 12 + 4)
+#define THUMB_AT   384
+#define THUMB_SIZE 64
+#define TIFF_SIZE  472
+
+/* What the JPEG holds around the TIFF data. */
+#define EXIF_HEADER (2 + 4 + 6)
+#define JPEG_SIZE   (EXIF_HEADER + TIFF_SIZE + 2)
+
+/* Ends a value just over the end of a block. */
+#define OVER_END(At, Size) ((At) + (Size) - 4)
+
+struct Case {
+	const char* Name;
+	int BigEndian;
+	int GpsSlot;         /* Which entry of IFD0 is the GPS pointer;
+				-1 for none. */
+	unsigned long GpsAt; /* Where the GPS pointer points. */
+	unsigned long LatAt; /* Where the latitude is said to be. */
+	int Expect;          /* What StripGPSInPlace should return. */
+};
+
+static const struct Case Cases[] = {
+	{ "II, GPS first", 0, 0, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "II, GPS second", 0, 1, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "II, GPS third", 0, 2, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "II, GPS last", 0, 3, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "MM, GPS first", 1, 0, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "MM, GPS second", 1, 1, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "MM, GPS third", 1, 2, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "MM, GPS last", 1, 3, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "II, no GPS", 0, -1, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "MM, no GPS", 1, -1, GPS_AT, LAT_AT, STRIP_DONE },
+	{ "II, latitude over IFD0", 0, 3, GPS_AT,
+		OVER_END(IFD0_AT, IFD0_SIZE), STRIP_UNUSUAL },
+	{ "II, latitude over IFD0's value", 0, 3, GPS_AT,
+		OVER_END(MAKE_AT, MAKE_SIZE), STRIP_UNUSUAL },
+	{ "II, latitude over the Exif IFD", 0, 1, GPS_AT,
+		OVER_END(EXIF_AT, EXIF_SIZE), STRIP_UNUSUAL },
+	{ "MM, latitude over the Exif IFD's value", 1, 1, GPS_AT,
+		OVER_END(DATE_AT, DATE_SIZE), STRIP_UNUSUAL },
+	{ "MM, latitude over IFD1", 1, 0, GPS_AT,
+		OVER_END(IFD1_AT, IFD1_SIZE), STRIP_UNUSUAL },
+	{ "II, latitude over the thumbnail", 0, 0, GPS_AT,
+		OVER_END(THUMB_AT, THUMB_SIZE), STRIP_UNUSUAL },
+	{ "MM, GPS IFD over the Exif IFD", 1, 2, EXIF_AT,
+		LAT_AT, STRIP_UNUSUAL },
+	{ "II, GPS IFD over IFD1", 0, 2, IFD1_AT,
+		LAT_AT, STRIP_UNUSUAL },
+	{ NULL, 0, 0, 0, 0, 0 }
+};
+
+static void Put16(unsigned char* P, int BigEndian, unsigned Value)
+{
+	P[BigEndian ? 0 : 1] = (Value >> 8) & 0xff;
+	P[BigEndian ? 1 : 0] = Value & 0xff;
+}
+
+static void Put32(unsigned char* P, int BigEndian, unsigned long Value)
+{
+	Put16(P + (BigEndian ? 0 : 2), BigEndian, (Value >> 16) & 0xffff);
+	Put16(P + (BigEndian ? 2 : 0), BigEndian, Value & 0xffff);
+}
+
+/* Puts an IFD entry at P. Value is the offset of the value, or the
+ * value itself for a SHORT or LONG that fits. */
+static void PutEntry(unsigned char* P, int BigEndian, unsigned Tag,
+		     unsigned Type, unsigned long Count, unsigned long Value)
+{
+	Put16(P, BigEndian, Tag);
+	Put16(P + 2, BigEndian, Type);
+	Put32(P + 4, BigEndian, Count);
+	if (Type == 3 && Count == 1)
+		Put16(P + 8, BigEndian, Value);
+	else
+		Put32(P + 8, BigEndian, Value);
+}
+
+/* Makes the JPEG for Test in Jpeg. Without WithGps, it's made as it
+ * should be after stripping: the GPS IFD and its values are all 0, and
+ * the entries after the GPS pointer in IFD0 have moved up. */
+static void MakeJpeg(const struct Case* Test, int WithGps, unsigned char* Jpeg)
+{
+	static const unsigned char Header[EXIF_HEADER] = {
+		0xff, 0xd8, 0xff, 0xe1,
+		(2 + 6 + TIFF_SIZE) >> 8, (2 + 6 + TIFF_SIZE) & 0xff,
+		'E', 'x', 'i', 'f', 0, 0
+	};
+	unsigned char* T = Jpeg + EXIF_HEADER;
+	int Big = Test->BigEndian;
+	int Gps = WithGps && Test->GpsSlot >= 0;
+	unsigned char* Entry;
+	int i;
+
+	memset(Jpeg, 0, JPEG_SIZE);
+	memcpy(Jpeg, Header, EXIF_HEADER);
+	Jpeg[JPEG_SIZE - 2] = 0xff;
+	Jpeg[JPEG_SIZE - 1] = 0xd9;
+
+	memcpy(T, Big ? "MM" : "II", 2);
+	Put16(T + 2, Big, 42);
+	Put32(T + 4, Big, IFD0_AT);
+
+	/* IFD0: make, orientation, the Exif pointer, and the GPS pointer
+	 * wherever the case wants it. */
+	Put16(T + IFD0_AT, Big, Gps ? 4 : 3);
+	Entry = T + IFD0_AT + 2;
+	for (i = 0; i < 4; i++)
+	{
+		if (Gps && i == Test->GpsSlot)
+		{
+			PutEntry(Entry, Big, 0x8825, 4, 1, Test->GpsAt);
+			Entry += 12;
+		}
+		if (i == 0)
+			PutEntry(Entry, Big, 0x010f, 2, MAKE_SIZE, MAKE_AT);
+		else if (i == 1)
+			PutEntry(Entry, Big, 0x0112, 3, 1, 1);
+		else if (i == 2)
+			PutEntry(Entry, Big, 0x8769, 4, 1, EXIF_AT);
+		else
+			break;
+		Entry += 12;
+	}
+	Put32(Entry, Big, IFD1_AT);
+	memcpy(T + MAKE_AT, "TestCamera", 11);
+
+	/* The Exif IFD, with the time the photo was taken. */
+	Put16(T + EXIF_AT, Big, 1);
+	PutEntry(T + EXIF_AT + 2, Big, 0x9003, 2, DATE_SIZE, DATE_AT);
+	memcpy(T + DATE_AT, "2020:03:29 12:00:00", DATE_SIZE);
+
+	/* The GPS IFD: version, latitude reference and latitude. */
+	if (WithGps)
+	{
+		Put16(T + GPS_AT, Big, 3);
+		PutEntry(T + GPS_AT + 2, Big, 0x0000, 1, 4, 0);
+		memcpy(T + GPS_AT + 2 + 8, "\2\2\0\0", 4);
+		PutEntry(T + GPS_AT + 14, Big, 0x0001, 2, 2, 0);
+		memcpy(T + GPS_AT + 14 + 8, "N\0\0\0", 4);
+		PutEntry(T + GPS_AT + 26, Big, 0x0002, 5, 3, Test->LatAt);
+		for (i = 0; i < LAT_SIZE; i++)
+			T[LAT_AT + i] = 0x40 + i;
+	}
+
+	/* IFD1, with a JPEG thumbnail. */
+	Put16(T + IFD1_AT, Big, 2);
+	PutEntry(T + IFD1_AT + 2, Big, 0x0201, 4, 1, THUMB_AT);
+	PutEntry(T + IFD1_AT + 14, Big, 0x0202, 4, 1, THUMB_SIZE);
+	for (i = 0; i < THUMB_SIZE; i++)
+		T[THUMB_AT + i] = 0x80 + i;
+}
+
+static int WriteFile(const char* File, const unsigned char* Data, size_t Size)
+{
+	FILE* F = fopen(File, "wb");
+	if (!F)
+		return 0;
+	int Ok = fwrite(Data, 1, Size, F) == Size;
+	return !fclose(F) && Ok;
+}
+
+static int ReadFile(const char* File, unsigned char* Data, size_t Size)
+{
+	FILE* F = fopen(File, "rb");
+	if (!F)
+		return 0;
+	/* Read one more, to catch the file growing. */
+	int Ok = fread(Data, 1, Size + 1, F) == Size;
+	fclose(F);
+	return Ok;
+}
+
+/* Runs one case, showing what's wrong if it fails. */
+static int RunCase(const struct Case* Test)
+{
+	unsigned char Before[JPEG_SIZE];
+	unsigned char Expect[JPEG_SIZE];
+	unsigned char After[JPEG_SIZE + 1];
+	size_t i;
+
+	MakeJpeg(Test, 1, Before);
+	if (Test->Expect == STRIP_DONE && Test->GpsSlot >= 0)
+		MakeJpeg(Test, 0, Expect);
+	else
+		memcpy(Expect, Before, JPEG_SIZE);
+
+	if (!WriteFile(TEST_FILE, Before, JPEG_SIZE))
+	{
+		printf("%s: couldn't write %s\n", Test->Name, TEST_FILE);
+		return 0;
+	}
+	int Result = StripGPSInPlace(TEST_FILE);
+	int Read = ReadFile(TEST_FILE, After, JPEG_SIZE);
+	remove(TEST_FILE);
+
+	if (Result != Test->Expect)
+	{
+		printf("%s: returned %d, not %d\n", Test->Name, Result, Test->Expect);
+		return 0;
+	}
+	if (!Read)
+	{
+		printf("%s: the file changed size\n", Test->Name);
+		return 0;
+	}
+	for (i = 0; i < JPEG_SIZE; i++)
+	{
+		if (After[i] != Expect[i])
+		{
+			printf("%s: byte %lu of the TIFF data is %02x, not %02x\n",
+				Test->Name, (unsigned long) i - EXIF_HEADER,
+				After[i], Expect[i]);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int main(void)
+{
+	const struct Case* Test;
+	int Failures = 0;
+	int Run = 0;
+
+	for (Test = Cases; Test->Name; Test++)
+	{
+		if (!RunCase(Test))
+			Failures++;
+		Run++;
+	}
+
+	if (Failures)
+	{
+		printf("%d of %d cases failed\n", Failures, Run);
+		return EXIT_FAILURE;
+	}
+	printf("All %d cases passed\n", Run);
+	return EXIT_SUCCESS;
+}
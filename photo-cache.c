@@ -0,0 +1,601 @@
+/* photo-cache.c
+ *
+ * This file contains an on-disk cache of the EXIF details
+ * that correlation needs from each photo: the DateTimeOriginal
+ * tag and any GPS data already present. Repeated runs over the
+ * same photos (say, to try different time zones) can then skip
+ * opening the photos altogether.
+ *
+ * The cache file is a short header followed by fixed size
+ * records, only ever appended to. A record is only believed
+ * while the device, inode, size, mtime and ctime of the photo
+ * (and a hash of its path) still match; a newer record for the
+ * same file simply supersedes the older one.
+ *
+ * Several threads may use one cache at once. The lock is only held
+ * while looking up or adding a record, never while reading a photo.
+ *
+ * Several processes may use one cache file at once too, each adding
+ * its records to the end. Each holds a shared flock() on the file for
+ * as long as it has it open, so the end is only trimmed, and the file
+ * only compacted, by a process that has it to itself.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#ifndef _WIN32
+#include <sys/file.h>
+#endif
+
+#include "i18n.h"
+#include "gpsstructure.h"
+#include "exif-gps.h"
+#include "photo-cache.h"
+
+#define CACHE_MAGIC     "GPSCPHC1"
+#define CACHE_BYTEORDER 0x01020304
+#define CACHE_TIME_LEN  28
+
+/* Bits in CacheRecord.Flags */
+#define CACHE_HAVETIME     1  /* Time holds DateTimeOriginal */
+#define CACHE_INCLUDESGPS  2  /* IncludesGPS from ReadExifData */
+#define CACHE_INCLUDESLAT  4  /* IncludesGPS from ReadExifDate */
+
+/* Records are written every this many at a time, so that other
+ * processes appending to the same cache never split one. */
+#define CACHE_WRITE_BATCH 64
+
+#ifdef _WIN32
+/* There's no flock() there, so a cache mustn't be shared between
+ * processes. */
+#define LOCK_SH 1
+#define LOCK_EX 2
+#define LOCK_NB 4
+static int flock(int Fd, int Operation)
+{
+	return 0;
+}
+#endif
+
+/* Nanosecond file times aren't available everywhere. */
+#ifdef __linux__
+#define MTIME_NSEC(s) ((s).st_mtim.tv_nsec)
+#define CTIME_NSEC(s) ((s).st_ctim.tv_nsec)
+#else
+#define MTIME_NSEC(s) 0
+#define CTIME_NSEC(s) 0
+#endif
+
+struct CacheHeader {
+	char Magic[8];
+	uint32_t RecordSize;
+	uint32_t ByteOrder;
+};
+
+/* The on-disk record. The first eight fields are the key. */
+struct CacheRecord {
+	uint64_t PathHash;
+	uint64_t Device;
+	uint64_t Inode;
+	int64_t Size;
+	int64_t MTime;
+	int64_t MTimeNsec;
+	int64_t CTime;
+	int64_t CTimeNsec;
+	double Lat;
+	double Long;
+	double Elev;
+	uint32_t Flags;
+	char Time[CACHE_TIME_LEN];
+};
+
+struct PhotoCache {
+	pthread_mutex_t Lock;        /* Over everything below. */
+	char* Filename;
+	FILE* Out;                   /* New records are appended here, */
+	char* OutBuffer;             /* a batch at a time from here. */
+	struct CacheRecord* Records; /* Every record, in file order. */
+	size_t NumRecords;
+	size_t AllocRecords;
+	size_t* Slots;               /* Hash on device and inode. Holds
+					an index into Records plus one,
+					or 0 for an empty slot. */
+	size_t NumSlots;
+	size_t NumLive;              /* Occupied slots. */
+};
+
+static uint64_t HashPath(const char* Path)
+{
+	/* FNV-1a */
+	uint64_t Hash = 14695981039346656037ULL;
+	while (*Path)
+	{
+		Hash ^= (unsigned char)*Path++;
+		Hash *= 1099511628211ULL;
+	}
+	return Hash;
+}
+
+static size_t HashFile(uint64_t Device, uint64_t Inode)
+{
+	uint64_t Hash = Inode ^ (Device * 0x9E3779B97F4A7C15ULL);
+	Hash ^= Hash >> 33;
+	Hash *= 0xFF51AFD7ED558CCDULL;
+	Hash ^= Hash >> 33;
+	return (size_t)Hash;
+}
+
+/* Finds the slot holding the given file, or the empty slot
+ * where it would go. */
+static size_t* FindSlot(struct PhotoCache* Cache, uint64_t Device, uint64_t Inode)
+{
+	size_t Mask = Cache->NumSlots - 1;
+	size_t i = HashFile(Device, Inode) & Mask;
+	while (Cache->Slots[i])
+	{
+		const struct CacheRecord* Rec = &Cache->Records[Cache->Slots[i] - 1];
+		if (Rec->Device == Device && Rec->Inode == Inode)
+			break;
+		i = (i + 1) & Mask;
+	}
+	return &Cache->Slots[i];
+}
+
+/* Makes Records[Index] the current record for its file. */
+static int IndexRecord(struct PhotoCache* Cache, size_t Index)
+{
+	if ((Cache->NumLive + 1) * 2 > Cache->NumSlots)
+	{
+		/* Rehash into a table twice the size. */
+		size_t* OldSlots = Cache->Slots;
+		size_t OldNumSlots = Cache->NumSlots;
+		size_t i;
+
+		Cache->NumSlots = OldNumSlots ? OldNumSlots * 2 : 1024;
+		Cache->Slots = (size_t*) calloc(Cache->NumSlots, sizeof(size_t));
+		if (!Cache->Slots)
+		{
+			Cache->Slots = OldSlots;
+			Cache->NumSlots = OldNumSlots;
+			return 0;
+		}
+		for (i = 0; i < OldNumSlots; i++)
+		{
+			if (OldSlots[i])
+			{
+				const struct CacheRecord* Rec = &Cache->Records[OldSlots[i] - 1];
+				*FindSlot(Cache, Rec->Device, Rec->Inode) = OldSlots[i];
+			}
+		}
+		free(OldSlots);
+	}
+
+	const struct CacheRecord* Rec = &Cache->Records[Index];
+	size_t* Slot = FindSlot(Cache, Rec->Device, Rec->Inode);
+	if (!*Slot)
+		Cache->NumLive++;
+	*Slot = Index + 1;
+	return 1;
+}
+
+/* Appends a record to the in-memory list. */
+static struct CacheRecord* AddRecord(struct PhotoCache* Cache)
+{
+	if (Cache->NumRecords == Cache->AllocRecords)
+	{
+		size_t NewAlloc = Cache->AllocRecords ? Cache->AllocRecords * 2 : 1024;
+		struct CacheRecord* NewRecords = (struct CacheRecord*)
+			realloc(Cache->Records, NewAlloc * sizeof(struct CacheRecord));
+		if (!NewRecords)
+			return NULL;
+		Cache->Records = NewRecords;
+		Cache->AllocRecords = NewAlloc;
+	}
+	return &Cache->Records[Cache->NumRecords++];
+}
+
+static void FillHeader(struct CacheHeader* Header)
+{
+	memset(Header, 0, sizeof(*Header));
+	memcpy(Header->Magic, CACHE_MAGIC, sizeof(Header->Magic));
+	Header->RecordSize = sizeof(struct CacheRecord);
+	Header->ByteOrder = CACHE_BYTEORDER;
+}
+
+/* Reads in an existing cache file. Returns the number of bytes
+ * of it that are good, or 0 if it needs to be started afresh. */
+static long LoadCache(struct PhotoCache* Cache, FILE* In)
+{
+	struct CacheHeader Header;
+	struct CacheHeader Expected;
+
+	FillHeader(&Expected);
+	if (fread(&Header, sizeof(Header), 1, In) != 1 ||
+	    memcmp(&Header, &Expected, sizeof(Header)) != 0)
+	{
+		/* Not ours, or written by a different build. */
+		return 0;
+	}
+
+	while (1)
+	{
+		struct CacheRecord* Rec = AddRecord(Cache);
+		if (!Rec)
+			break;
+		if (fread(Rec, sizeof(*Rec), 1, In) != 1)
+		{
+			/* End of file, or a record cut short by a crash. */
+			Cache->NumRecords--;
+			break;
+		}
+		if (!IndexRecord(Cache, Cache->NumRecords - 1))
+			break;
+	}
+
+	return sizeof(Header) + Cache->NumRecords * sizeof(struct CacheRecord);
+}
+
+/* Forgets every record, to read the file in again. */
+static void ClearCache(struct PhotoCache* Cache)
+{
+	Cache->NumRecords = 0;
+	Cache->NumLive = 0;
+	if (Cache->Slots)
+		memset(Cache->Slots, 0, Cache->NumSlots * sizeof(size_t));
+}
+
+/* Opens File for appending and locks it: exclusively if no other
+ * process has it open, setting *Alone, otherwise shared. Returns the
+ * descriptor, or -1. */
+static int LockCacheFile(const char* File, int* Alone)
+{
+	while (1)
+	{
+		int Fd = open(File, O_RDWR | O_CREAT | O_APPEND, 0666);
+		if (Fd < 0)
+			return -1;
+		*Alone = (flock(Fd, LOCK_EX | LOCK_NB) == 0);
+		if (!*Alone && flock(Fd, LOCK_SH) != 0)
+		{
+			close(Fd);
+			return -1;
+		}
+
+		/* If it was compacted while we waited, we have the old
+		 * file, which is no longer there: try again. */
+		struct stat Opened, Named;
+		if (fstat(Fd, &Opened) != 0 || stat(File, &Named) != 0)
+		{
+			close(Fd);
+			return -1;
+		}
+		if (Opened.st_dev == Named.st_dev && Opened.st_ino == Named.st_ino)
+			return Fd;
+		close(Fd);
+	}
+}
+
+struct PhotoCache* OpenPhotoCache(const char* File)
+{
+	struct PhotoCache* Cache = (struct PhotoCache*) calloc(1, sizeof(*Cache));
+	if (!Cache)
+		return NULL;
+	pthread_mutex_init(&Cache->Lock, NULL);
+	Cache->Filename = strdup(File);
+
+	int Alone;
+	int Fd = LockCacheFile(File, &Alone);
+	if (Fd < 0)
+	{
+		fprintf(stderr, _("Unable to create photo cache %s.\n"), File);
+		ClosePhotoCache(Cache);
+		return NULL;
+	}
+
+	long GoodLength = 0;
+	FILE* In = fopen(File, "rb");
+	if (In)
+	{
+		GoodLength = LoadCache(Cache, In);
+		fclose(In);
+	}
+
+	if (GoodLength == 0)
+	{
+		/* Start a new cache file with just the header. That
+		 * can't be done to one someone else is adding to. */
+		struct CacheHeader Header;
+		FillHeader(&Header);
+		ClearCache(Cache);
+		if (!Alone || ftruncate(Fd, 0) != 0 ||
+		    write(Fd, &Header, sizeof(Header)) != sizeof(Header))
+		{
+			fprintf(stderr, _("Unable to create photo cache %s.\n"), File);
+			close(Fd);
+			ClosePhotoCache(Cache);
+			return NULL;
+		}
+	} else if (Alone) {
+		/* Drop any partial record at the end so that appends
+		 * stay aligned. With others adding to it, a partial
+		 * record is one of theirs still being written. */
+		if (ftruncate(Fd, GoodLength) != 0)
+		{
+			fprintf(stderr, _("Unable to update photo cache %s.\n"), File);
+			close(Fd);
+			ClosePhotoCache(Cache);
+			return NULL;
+		}
+	}
+	/* Let others in, but keep them from replacing the file. */
+	if (Alone)
+		flock(Fd, LOCK_SH);
+
+	Cache->Out = fdopen(Fd, "ab");
+	if (!Cache->Out)
+	{
+		fprintf(stderr, _("Unable to update photo cache %s.\n"), File);
+		close(Fd);
+		ClosePhotoCache(Cache);
+		return NULL;
+	}
+	/* The buffer has to be given: without one, the size is only a
+	 * hint, and a record could be split between two writes. */
+	Cache->OutBuffer = (char*) malloc(sizeof(struct CacheRecord) * CACHE_WRITE_BATCH);
+	if (Cache->OutBuffer)
+		setvbuf(Cache->Out, Cache->OutBuffer, _IOFBF,
+			sizeof(struct CacheRecord) * CACHE_WRITE_BATCH);
+
+	return Cache;
+}
+
+/* Rewrites the cache file with only the current records, if
+ * superseded ones have come to dominate it. Called with the file
+ * locked exclusively, so nobody else has it open. */
+static void CompactCache(struct PhotoCache* Cache)
+{
+	/* Others may have added to it since it was read in. */
+	struct stat Stat;
+	if (stat(Cache->Filename, &Stat) != 0)
+		return;
+	if (Stat.st_size != (off_t) (sizeof(struct CacheHeader) +
+				     Cache->NumRecords * sizeof(struct CacheRecord)))
+	{
+		FILE* In = fopen(Cache->Filename, "rb");
+		if (!In)
+			return;
+		ClearCache(Cache);
+		long GoodLength = LoadCache(Cache, In);
+		fclose(In);
+		if (GoodLength == 0)
+			return;
+	}
+
+	if (Cache->NumRecords < 4096 || Cache->NumRecords < Cache->NumLive * 2)
+		return;
+
+	const size_t TempLength = strlen(Cache->Filename) + 8;
+	char* TempName = (char*) malloc(TempLength);
+	if (!TempName)
+		return;
+	snprintf(TempName, TempLength, "%s.new", Cache->Filename);
+
+	FILE* Out = fopen(TempName, "wb");
+	int Ok = (Out != NULL);
+	if (Ok)
+	{
+		struct CacheHeader Header;
+		size_t i;
+
+		FillHeader(&Header);
+		Ok = (fwrite(&Header, sizeof(Header), 1, Out) == 1);
+
+		/* Keep file order, taking each record only if it's the
+		 * one its slot points at. */
+		for (i = 0; Ok && i < Cache->NumRecords; i++)
+		{
+			const struct CacheRecord* Rec = &Cache->Records[i];
+			if (*FindSlot(Cache, Rec->Device, Rec->Inode) == i + 1)
+				Ok = (fwrite(Rec, sizeof(*Rec), 1, Out) == 1);
+		}
+		if (fclose(Out) != 0)
+			Ok = 0;
+	}
+
+	if (!Ok || rename(TempName, Cache->Filename) != 0)
+		unlink(TempName);
+	free(TempName);
+}
+
+void ClosePhotoCache(struct PhotoCache* Cache)
+{
+	if (!Cache)
+		return;
+
+	if (Cache->Out)
+	{
+		/* Only compact a file nobody else has open: one with it
+		 * open would go on adding to the old file. The lock goes
+		 * with the file. */
+		if (fflush(Cache->Out) == 0 &&
+		    flock(fileno(Cache->Out), LOCK_EX | LOCK_NB) == 0)
+			CompactCache(Cache);
+		fclose(Cache->Out);
+	}
+	free(Cache->Records);
+	free(Cache->Slots);
+	free(Cache->OutBuffer);
+	free(Cache->Filename);
+	pthread_mutex_destroy(&Cache->Lock);
+	free(Cache);
+}
+
+/* Fills in the key fields of a record for the given file.
+ * Returns 0 if the file can't be examined. */
+static int MakeKey(const char* File, struct CacheRecord* Key)
+{
+	struct stat Stat;
+	if (stat(File, &Stat) != 0)
+		return 0;
+
+	memset(Key, 0, sizeof(*Key));
+	Key->PathHash = HashPath(File);
+	Key->Device = Stat.st_dev;
+	Key->Inode = Stat.st_ino;
+	Key->Size = Stat.st_size;
+	Key->MTime = Stat.st_mtime;
+	Key->MTimeNsec = MTIME_NSEC(Stat);
+	Key->CTime = Stat.st_ctime;
+	Key->CTimeNsec = CTIME_NSEC(Stat);
+	return 1;
+}
+
+static const struct CacheRecord* FindRecord(struct PhotoCache* Cache,
+					    const struct CacheRecord* Key)
+{
+	if (!Cache->NumSlots)
+		return NULL;
+
+	size_t Slot = *FindSlot(Cache, Key->Device, Key->Inode);
+	if (!Slot)
+		return NULL;
+
+	const struct CacheRecord* Rec = &Cache->Records[Slot - 1];
+	if (Rec->PathHash != Key->PathHash ||
+	    Rec->Size != Key->Size ||
+	    Rec->MTime != Key->MTime ||
+	    Rec->MTimeNsec != Key->MTimeNsec ||
+	    Rec->CTime != Key->CTime ||
+	    Rec->CTimeNsec != Key->CTimeNsec)
+	{
+		/* The file has changed since. */
+		return NULL;
+	}
+	return Rec;
+}
+
+static void StoreRecord(struct PhotoCache* Cache, const struct CacheRecord* Record)
+{
+	struct CacheRecord* Rec = AddRecord(Cache);
+	if (!Rec)
+		return;
+	*Rec = *Record;
+	if (!IndexRecord(Cache, Cache->NumRecords - 1))
+	{
+		Cache->NumRecords--;
+		return;
+	}
+	/* Errors here only cost us the record next time. */
+	fwrite(Rec, sizeof(*Rec), 1, Cache->Out);
+}
+
+/* Fills in Record for the given file, from the cache if possible,
+ * otherwise from the file itself (and then remembers it).
+ * Returns the photo time as ReadExifDetails does. */
+static char* LookupPhoto(struct PhotoCache* Cache, const char* File,
+			 struct CacheRecord* Record)
+{
+	int Keyed = MakeKey(File, Record);
+	if (Keyed)
+	{
+		pthread_mutex_lock(&Cache->Lock);
+		const struct CacheRecord* Hit = FindRecord(Cache, Record);
+		if (Hit)
+			*Record = *Hit;
+		pthread_mutex_unlock(&Cache->Lock);
+		if (Hit)
+			return (Record->Flags & CACHE_HAVETIME) ? strdup(Record->Time) : NULL;
+	}
+
+	int IncludesGPS = 0;
+	int IncludesLatitude = 0;
+	Record->Lat = Record->Long = Record->Elev = 0;
+	char* Time = ReadExifDetails(File, &Record->Lat, &Record->Long,
+				     &Record->Elev, &IncludesGPS, &IncludesLatitude);
+
+	Record->Flags = 0;
+	if (Time)
+	{
+		Record->Flags |= CACHE_HAVETIME;
+		if (IncludesGPS)
+			Record->Flags |= CACHE_INCLUDESGPS;
+		if (IncludesLatitude)
+			Record->Flags |= CACHE_INCLUDESLAT;
+		if (strlen(Time) >= CACHE_TIME_LEN)
+		{
+			/* Not a time we know how to store. Don't cache it. */
+			Keyed = 0;
+		} else {
+			strcpy(Record->Time, Time);
+		}
+	}
+
+	if (Keyed)
+	{
+		pthread_mutex_lock(&Cache->Lock);
+		StoreRecord(Cache, Record);
+		pthread_mutex_unlock(&Cache->Lock);
+	}
+
+	return Time;
+}
+
+char* ReadExifDateCached(struct PhotoCache* Cache, const char* File,
+			 int* IncludesGPS)
+{
+	if (!Cache)
+		return ReadExifDate(File, IncludesGPS);
+
+	struct CacheRecord Record;
+	char* Time = LookupPhoto(Cache, File, &Record);
+	if (Time)
+		*IncludesGPS = (Record.Flags & CACHE_INCLUDESLAT) ? 1 : 0;
+	return Time;
+}
+
+char* ReadExifDataCached(struct PhotoCache* Cache, const char* File,
+			 double* Lat, double* Long, double* Elev, int* IncludesGPS)
+{
+	if (!Cache)
+		return ReadExifData(File, Lat, Long, Elev, IncludesGPS);
+
+	struct CacheRecord Record;
+	char* Time = LookupPhoto(Cache, File, &Record);
+	if (Time)
+	{
+		*IncludesGPS = (Record.Flags & CACHE_INCLUDESGPS) ? 1 : 0;
+		if (*IncludesGPS)
+		{
+			/* Otherwise ReadExifData leaves these alone. */
+			*Lat = Record.Lat;
+			*Long = Record.Long;
+			*Elev = Record.Elev;
+		}
+	}
+	return Time;
+}
@@ -0,0 +1,36 @@
+/* photo-cache.h
+ *
+ * This file contains the prototypes for the on-disk photo
+ * metadata cache in photo-cache.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* The cache is opaque to its users. A NULL cache pointer is
+ * valid everywhere, and simply means "read the file". */
+struct PhotoCache;
+
+struct PhotoCache* OpenPhotoCache(const char* File);
+void ClosePhotoCache(struct PhotoCache* Cache);
+
+/* These behave exactly like ReadExifDate and ReadExifData,
+ * but answer from the cache when the file hasn't changed. */
+char* ReadExifDateCached(struct PhotoCache* Cache, const char* File,
+			 int* IncludesGPS);
+char* ReadExifDataCached(struct PhotoCache* Cache, const char* File,
+			 double* Lat, double* Long, double* Elev, int* IncludesGPS);
@@ -0,0 +1,285 @@
+/* photo-list.c
+ *
+ * This file contains a GtkTreeModel over the GUI's photo list.
+ *
+ * A GtkListStore keeps its own copy of every cell, so each photo
+ * read or correlated had all its cells formatted and copied in,
+ * shown or not, and the store grew with the list. This model holds
+ * nothing but a pointer to the list: a cell is formatted when the
+ * tree view asks for it, which it only does for the rows it's
+ * drawing. A row is an index into the list, so finding one is
+ * immediate.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include <gtk/gtk.h>
+
+#include "i18n.h"
+#include "photo-list.h"
+
+typedef struct {
+	GObject Parent;
+	gint Stamp;             /* Marks iters as ours. */
+	struct GUIPhoto** Photos;
+	int* NumPhotos;
+} PhotoListModel;
+
+typedef struct {
+	GObjectClass Parent;
+} PhotoListModelClass;
+
+static GType PhotoListModelType(void);
+
+#define PHOTO_LIST_MODEL(Object) \
+	(G_TYPE_CHECK_INSTANCE_CAST((Object), PhotoListModelType(), PhotoListModel))
+
+/* A row is just its index, kept in the iter. */
+static gboolean RowIter(PhotoListModel* List, GtkTreeIter* Iter, int Index)
+{
+	if (Index < 0 || Index >= *List->NumPhotos)
+		return FALSE;
+	Iter->stamp = List->Stamp;
+	Iter->user_data = GINT_TO_POINTER(Index);
+	Iter->user_data2 = NULL;
+	Iter->user_data3 = NULL;
+	return TRUE;
+}
+
+static int IterRow(GtkTreeIter* Iter)
+{
+	return GPOINTER_TO_INT(Iter->user_data);
+}
+
+static GtkTreeModelFlags GetFlags(GtkTreeModel* Model)
+{
+	return GTK_TREE_MODEL_LIST_ONLY;
+}
+
+static gint GetNColumns(GtkTreeModel* Model)
+{
+	return LIST_NOCOLUMNS;
+}
+
+static GType GetColumnType(GtkTreeModel* Model, gint Column)
+{
+	return G_TYPE_STRING;
+}
+
+static gboolean GetIter(GtkTreeModel* Model, GtkTreeIter* Iter, GtkTreePath* Path)
+{
+	if (gtk_tree_path_get_depth(Path) != 1)
+		return FALSE;
+	return RowIter(PHOTO_LIST_MODEL(Model), Iter,
+			gtk_tree_path_get_indices(Path)[0]);
+}
+
+static GtkTreePath* GetPath(GtkTreeModel* Model, GtkTreeIter* Iter)
+{
+	return gtk_tree_path_new_from_indices(IterRow(Iter), -1);
+}
+
+/* Makes up the text of one cell, much as it used to be set into the
+ * list store each time the photo changed. */
+static void GetValue(GtkTreeModel* Model, GtkTreeIter* Iter, gint Column,
+		     GValue* Value)
+{
+	PhotoListModel* List = PHOTO_LIST_MODEL(Model);
+	int Index = IterRow(Iter);
+	char Scratch[100] = "";
+	const char* Text = Scratch;
+
+	g_value_init(Value, G_TYPE_STRING);
+	if (Index < 0 || Index >= *List->NumPhotos)
+		return;
+	const struct GUIPhoto* Photo = &(*List->Photos)[Index];
+
+	/* In each case below, consider the values that are invalid
+	 * for each - if that's the case, consider the spots as
+	 * "blank". */
+	int ShowGPS = Photo->Time && Photo->IncludesGPS;
+	switch (Column)
+	{
+		case LIST_FILENAME:
+			/* Photos being taken out have none. */
+			if (Photo->Filename)
+				Text = strrchr(Photo->Filename, G_DIR_SEPARATOR)+1;
+			break;
+		case LIST_LAT:
+			/* Lat can't be greater than 90 degrees. */
+			if (ShowGPS && Photo->Lat < 200)
+				snprintf(Scratch, sizeof(Scratch), "%f (%c)",
+					Photo->Lat, (Photo->Lat < 0) ? 'S' : 'N');
+			break;
+		case LIST_LONG:
+			/* Long can't be greater than 180 degrees. */
+			if (ShowGPS && Photo->Long < 200)
+				snprintf(Scratch, sizeof(Scratch), "%f (%c)",
+					Photo->Long, (Photo->Long < 0) ? 'W' : 'E');
+			break;
+		case LIST_ELEV:
+			/* Radius of earth ~6000km */
+			if (ShowGPS && Photo->Elev > -7000000)
+				snprintf(Scratch, sizeof(Scratch), "%.2fm", Photo->Elev);
+			break;
+		case LIST_TIME:
+			if (Photo->Time)
+				Text = Photo->Time;
+			break;
+		case LIST_STATE:
+			if (Photo->State)
+				Text = Photo->State;
+			else if (!Photo->Time)
+				Text = _("No EXIF data");
+			else if (Photo->IncludesGPS)
+				Text = _("GPS Data Present");
+			else
+				Text = _("Ready");
+			break;
+	}
+	g_value_set_string(Value, Text);
+}
+
+static gboolean IterNext(GtkTreeModel* Model, GtkTreeIter* Iter)
+{
+	return RowIter(PHOTO_LIST_MODEL(Model), Iter, IterRow(Iter) + 1);
+}
+
+static gboolean IterChildren(GtkTreeModel* Model, GtkTreeIter* Iter,
+			     GtkTreeIter* Parent)
+{
+	if (Parent)
+		return FALSE;
+	return RowIter(PHOTO_LIST_MODEL(Model), Iter, 0);
+}
+
+static gboolean IterHasChild(GtkTreeModel* Model, GtkTreeIter* Iter)
+{
+	return FALSE;
+}
+
+static gint IterNChildren(GtkTreeModel* Model, GtkTreeIter* Iter)
+{
+	if (Iter)
+		return 0;
+	return *PHOTO_LIST_MODEL(Model)->NumPhotos;
+}
+
+static gboolean IterNthChild(GtkTreeModel* Model, GtkTreeIter* Iter,
+			     GtkTreeIter* Parent, gint N)
+{
+	if (Parent)
+		return FALSE;
+	return RowIter(PHOTO_LIST_MODEL(Model), Iter, N);
+}
+
+static gboolean IterParent(GtkTreeModel* Model, GtkTreeIter* Iter,
+			   GtkTreeIter* Child)
+{
+	return FALSE;
+}
+
+static void TreeModelInit(GtkTreeModelIface* Iface)
+{
+	Iface->get_flags = GetFlags;
+	Iface->get_n_columns = GetNColumns;
+	Iface->get_column_type = GetColumnType;
+	Iface->get_iter = GetIter;
+	Iface->get_path = GetPath;
+	Iface->get_value = GetValue;
+	Iface->iter_next = IterNext;
+	Iface->iter_children = IterChildren;
+	Iface->iter_has_child = IterHasChild;
+	Iface->iter_n_children = IterNChildren;
+	Iface->iter_nth_child = IterNthChild;
+	Iface->iter_parent = IterParent;
+}
+
+static void PhotoListModelInit(PhotoListModel* List)
+{
+	List->Stamp = g_random_int();
+}
+
+GType PhotoListModelType(void)
+{
+	static GType Type = 0;
+	if (Type)
+		return Type;
+
+	static const GTypeInfo Info = {
+		sizeof(PhotoListModelClass),
+		NULL, NULL, NULL, NULL, NULL,
+		sizeof(PhotoListModel),
+		0,
+		(GInstanceInitFunc) PhotoListModelInit,
+		NULL
+	};
+	static const GInterfaceInfo TreeModelInfo = {
+		(GInterfaceInitFunc) TreeModelInit,
+		NULL,
+		NULL
+	};
+
+	Type = g_type_register_static(G_TYPE_OBJECT, "GpsCorrelatePhotoList",
+			&Info, (GTypeFlags) 0);
+	g_type_add_interface_static(Type, GTK_TYPE_TREE_MODEL, &TreeModelInfo);
+	return Type;
+}
+
+GtkTreeModel* NewPhotoListModel(struct GUIPhoto** Photos, int* NumPhotos)
+{
+	PhotoListModel* List = PHOTO_LIST_MODEL(g_object_new(PhotoListModelType(), NULL));
+	List->Photos = Photos;
+	List->NumPhotos = NumPhotos;
+	return GTK_TREE_MODEL(List);
+}
+
+void PhotoRowInserted(GtkTreeModel* Model, int Index)
+{
+	GtkTreeIter Iter;
+	if (!RowIter(PHOTO_LIST_MODEL(Model), &Iter, Index))
+		return;
+	GtkTreePath* Path = gtk_tree_path_new_from_indices(Index, -1);
+	gtk_tree_model_row_inserted(Model, Path, &Iter);
+	gtk_tree_path_free(Path);
+}
+
+void PhotoRowDeleted(GtkTreeModel* Model, int Index)
+{
+	GtkTreePath* Path = gtk_tree_path_new_from_indices(Index, -1);
+	gtk_tree_model_row_deleted(Model, Path);
+	gtk_tree_path_free(Path);
+}
+
+void PhotoRowsChanged(GtkTreeModel* Model, int First, int Last)
+{
+	GtkTreeIter Iter;
+	GtkTreePath* Path = gtk_tree_path_new_from_indices(First, -1);
+	int Index;
+	for (Index = First; Index <= Last; Index++)
+	{
+		if (!RowIter(PHOTO_LIST_MODEL(Model), &Iter, Index))
+			break;
+		gtk_tree_model_row_changed(Model, Path, &Iter);
+		gtk_tree_path_next(Path);
+	}
+	gtk_tree_path_free(Path);
+}
@@ -0,0 +1,58 @@
+/* photo-list.h
+ *
+ * This file contains the photo list of the GUI, and the prototypes
+ * for the GtkTreeModel in photo-list.c that shows it.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/types.h>
+
+/* The columns of the model. */
+enum
+{
+	LIST_FILENAME,
+	LIST_LAT,
+	LIST_LONG,
+	LIST_ELEV,
+	LIST_TIME,
+	LIST_STATE,
+	LIST_NOCOLUMNS
+};
+
+/* One photo in the list. */
+struct GUIPhoto {
+	char* Filename;
+	char* Time;             /* From the EXIF data; NULL if none (yet). */
+	time_t Epoch;           /* Time, taken as UTC; 0 without it. */
+	double Lat, Long, Elev;
+	int IncludesGPS;        /* Lat, Long and Elev are worth showing. */
+	int GPSInFile;          /* The photo itself has GPS data. */
+	const char* State;      /* Shown as is; NULL to go by the above. */
+};
+
+/* Makes a model with a row for each of the *NumPhotos photos at
+ * *Photos. Nothing is copied: cells are made up from the photos as
+ * they are asked for, which is only for the rows on the screen. So
+ * the model must be told of every row added, taken out or changed,
+ * once Photos and NumPhotos say so. */
+GtkTreeModel* NewPhotoListModel(struct GUIPhoto** Photos, int* NumPhotos);
+
+void PhotoRowInserted(GtkTreeModel* Model, int Index);
+void PhotoRowDeleted(GtkTreeModel* Model, int Index);
+void PhotoRowsChanged(GtkTreeModel* Model, int First, int Last);
@@ -0,0 +1,316 @@
+/* pipeline.c
+ *
+ * This file correlates photos in three stages, each on its own pool
+ * of threads: reading the time from the photo, matching it to the
+ * tracks, and writing the position back. Reading and writing wait on
+ * the disk, and matching on the CPU, so with the stages apart each
+ * can be kept busy by as many threads as suit it.
+ *
+ * Each pool only lets so many photos wait for it, so a stage that
+ * gets ahead is held back until the next one catches up, and a long
+ * list of photos isn't all in memory at once.
+ *
+ * Photos finish in whatever order the threads get through them, but
+ * they're handed back in the order they were given, so that what's
+ * shown and recorded is the same from one run to the next.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "gpsstructure.h"
+#include "exif-gps.h"
+#include "correlate.h"
+#include "stats.h"
+#include "workpool.h"
+#include "throttle.h"
+#include "pipeline.h"
+
+/* Photos that may wait for each stage. */
+#define PIPELINE_QUEUE 256
+
+/* Photos that may be in the pipeline at once, from being given to it
+ * to being handed back, including those finished but waiting their
+ * turn to be handed back. */
+#define PIPELINE_PHOTOS (4 * PIPELINE_QUEUE)
+
+struct Pipeline {
+	struct CorrelateOptions Options;
+	struct WorkPool* Readers;
+	struct WorkPool* Matchers;
+	struct WorkPool* Writers;
+	struct Throttle* Throttle; /* Over the writers, or NULL. */
+	PipelineDone Done;
+	void* Data;
+	int Cancelled;             /* Set atomically. */
+
+	/* Photos finished, waiting to be handed back in order. */
+	pthread_mutex_t OrderLock; /* Over these four. */
+	pthread_cond_t Returned;   /* Next went up. */
+	struct PipelineJob* Finished[PIPELINE_PHOTOS];
+	long Given;                /* Photos given to PipelinePhoto, */
+	long Next;                 /* and the next one to hand back. */
+};
+
+struct PipelineJob {
+	long Number;               /* From 0, in the order given. */
+	int Dropped;               /* Cancelled: not to be handed back. */
+	char* File;
+	char* Time;                /* From CorrelateRead. */
+	struct GPSPoint* Point;    /* From CorrelateMatch. */
+	struct CorrelateOptions Options;
+	long long Began;           /* For --stats. */
+};
+
+static void ReadStage(void* Data, void* PipelineData);
+static void MatchStage(void* Data, void* PipelineData);
+static void WriteStage(void* Data, void* PipelineData);
+
+/* Hands Job on to the next stage, or does that here if it can't. */
+static void PassOn(struct Pipeline* Pipeline, struct WorkPool* Pool,
+		   WorkFunction Stage, struct PipelineJob* Job)
+{
+	if (!AddWork(Pool, Job))
+		Stage(Job, Pipeline);
+}
+
+static void FreeJob(struct PipelineJob* Job)
+{
+	free(Job->File);
+	free(Job->Time);
+	free(Job->Point);
+	free(Job);
+}
+
+/* The photo has gone as far as it's going. It's handed back once
+ * every photo given before it has been, so this may hand back several
+ * that were waiting on it, or none. Done is called with OrderLock
+ * held, which keeps the calls in order. */
+static void FinishJob(struct Pipeline* Pipeline, struct PipelineJob* Job)
+{
+	if (!Job->Dropped)
+		StatsEndFile(STATS_PHOTO, Job->Began, Job->File);
+
+	pthread_mutex_lock(&Pipeline->OrderLock);
+	Pipeline->Finished[Job->Number % PIPELINE_PHOTOS] = Job;
+	while ((Job = Pipeline->Finished[Pipeline->Next % PIPELINE_PHOTOS]) != NULL)
+	{
+		Pipeline->Finished[Pipeline->Next % PIPELINE_PHOTOS] = NULL;
+		Pipeline->Next++;
+		if (!Job->Dropped)
+		{
+			Pipeline->Done(Job->File, Job->Point, &Job->Options, Pipeline->Data);
+			Job->Point = NULL;
+		}
+		FreeJob(Job);
+		pthread_cond_signal(&Pipeline->Returned);
+	}
+	pthread_mutex_unlock(&Pipeline->OrderLock);
+}
+
+/* Cancelled: the photo goes no further, and isn't handed back. */
+static void DropJob(struct Pipeline* Pipeline, struct PipelineJob* Job)
+{
+	Job->Dropped = 1;
+	FinishJob(Pipeline, Job);
+}
+
+static int Cancelled(struct Pipeline* Pipeline)
+{
+	return __atomic_load_n(&Pipeline->Cancelled, __ATOMIC_RELAXED);
+}
+
+void ReadStage(void* Data, void* PipelineData)
+{
+	struct PipelineJob* Job = (struct PipelineJob*) Data;
+	struct Pipeline* Pipeline = (struct Pipeline*) PipelineData;
+
+	if (Cancelled(Pipeline))
+	{
+		DropJob(Pipeline, Job);
+		return;
+	}
+	Job->Time = CorrelateRead(Job->File, &Job->Options);
+	if (!Job->Time)
+		FinishJob(Pipeline, Job);
+	else
+		PassOn(Pipeline, Pipeline->Matchers, MatchStage, Job);
+}
+
+void MatchStage(void* Data, void* PipelineData)
+{
+	struct PipelineJob* Job = (struct PipelineJob*) Data;
+	struct Pipeline* Pipeline = (struct Pipeline*) PipelineData;
+
+	if (Cancelled(Pipeline))
+	{
+		DropJob(Pipeline, Job);
+		return;
+	}
+	Job->Point = CorrelateMatch(Job->Time, &Job->Options);
+	Job->Time = NULL;
+
+	if (!Job->Point || Job->Options.NoWriteExif)
+		FinishJob(Pipeline, Job);
+	else
+		PassOn(Pipeline, Pipeline->Writers, WriteStage, Job);
+}
+
+void WriteStage(void* Data, void* PipelineData)
+{
+	struct PipelineJob* Job = (struct PipelineJob*) Data;
+	struct Pipeline* Pipeline = (struct Pipeline*) PipelineData;
+
+	if (Cancelled(Pipeline))
+	{
+		DropJob(Pipeline, Job);
+		return;
+	}
+	if (Pipeline->Throttle)
+	{
+		/* The whole file gets written again. */
+		struct stat Info;
+		long long Bytes = stat(Job->File, &Info) == 0 ? Info.st_size : 0;
+		long long Began = ThrottleBegin(Pipeline->Throttle, Bytes);
+		CorrelateWrite(Job->File, Job->Point, &Job->Options);
+		ThrottleEnd(Pipeline->Throttle, Began, Bytes);
+	} else {
+		CorrelateWrite(Job->File, Job->Point, &Job->Options);
+	}
+	FinishJob(Pipeline, Job);
+}
+
+struct Pipeline* StartPipeline(const struct CorrelateOptions* Options,
+			       int Readers, int Matchers,
+			       int MinWriters, int Writers, double MaxWriteMB,
+			       PipelineDone Done, void* Data)
+{
+	struct Pipeline* Pipeline = (struct Pipeline*) calloc(1, sizeof(*Pipeline));
+	if (!Pipeline)
+		return NULL;
+	Pipeline->Options = *Options;
+	Pipeline->Done = Done;
+	Pipeline->Data = Data;
+	pthread_mutex_init(&Pipeline->OrderLock, NULL);
+	pthread_cond_init(&Pipeline->Returned, NULL);
+
+	InitExif();
+	Pipeline->Readers = StartWorkPool("reader", Readers, PIPELINE_QUEUE, ReadStage, Pipeline);
+	Pipeline->Matchers = StartWorkPool("matcher", Matchers, PIPELINE_QUEUE, MatchStage, Pipeline);
+	Pipeline->Writers = StartWorkPool("writer", Writers, PIPELINE_QUEUE, WriteStage, Pipeline);
+	if (!Pipeline->Readers || !Pipeline->Matchers || !Pipeline->Writers)
+	{
+		/* Nothing has been queued, so these stop straight away. */
+		if (Pipeline->Readers)
+			FinishWorkPool(Pipeline->Readers);
+		if (Pipeline->Matchers)
+			FinishWorkPool(Pipeline->Matchers);
+		if (Pipeline->Writers)
+			FinishWorkPool(Pipeline->Writers);
+		pthread_cond_destroy(&Pipeline->Returned);
+		pthread_mutex_destroy(&Pipeline->OrderLock);
+		free(Pipeline);
+		return NULL;
+	}
+
+	/* There are as many writers as there can ever be writing at
+	 * once; the throttle says how many of them may. */
+	Writers = WorkPoolThreads(Pipeline->Writers);
+	if ((MinWriters > 0 && MinWriters < Writers) || MaxWriteMB > 0)
+		Pipeline->Throttle = StartThrottle(MinWriters, Writers, MaxWriteMB);
+	return Pipeline;
+}
+
+int PipelinePhoto(struct Pipeline* Pipeline, const char* File)
+{
+	struct PipelineJob* Job = (struct PipelineJob*) calloc(1, sizeof(*Job));
+	if (!Job)
+		return 0;
+	Job->File = strdup(File);
+	Job->Options = Pipeline->Options;
+	if (!Job->File)
+	{
+		FreeJob(Job);
+		return 0;
+	}
+
+	/* Wait for room to keep it until it can be handed back. */
+	pthread_mutex_lock(&Pipeline->OrderLock);
+	while (Pipeline->Given - Pipeline->Next >= PIPELINE_PHOTOS)
+		pthread_cond_wait(&Pipeline->Returned, &Pipeline->OrderLock);
+	Job->Number = Pipeline->Given++;
+	pthread_mutex_unlock(&Pipeline->OrderLock);
+	Job->Began = StatsBegin();
+
+	if (Pipeline->Options.AutoTimeZone)
+	{
+		/* The first photo with a time works out the time zone for
+		 * all the rest, as CorrelatePhoto does. So until one has,
+		 * each is done here and now, in the order given. */
+		Job->Time = CorrelateRead(Job->File, &Job->Options);
+		if (!Job->Time)
+		{
+			FinishJob(Pipeline, Job);
+			return 1;
+		}
+		Job->Point = CorrelateMatch(Job->Time, &Job->Options);
+		Job->Time = NULL;
+		Pipeline->Options.AutoTimeZone = 0;
+		Pipeline->Options.TimeZoneHours = Job->Options.TimeZoneHours;
+		Pipeline->Options.TimeZoneMins = Job->Options.TimeZoneMins;
+		if (!Job->Point || Job->Options.NoWriteExif)
+			FinishJob(Pipeline, Job);
+		else
+			WriteStage(Job, Pipeline);
+		return 1;
+	}
+
+	/* It has its place in the order now, so it must be done. */
+	PassOn(Pipeline, Pipeline->Readers, ReadStage, Job);
+	return 1;
+}
+
+void CancelPipeline(struct Pipeline* Pipeline)
+{
+	__atomic_store_n(&Pipeline->Cancelled, 1, __ATOMIC_RELAXED);
+}
+
+void FinishPipeline(struct Pipeline* Pipeline,
+		    struct CorrelateOptions* Options)
+{
+	/* Each stage only passes photos on to the ones after it. */
+	FinishWorkPool(Pipeline->Readers);
+	FinishWorkPool(Pipeline->Matchers);
+	FinishWorkPool(Pipeline->Writers);
+	FinishThrottle(Pipeline->Throttle);
+
+	if (Options && Options->AutoTimeZone && !Pipeline->Options.AutoTimeZone)
+	{
+		Options->AutoTimeZone = 0;
+		Options->TimeZoneHours = Pipeline->Options.TimeZoneHours;
+		Options->TimeZoneMins = Pipeline->Options.TimeZoneMins;
+	}
+	pthread_cond_destroy(&Pipeline->Returned);
+	pthread_mutex_destroy(&Pipeline->OrderLock);
+	free(Pipeline);
+}
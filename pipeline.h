@@ -0,0 +1,63 @@
+/* pipeline.h
+ *
+ * This file contains the prototypes for correlating photos in
+ * stages, in pipeline.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct Pipeline;
+struct GPSPoint;
+struct CorrelateOptions;
+
+/* Called once for each photo, when it has gone as far as it's going,
+ * with what CorrelatePhoto would have returned (Done's to free) and
+ * left in Options. Photos are handed back one at a time, in the order
+ * they were given to PipelinePhoto, on whichever thread finished the
+ * last of them. */
+typedef void (*PipelineDone)(const char* File, struct GPSPoint* Point,
+			     struct CorrelateOptions* Options, void* Data);
+
+/* Starts Readers threads reading photos, Matchers matching them and
+ * Writers writing them; 0 picks one for each CPU. With MinWriters
+ * below that, only as many write at once as turn out to get the most
+ * written, but never fewer than MinWriters. With MaxWriteMB above 0,
+ * writes are spaced out to write no more megabytes a second than
+ * that. Each photo is correlated with its own copy of Options.
+ * Returns NULL on failure. */
+struct Pipeline* StartPipeline(const struct CorrelateOptions* Options,
+			       int Readers, int Matchers,
+			       int MinWriters, int Writers, double MaxWriteMB,
+			       PipelineDone Done, void* Data);
+
+/* Queues File, waiting while the readers have plenty in hand already.
+ * With AutoTimeZone, photos are done there and then, until one has a
+ * time to work the time zone out from; the rest all use that zone.
+ * Returns 0 if it couldn't be queued. */
+int PipelinePhoto(struct Pipeline* Pipeline, const char* File);
+
+/* Drops every photo not yet started on at each stage. Done isn't
+ * called for those. */
+void CancelPipeline(struct Pipeline* Pipeline);
+
+/* Waits for the photos queued to be done, then stops the threads and
+ * frees everything. With AutoTimeZone, the time zone the first photo
+ * with a time gave is put in Options, as CorrelatePhoto would have
+ * done. */
+void FinishPipeline(struct Pipeline* Pipeline,
+		    struct CorrelateOptions* Options);
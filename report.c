@@ -0,0 +1,171 @@
+/* report.c
+ *
+ * This file writes the --report output: one JSON object per line
+ * for each photo, saying what happened to it and how long each
+ * step took, for feeding into other tools.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include <time.h>
+
+#include "i18n.h"
+#include "gpsstructure.h"
+#include "correlate.h"
+#include "report.h"
+
+/* The report is written in large blocks, rather than a line at a
+ * time, so that it costs next to nothing. */
+#define REPORT_BUFFER (64 * 1024)
+
+struct Report {
+	FILE* Out;
+	char* Buffer;
+};
+
+const char* ResultName(int Result)
+{
+	switch (Result)
+	{
+		case CORR_OK:            return "exact";
+		case CORR_INTERPOLATED:  return "interpolated";
+		case CORR_ROUND:         return "rounded";
+		case CORR_NOMATCH:       return "nomatch";
+		case CORR_TOOFAR:        return "toofar";
+		case CORR_EXIFWRITEFAIL: return "writefail";
+		case CORR_NOEXIFINPUT:   return "nodate";
+		case CORR_GPSDATAEXISTS: return "gpsexists";
+		case CORR_UNCHANGED:     return "unchanged";
+	}
+	return "unknown";
+}
+
+struct Report* OpenReport(const char* Format, FILE* Out)
+{
+	if (strcmp(Format, "jsonl") != 0)
+	{
+		fprintf(stderr, _("Unknown report format %s.\n"), Format);
+		return NULL;
+	}
+
+	struct Report* Report = (struct Report*) calloc(1, sizeof(*Report));
+	if (!Report)
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		return NULL;
+	}
+	Report->Out = Out;
+	Report->Buffer = (char*) malloc(REPORT_BUFFER);
+	if (Report->Buffer)
+		setvbuf(Out, Report->Buffer, _IOFBF, REPORT_BUFFER);
+	return Report;
+}
+
+void CloseReport(struct Report* Report)
+{
+	if (!Report)
+		return;
+	fclose(Report->Out);
+	free(Report->Buffer);
+	free(Report);
+}
+
+/* Writes a JSON string. Bytes outside ASCII are passed through as they
+ * are, so names are only valid JSON if they're valid UTF-8. */
+static void WriteString(FILE* Out, const char* Str)
+{
+	const unsigned char* c;
+
+	putc('"', Out);
+	for (c = (const unsigned char*) Str; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			putc('\\', Out);
+			putc(*c, Out);
+		} else if (*c < 0x20) {
+			fprintf(Out, "\\u%04x", *c);
+		} else {
+			putc(*c, Out);
+		}
+	}
+	putc('"', Out);
+}
+
+static void WriteIndex(FILE* Out, const char* Name, int Index)
+{
+	if (Index >= 0)
+		fprintf(Out, ",\"%s\":%d", Name, Index);
+	else
+		fprintf(Out, ",\"%s\":null", Name);
+}
+
+/* Writes Value with Decimals places. JSON numbers always use a decimal
+ * point, but printf() uses the locale's. Setting LC_NUMERIC around this
+ * isn't safe with other threads reading photos or GPX files at the
+ * same time, so the locale's point is swapped for "." afterwards. */
+static void WriteNumber(FILE* Out, const char* Name, double Value, int Decimals)
+{
+	const char* Point = localeconv()->decimal_point;
+	char Text[400];
+	char* At;
+
+	snprintf(Text, sizeof(Text), "%.*f", Decimals, Value);
+	if (strcmp(Point, ".") != 0 && (At = strstr(Text, Point)) != NULL)
+	{
+		size_t Length = strlen(Point);
+		*At = '.';
+		memmove(At + 1, At + Length, strlen(At + Length) + 1);
+	}
+	fprintf(Out, ",\"%s\":%s", Name, Text);
+}
+
+void ReportResult(struct Report* Report, const char* File,
+		  const struct GPSPoint* Point,
+		  const struct CorrelateOptions* Options)
+{
+	FILE* Out;
+
+	if (!Report)
+		return;
+	Out = Report->Out;
+
+	fputs("{\"file\":", Out);
+	WriteString(Out, File);
+	fprintf(Out, ",\"status\":\"%s\",\"result\":%d",
+		ResultName(Options->Result), Options->Result);
+	if (Point)
+	{
+		WriteNumber(Out, "lat", Point->Lat, 8);
+		WriteNumber(Out, "long", Point->Long, 8);
+		if (Point->ElevDecimals >= 0)
+			WriteNumber(Out, "elev", Point->Elev, 3);
+		else
+			fputs(",\"elev\":null", Out);
+	} else {
+		fputs(",\"lat\":null,\"long\":null,\"elev\":null", Out);
+	}
+	WriteIndex(Out, "track", Options->MatchTrack);
+	WriteIndex(Out, "point", Options->MatchPoint);
+	fprintf(Out, ",\"read_us\":%ld,\"match_us\":%ld,\"write_us\":%ld}\n",
+		Options->ReadMicros, Options->MatchMicros, Options->WriteMicros);
+}
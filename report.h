@@ -0,0 +1,40 @@
+/* report.h
+ *
+ * This file contains the prototypes for the per-photo report
+ * written by report.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct Report;
+struct GPSPoint;
+struct CorrelateOptions;
+
+/* Starts a report in the given format (only "jsonl" so far) on Out,
+ * which the report then owns. Returns NULL if the format is unknown. */
+struct Report* OpenReport(const char* Format, FILE* Out);
+void CloseReport(struct Report* Report);
+
+/* Adds the outcome of CorrelatePhoto for File to the report. Point
+ * is what CorrelatePhoto returned, and may be NULL. */
+void ReportResult(struct Report* Report, const char* File,
+		  const struct GPSPoint* Point,
+		  const struct CorrelateOptions* Options);
+
+/* Returns a short name for a CORR_* result, like "interpolated". */
+const char* ResultName(int Result);
@@ -0,0 +1,203 @@
+/* stats.c
+ *
+ * This file contains the performance counters behind --stats.
+ *
+ * Each stage keeps a count, a total, and a histogram of how long it
+ * took, from which the median and 99th percentile are worked out at
+ * the end. The histogram buckets are a power of two wide, split into
+ * eight, so the percentiles are good to within about 6%. Everything
+ * is updated with atomic adds, so any thread can count.
+ *
+ * The same timings also go into the --trace output, if that's on.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "i18n.h"
+#include "unixtime.h"
+#include "stats.h"
+#include "trace.h"
+
+#define SUB_BUCKETS 8
+#define NUM_BUCKETS ((64 - 2) * SUB_BUCKETS)
+
+struct StageStats {
+	unsigned long long Count;
+	unsigned long long TotalNanos;
+	unsigned long long Buckets[NUM_BUCKETS];
+};
+
+static int Enabled;
+static long long EnabledAt;
+static struct StageStats Stages[STATS_NUM_STAGES];
+static unsigned long long SizeOpened;
+static unsigned long long SizeWritten;
+
+static const char* const StageNames[STATS_NUM_STAGES] = {
+	N_("GPX parse"),
+	N_("Time convert"),
+	N_("EXIF open"),
+	N_("EXIF read"),
+	N_("Track search"),
+	N_("EXIF write"),
+	N_("Whole photo"),
+};
+
+void EnableStats(void)
+{
+	EnabledAt = MonotonicNanos();
+	Enabled = 1;
+}
+
+int StatsEnabled(void)
+{
+	return Enabled;
+}
+
+long long StatsBegin(void)
+{
+	return (Enabled || TraceEnabled()) ? MonotonicNanos() : 0;
+}
+
+/* Values under 8 get a bucket each. After that, each power of two
+ * gets SUB_BUCKETS buckets. */
+static int BucketOf(unsigned long long Nanos)
+{
+	int Top;
+
+	if (Nanos < SUB_BUCKETS)
+		return (int)Nanos;
+	Top = 63 - __builtin_clzll(Nanos);
+	return (Top - 2) * SUB_BUCKETS + (int)((Nanos >> (Top - 3)) & (SUB_BUCKETS - 1));
+}
+
+/* Returns the middle of the range of times that fall in Bucket. */
+static unsigned long long BucketMiddle(int Bucket)
+{
+	int Top;
+	unsigned long long Low, Width;
+
+	if (Bucket < SUB_BUCKETS)
+		return Bucket;
+	Top = Bucket / SUB_BUCKETS + 2;
+	Width = 1ULL << (Top - 3);
+	Low = (unsigned long long)(SUB_BUCKETS + Bucket % SUB_BUCKETS) * Width;
+	return Low + Width / 2;
+}
+
+void StatsEnd(int Stage, long long Began)
+{
+	StatsEndFile(Stage, Began, NULL);
+}
+
+void StatsEndFile(int Stage, long long Began, const char* File)
+{
+	struct StageStats* Stats = &Stages[Stage];
+	long long Ended, Took;
+
+	if (!Began)
+		return;
+	Ended = MonotonicNanos();
+	/* There's a time conversion for every track point, which would
+	 * push everything else out of the trace; the GPX file's own event
+	 * covers them. */
+	if (Stage != STATS_TIME_CONVERT)
+		TraceEvent(StageNames[Stage], Began, Ended, File);
+	if (!Enabled)
+		return;
+	Took = Ended - Began;
+	if (Took < 0)
+		Took = 0;
+
+	__atomic_fetch_add(&Stats->Count, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&Stats->TotalNanos, Took, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&Stats->Buckets[BucketOf(Took)], 1, __ATOMIC_RELAXED);
+}
+
+void StatsSizeOpened(long long Bytes)
+{
+	if (Enabled && Bytes > 0)
+		__atomic_fetch_add(&SizeOpened, Bytes, __ATOMIC_RELAXED);
+}
+
+void StatsSizeWritten(long long Bytes)
+{
+	if (Enabled && Bytes > 0)
+		__atomic_fetch_add(&SizeWritten, Bytes, __ATOMIC_RELAXED);
+}
+
+/* Returns the time that Fraction of the stage's counts came in under. */
+static unsigned long long Percentile(const struct StageStats* Stats, double Fraction)
+{
+	unsigned long long Wanted = (unsigned long long)(Stats->Count * Fraction + 0.5);
+	unsigned long long Seen = 0;
+	int i;
+
+	if (Wanted < 1)
+		Wanted = 1;
+	for (i = 0; i < NUM_BUCKETS; i++)
+	{
+		Seen += Stats->Buckets[i];
+		if (Seen >= Wanted)
+			return BucketMiddle(i);
+	}
+	return 0;
+}
+
+/* Prints a time in whichever unit suits it. */
+static void PrintTime(FILE* Out, unsigned long long Nanos)
+{
+	if (Nanos < 10000ULL)
+		fprintf(Out, " %8lluns", Nanos);
+	else if (Nanos < 10000000ULL)
+		fprintf(Out, " %8.1fus", Nanos / 1e3);
+	else if (Nanos < 10000000000ULL)
+		fprintf(Out, " %8.1fms", Nanos / 1e6);
+	else
+		fprintf(Out, " %8.2fs ", Nanos / 1e9);
+}
+
+void PrintStats(FILE* Out)
+{
+	double Elapsed = (MonotonicNanos() - EnabledAt) / 1e9;
+	int i;
+
+	if (!Enabled)
+		return;
+
+	fprintf(Out, _("\nStage              Count      Total     Median       99th\n"));
+	for (i = 0; i < STATS_NUM_STAGES; i++)
+	{
+		const struct StageStats* Stats = &Stages[i];
+		if (!Stats->Count)
+			continue;
+		fprintf(Out, "%-14s %9llu", _(StageNames[i]), Stats->Count);
+		PrintTime(Out, Stats->TotalNanos);
+		PrintTime(Out, Percentile(Stats, 0.50));
+		PrintTime(Out, Percentile(Stats, 0.99));
+		fprintf(Out, "\n");
+	}
+
+	fprintf(Out, _("Elapsed: %.3f s, %.1f files/sec.\n"), Elapsed,
+		Elapsed > 0 ? Stages[STATS_PHOTO].Count / Elapsed : 0.0);
+	fprintf(Out, _("File size of photos opened: %llu bytes, written: %llu bytes.\n"),
+		SizeOpened, SizeWritten);
+}
@@ -0,0 +1,62 @@
+/* stats.h
+ *
+ * This file contains the prototypes for the performance counters
+ * in stats.c, used by --stats.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The stages that are timed. */
+#define STATS_GPX_PARSE     0 /* ReadGPX */
+#define STATS_TIME_CONVERT  1 /* ConvertToUnixTime */
+#define STATS_EXIF_OPEN     2 /* Opening a photo with Exiv2 */
+#define STATS_EXIF_READ     3 /* readMetadata */
+#define STATS_TRACK_SEARCH  4 /* Finding the photo's place in the tracks */
+#define STATS_EXIF_WRITE    5 /* writeMetadata */
+#define STATS_PHOTO         6 /* A photo, from reading it to writing it */
+#define STATS_NUM_STAGES    7
+
+/* Turns on the counters. Until then, they cost next to nothing. */
+void EnableStats(void);
+int StatsEnabled(void);
+
+/* Returns the time to pass to StatsEnd, or 0 if counting is off. */
+long long StatsBegin(void);
+/* Counts one of Stage, which started at Began. Safe to call from
+ * any thread. Each is also traced, but for STATS_TIME_CONVERT.
+ * StatsEndFile also names the file in the trace. */
+void StatsEnd(int Stage, long long Began);
+void StatsEndFile(int Stage, long long Began, const char* File);
+
+/* Adds up the sizes of the photos opened and written. That's the
+ * whole file, not what was read from the disk: Exiv2 only reads the
+ * parts it needs, and doesn't say how much that was. Check
+ * StatsEnabled() first if the size takes effort to find. */
+void StatsSizeOpened(long long Bytes);
+void StatsSizeWritten(long long Bytes);
+
+/* Prints the totals to Out. */
+void PrintStats(FILE* Out);
+
+#ifdef __cplusplus
+}
+#endif
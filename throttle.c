@@ -0,0 +1,219 @@
+/* throttle.c
+ *
+ * This file decides how many photos are written at once. How many
+ * is best depends on the storage: a local SSD keeps getting quicker
+ * up to lots at once, a single disk is best with a few, and a network
+ * share may take the same time however many there are. So the number
+ * is found by trying: every half second or so it's moved by one, and
+ * it carries on that way while more gets written than ever before,
+ * heads back to the best number found when less does, and comes down
+ * when it makes no difference, since then the extra writes only wait
+ * longer. Comparing with the best rather than with the last half
+ * second stops a run of small losses adding up to a large one. Every
+ * few seconds it tries one more anyway, in case things have changed:
+ * the readers may have been holding the writers up, or other work on
+ * the disk may have finished.
+ *
+ * Writes can also be spaced out so that no more than so many bytes a
+ * second are written, to leave some of a shared disk for others.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "unixtime.h"
+#include "trace.h"
+#include "throttle.h"
+
+/* How long each number of writes at once is tried for, at least. It
+ * must also have had as many writes finish as it allows. */
+#define THROTTLE_WINDOW_MS 500
+
+/* Changes in the rate smaller than this are taken as noise. */
+#define THROTTLE_MARGIN 0.05
+
+/* Every so many windows, try one more write at once. */
+#define THROTTLE_PROBE 8
+
+struct Throttle {
+	pthread_mutex_t Lock;      /* Over everything below. */
+	pthread_cond_t Freed;      /* Active went down, or Limit up. */
+	int Min, Max;
+	int Limit;                 /* Writes allowed at once now, */
+	int Active;                /* and how many are going on. */
+	double NanosPerByte;       /* From MaxMB, or 0 for no limit. */
+	long long NextStart;       /* When the next write may start. */
+
+	/* Since Limit last changed. */
+	long long WindowStart;
+	int WindowWrites;
+	long long WindowBytes;
+	long long WindowNanos;     /* The writes' times, added up. */
+
+	int Step;                  /* Which way Limit last went: +1 or -1. */
+	double BestRate;           /* The most bytes a second yet, */
+	int BestLimit;             /* and with how many at once. */
+	int SinceProbe;            /* Windows since the last try upwards. */
+};
+
+struct Throttle* StartThrottle(int Min, int Max, double MaxMB)
+{
+	struct Throttle* Throttle = (struct Throttle*) calloc(1, sizeof(*Throttle));
+	if (!Throttle)
+		return NULL;
+	if (Max < 1)
+		Max = 1;
+	if (Min < 1 || Min > Max)
+		Min = Max;
+	Throttle->Min = Min;
+	Throttle->Max = Max;
+	/* Start as many as it would have been without this, and see if
+	 * fewer will do. */
+	Throttle->Limit = Max;
+	Throttle->BestLimit = Max;
+	Throttle->Step = -1;
+	if (MaxMB > 0)
+		Throttle->NanosPerByte = 1e9 / (MaxMB * 1000000);
+	Throttle->WindowStart = MonotonicNanos();
+	pthread_mutex_init(&Throttle->Lock, NULL);
+	pthread_cond_init(&Throttle->Freed, NULL);
+	return Throttle;
+}
+
+/* Called with the lock held, once the window is long enough: picks
+ * the limit for the next one. */
+static void Adjust(struct Throttle* Throttle, long long Now)
+{
+	double Rate = Throttle->WindowBytes * 1e9 / (Now - Throttle->WindowStart);
+	double Best = Throttle->BestRate;
+
+	if (Rate > Best * (1 + THROTTLE_MARGIN))
+	{
+		/* Better than ever: carry on the same way. */
+		Throttle->BestRate = Rate;
+		Throttle->BestLimit = Throttle->Limit;
+	} else if (Rate < Best * (1 - THROTTLE_MARGIN)) {
+		if (Throttle->Limit == Throttle->BestLimit)
+		{
+			/* Worse with the best number: something else has
+			 * changed, so what was best is no guide now. Start
+			 * again from here. */
+			Throttle->BestRate = Rate;
+			Throttle->Step = -1;
+		} else {
+			/* Worse: head back to the best. */
+			Throttle->Step = Throttle->BestLimit > Throttle->Limit ? 1 : -1;
+		}
+	} else {
+		/* No better: as much gets written with fewer. */
+		Throttle->Step = -1;
+	}
+
+	if (TraceEnabled())
+	{
+		char Detail[80];
+		snprintf(Detail, sizeof(Detail), "%d at once, %.1f MB/s, %.1f ms each",
+			 Throttle->Limit, Rate / 1000000,
+			 Throttle->WindowNanos / 1e6 / Throttle->WindowWrites);
+		TraceEvent("Writers", Throttle->WindowStart, Now, Detail);
+	}
+
+	int Limit = Throttle->Limit + Throttle->Step;
+	if (Limit < Throttle->Min)
+		Limit = Throttle->Min;
+	if (Limit > Throttle->Max)
+		Limit = Throttle->Max;
+	if (++Throttle->SinceProbe >= THROTTLE_PROBE && Throttle->Limit < Throttle->Max)
+	{
+		/* See if one more helps now. */
+		Limit = Throttle->Limit + 1;
+		Throttle->Step = 1;
+		Throttle->SinceProbe = 0;
+	}
+	if (Limit > Throttle->Limit)
+		pthread_cond_broadcast(&Throttle->Freed);
+	Throttle->Limit = Limit;
+
+	Throttle->WindowStart = Now;
+	Throttle->WindowWrites = 0;
+	Throttle->WindowBytes = 0;
+	Throttle->WindowNanos = 0;
+}
+
+long long ThrottleBegin(struct Throttle* Throttle, long long Bytes)
+{
+	pthread_mutex_lock(&Throttle->Lock);
+	while (Throttle->Active >= Throttle->Limit)
+		pthread_cond_wait(&Throttle->Freed, &Throttle->Lock);
+	Throttle->Active++;
+
+	/* Book a turn: each write takes up as long as its size allows
+	 * at the rate, so they're spaced out from the last one's. */
+	long long Now = MonotonicNanos();
+	long long Start = Now;
+	if (Throttle->NanosPerByte > 0)
+	{
+		if (Throttle->NextStart > Start)
+			Start = Throttle->NextStart;
+		Throttle->NextStart = Start + (long long) (Bytes * Throttle->NanosPerByte);
+	}
+	pthread_mutex_unlock(&Throttle->Lock);
+
+	if (Start > Now)
+	{
+		struct timespec Wait;
+		Wait.tv_sec = (Start - Now) / 1000000000;
+		Wait.tv_nsec = (Start - Now) % 1000000000;
+		nanosleep(&Wait, NULL);
+		Now = MonotonicNanos();
+	}
+	return Now;
+}
+
+void ThrottleEnd(struct Throttle* Throttle, long long Began, long long Bytes)
+{
+	long long Now = MonotonicNanos();
+
+	pthread_mutex_lock(&Throttle->Lock);
+	Throttle->Active--;
+	pthread_cond_signal(&Throttle->Freed);
+
+	Throttle->WindowWrites++;
+	Throttle->WindowBytes += Bytes;
+	Throttle->WindowNanos += Now - Began;
+	if (Throttle->Min < Throttle->Max &&
+	    Now - Throttle->WindowStart >= THROTTLE_WINDOW_MS * 1000000LL &&
+	    Throttle->WindowWrites >= Throttle->Limit)
+	{
+		Adjust(Throttle, Now);
+	}
+	pthread_mutex_unlock(&Throttle->Lock);
+}
+
+void FinishThrottle(struct Throttle* Throttle)
+{
+	if (!Throttle)
+		return;
+	pthread_cond_destroy(&Throttle->Freed);
+	pthread_mutex_destroy(&Throttle->Lock);
+	free(Throttle);
+}
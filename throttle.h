@@ -0,0 +1,38 @@
+/* throttle.h
+ *
+ * This file contains the prototypes for limiting how many photos are
+ * written at once, and how fast, in throttle.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct Throttle;
+
+/* Lets between Min and Max writes happen at once, settling on however
+ * many get the most written, and no more than MaxMB megabytes a second
+ * if MaxMB is above 0. With Min the same as Max, the number is fixed.
+ * Returns NULL on failure. */
+struct Throttle* StartThrottle(int Min, int Max, double MaxMB);
+
+/* Waits until a write of Bytes may start, and returns the time to
+ * pass to ThrottleEnd once it's finished. Safe to call from any
+ * thread. */
+long long ThrottleBegin(struct Throttle* Throttle, long long Bytes);
+void ThrottleEnd(struct Throttle* Throttle, long long Began, long long Bytes);
+
+void FinishThrottle(struct Throttle* Throttle);
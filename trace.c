@@ -0,0 +1,222 @@
+/* trace.c
+ *
+ * This file records a trace of a run for --trace, in the trace
+ * event format that chrome://tracing and Perfetto read.
+ *
+ * Events go into a fixed ring, so tracing a run of any length
+ * costs the same memory and no allocation; only the most recent
+ * TRACE_EVENTS survive. The ring is written out as JSON at exit.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <locale.h>
+#include <time.h>
+
+#include "i18n.h"
+#include "unixtime.h"
+#include "trace.h"
+
+#define TRACE_EVENTS  32768
+#define TRACE_THREADS 256
+#define DETAIL_SIZE   104
+
+struct TraceRecord {
+	const char* Name;
+	int Thread;
+	long long Began;
+	long long Ended;
+	char Detail[DETAIL_SIZE];
+};
+
+static int Tracing;
+static char* TraceFile;
+static long long StartedAt;
+static struct TraceRecord* Ring;
+static unsigned long Next;     /* Total events ever recorded. */
+static int NumThreads;
+static const char* ThreadNames[TRACE_THREADS];
+static __thread int ThisThread; /* 1 + index into ThreadNames, or 0. */
+
+static void WriteTrace(void)
+{
+	StopTrace();
+}
+
+int StartTrace(const char* File)
+{
+	FILE* Out = fopen(File, "w");
+	if (!Out)
+	{
+		fprintf(stderr, _("Unable to open trace file %s.\n"), File);
+		return 0;
+	}
+	fclose(Out);
+
+	Ring = (struct TraceRecord*) calloc(TRACE_EVENTS, sizeof(*Ring));
+	TraceFile = strdup(File);
+	if (!Ring || !TraceFile)
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		free(Ring);
+		free(TraceFile);
+		return 0;
+	}
+
+	StartedAt = MonotonicNanos();
+	Tracing = 1;
+	TraceThreadName("main");
+	atexit(WriteTrace);
+	return 1;
+}
+
+int TraceEnabled(void)
+{
+	return Tracing;
+}
+
+static int CurrentThread(void)
+{
+	if (!ThisThread)
+	{
+		int Id = __atomic_fetch_add(&NumThreads, 1, __ATOMIC_RELAXED);
+		ThisThread = (Id < TRACE_THREADS ? Id : TRACE_THREADS - 1) + 1;
+	}
+	return ThisThread - 1;
+}
+
+void TraceThreadName(const char* Name)
+{
+	/* Threads only get a number once they're in the trace. */
+	if (!Tracing)
+		return;
+	ThreadNames[CurrentThread()] = Name;
+}
+
+void TraceEvent(const char* Name, long long Began, long long Ended,
+		const char* Detail)
+{
+	struct TraceRecord* Record;
+
+	if (!Tracing)
+		return;
+
+	Record = &Ring[__atomic_fetch_add(&Next, 1, __ATOMIC_RELAXED) % TRACE_EVENTS];
+	Record->Name = Name;
+	Record->Thread = CurrentThread();
+	Record->Began = Began;
+	Record->Ended = Ended;
+	Record->Detail[0] = '\0';
+	if (Detail)
+	{
+		size_t Length = strlen(Detail);
+		if (Length >= DETAIL_SIZE)
+			Detail += Length - (DETAIL_SIZE - 1);
+		strcpy(Record->Detail, Detail);
+	}
+}
+
+/* Writes a JSON string, as in report.c. */
+static void WriteString(FILE* Out, const char* Str)
+{
+	const unsigned char* c;
+
+	putc('"', Out);
+	for (c = (const unsigned char*) Str; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			putc('\\', Out);
+			putc(*c, Out);
+		} else if (*c < 0x20) {
+			fprintf(Out, "\\u%04x", *c);
+		} else {
+			putc(*c, Out);
+		}
+	}
+	putc('"', Out);
+}
+
+void StopTrace(void)
+{
+	unsigned long First, Last, i;
+	int Thread;
+	FILE* Out;
+
+	if (!Tracing)
+		return;
+	Tracing = 0;
+
+	Out = fopen(TraceFile, "w");
+	if (!Out)
+	{
+		fprintf(stderr, _("Unable to open trace file %s.\n"), TraceFile);
+		return;
+	}
+
+	/* Trace timestamps are microseconds, with a decimal point. */
+	char* OldLocale = setlocale(LC_NUMERIC, NULL);
+	if (OldLocale)
+		OldLocale = strdup(OldLocale);
+	setlocale(LC_NUMERIC, "C");
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", Out);
+	fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+	      "\"args\":{\"name\":\"gpscorrelate\"}}", Out);
+	for (Thread = 0; Thread < NumThreads && Thread < TRACE_THREADS; Thread++)
+	{
+		if (!ThreadNames[Thread])
+			continue;
+		fprintf(Out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"tid\":%d,\"args\":{\"name\":", Thread);
+		WriteString(Out, ThreadNames[Thread]);
+		fputs("}}", Out);
+	}
+
+	Last = Next;
+	First = Last > TRACE_EVENTS ? Last - TRACE_EVENTS : 0;
+	for (i = First; i < Last; i++)
+	{
+		const struct TraceRecord* Record = &Ring[i % TRACE_EVENTS];
+		fputs(",\n{\"name\":", Out);
+		WriteString(Out, Record->Name);
+		fprintf(Out, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+			Record->Thread, (Record->Began - StartedAt) / 1e3,
+			(Record->Ended - Record->Began) / 1e3);
+		if (Record->Detail[0])
+		{
+			fputs(",\"args\":{\"file\":", Out);
+			WriteString(Out, Record->Detail);
+			fputs("}", Out);
+		}
+		fputs("}", Out);
+	}
+	fputs("\n]}\n", Out);
+	fclose(Out);
+
+	if (OldLocale)
+	{
+		setlocale(LC_NUMERIC, OldLocale);
+		free(OldLocale);
+	}
+	free(Ring);
+	Ring = NULL;
+}
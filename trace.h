@@ -0,0 +1,47 @@
+/* trace.h
+ *
+ * This file contains the prototypes for the trace recorder in
+ * trace.c, used by --trace.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Starts recording. The trace is written to File when the program
+ * exits, or when StopTrace is called. Call it only once. Returns 0 if
+ * File can't be written. */
+int StartTrace(const char* File);
+void StopTrace(void);
+int TraceEnabled(void);
+
+/* Records that Name ran from Began to Ended (MonotonicNanos times) on
+ * the calling thread. Name must be a string constant. Detail, if not
+ * NULL, is copied, but only the end of a long one is kept. */
+void TraceEvent(const char* Name, long long Began, long long Ended,
+		const char* Detail);
+
+/* Names the calling thread in the trace. Name must be a string
+ * constant. */
+void TraceThreadName(const char* Name);
+
+#ifdef __cplusplus
+}
+#endif
@@ -31,32 +31,39 @@
 #include <string.h>
 
 #include "unixtime.h"
-
-/* Some systems have a version of this called timegm(), but it's not portable */
-static time_t portable_timegm(struct tm *tm)
+#include "stats.h"
+
+/* Some systems have a version of this called timegm(), but it's not
+ * portable. Setting TZ to UTC around mktime() used to do the job, but
+ * that's slow and changes the environment under any other threads, so
+ * this works the day out directly instead. As mktime() does, it copes
+ * with fields outside their usual ranges. */
+static time_t portable_timegm(const struct tm *tm)
 {
-	static const char *tz;
-
-        if (!tz) {
-		tz = getenv("TZ");
-		if (tz)
-			/* Copy the string, since it's only guaranteed to be
-			 * valid until the next getenv or setenv */
-			tz = strdup(tz);
+	/* Bring the month into range first. */
+	long long Year = tm->tm_year + 1900LL + tm->tm_mon / 12;
+	int Month = tm->tm_mon % 12;
+	if (Month < 0)
+	{
+		Month += 12;
+		Year--;
 	}
 
-	/* Set an empty TZ to force UTC */
-	setenv("TZ", "", 1);
-	tzset();
-	time_t ret = mktime(tm);
-
-	/* Restore the original TZ */
-	if (tz)
-	   setenv("TZ", tz, 1);
-	else
-	   unsetenv("TZ");
-	tzset();
-	return ret;
+	/* Count days in a calendar whose years start in March, so that
+	 * leap days fall at the end of each year, from 1 March of year 0
+	 * (which is 719468 days before 1970). Every 400 years is exactly
+	 * 146097 days. */
+	if (Month < 2)
+		Year--;
+	long long Cycle = (Year >= 0 ? Year : Year - 399) / 400;
+	long long YearOfCycle = Year - Cycle * 400;
+	int DayOfYear = (153 * (Month < 2 ? Month + 10 : Month - 2) + 2) / 5;
+	long long Days = Cycle * 146097 + YearOfCycle * 365 + YearOfCycle / 4
+		- YearOfCycle / 100 + DayOfYear
+		- 719468 + tm->tm_mday - 1;
+
+	return (time_t)(Days * 86400 + tm->tm_hour * 3600LL
+			+ tm->tm_min * 60LL + tm->tm_sec);
 }
 
 time_t ConvertToUnixTime(const char* StringTime, const char* Format,
@@ -74,18 +81,19 @@ time_t ConvertToUnixTime(const char* StringTime, const char* Format,
 		return 0;
 	}
 
+	/* Only counted, not traced, so don't read the clock just for the trace. */
+	long long Began = StatsEnabled() ? StatsBegin() : 0;
+
 	/* Define and set up our structure. */
 	struct tm Time;
-	Time.tm_wday = 0;
-	Time.tm_yday = 0;
-	Time.tm_isdst = 0; // there is no DST in UTC
+	memset(&Time, 0, sizeof(Time));
 
 	/* Read out the time from the string using our format. */
 	sscanf(StringTime, Format, &Time.tm_year, &Time.tm_mon,
 			&Time.tm_mday, &Time.tm_hour,
 			&Time.tm_min, &Time.tm_sec);
 
-	/* Adjust the years for the mktime function to work. */
+	/* Adjust the years and months to what struct tm holds. */
 	Time.tm_year -= 1900;
 	Time.tm_mon  -= 1;
 
@@ -98,6 +106,28 @@ time_t ConvertToUnixTime(const char* StringTime, const char* Format,
 	thetime -= TZOffsetHours * 60 * 60;
 	thetime -= TZOffsetMinutes * 60;
 
+	StatsEnd(STATS_TIME_CONVERT, Began);
 	return thetime;
 }
 
+void BreakDownUTC(time_t Time, struct tm* Result)
+{
+#ifdef _WIN32
+	/* There gmtime() keeps a buffer for each thread. */
+	*Result = *gmtime(&Time);
+#else
+	gmtime_r(&Time, Result);
+#endif
+}
+
+long long MonotonicNanos(void)
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC, &Now);
+	return (long long)Now.tv_sec * 1000000000 + Now.tv_nsec;
+}
+
+long long MonotonicMicros(void)
+{
+	return MonotonicNanos() / 1000;
+}
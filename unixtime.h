@@ -33,3 +33,13 @@
 time_t ConvertToUnixTime(const char* StringTime, const char* Format,
 		int TZOffsetHours, int TZOffsetMinutes);
 
+/* gmtime(), but into Result rather than a buffer shared by every
+ * thread. */
+struct tm;
+void BreakDownUTC(time_t Time, struct tm* Result);
+
+/* Return readings of a clock that only ever goes forward, in
+ * nanoseconds or microseconds. They're only good for timing things. */
+long long MonotonicNanos(void);
+long long MonotonicMicros(void);
+
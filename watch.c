@@ -0,0 +1,361 @@
+/* watch.c
+ *
+ * This file watches a directory for photos as they arrive, and the
+ * GPX files for changes, for --watch.
+ *
+ * Linux's inotify says when a file has been written and closed, or
+ * moved into place, so nothing is ever scanned. A photo is only handed
+ * over once nothing more has happened to it for a moment, since some
+ * programs write a file in several goes.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "i18n.h"
+#include "unixtime.h"
+#include "dirwalk.h"
+#include "watch.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#define WATCH_QUIET_MS   500  /* How long a file must be left alone. */
+#define WATCH_IGNORE_MS  2000 /* How long to ignore our own writes. */
+
+/* A file that something has happened to. */
+struct WatchedFile {
+	char* Path;
+	int Track;                 /* Index in the track files, or -1. */
+	long long Due;             /* When to hand it over, or when to
+				      stop ignoring it. */
+	int Ignore;                /* We wrote it; pay no attention. */
+	struct WatchedFile* Next;
+};
+
+struct TrackFile {
+	const char* Path;          /* As given on the command line. */
+	int Wd;                    /* Watch on its directory. */
+	const char* Name;          /* Its name in that directory. */
+};
+
+struct Watcher {
+	int Fd;
+	int PhotoWd;
+	char* PhotoDir;
+	struct TrackFile* Tracks;
+	int NumTracks;
+	struct WatchedFile* Files;
+	char* Current;             /* Last name handed out. */
+};
+
+static const unsigned int WatchMask = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+static long long NowMillis(void)
+{
+	return MonotonicNanos() / 1000000;
+}
+
+static struct WatchedFile* FindFile(struct Watcher* Watcher, const char* Path)
+{
+	struct WatchedFile* File;
+	for (File = Watcher->Files; File; File = File->Next)
+	{
+		if (strcmp(File->Path, Path) == 0)
+			return File;
+	}
+	return NULL;
+}
+
+static void ForgetFile(struct Watcher* Watcher, struct WatchedFile* File)
+{
+	struct WatchedFile** Link = &Watcher->Files;
+	while (*Link != File)
+		Link = &(*Link)->Next;
+	*Link = File->Next;
+	free(File->Path);
+	free(File);
+}
+
+/* Notes that something happened to Name in the directory watched by
+ * Wd, putting off handing it over until it's been left alone. */
+static void Touched(struct Watcher* Watcher, int Wd, const char* Name)
+{
+	char* Path;
+	int Track = -1;
+	int i;
+
+	for (i = 0; i < Watcher->NumTracks; i++)
+	{
+		if (Watcher->Tracks[i].Wd == Wd &&
+		    strcmp(Watcher->Tracks[i].Name, Name) == 0)
+		{
+			Track = i;
+			break;
+		}
+	}
+	if (Track >= 0)
+	{
+		Path = strdup(Watcher->Tracks[Track].Path);
+	} else if (Wd == Watcher->PhotoWd) {
+		Path = (char*) malloc(strlen(Watcher->PhotoDir) + strlen(Name) + 2);
+		if (Path)
+			sprintf(Path, "%s/%s", Watcher->PhotoDir, Name);
+	} else {
+		return;
+	}
+	if (!Path)
+		return;
+
+	struct WatchedFile* File = FindFile(Watcher, Path);
+	if (File)
+	{
+		free(Path);
+		if (File->Ignore)
+			return;
+	} else {
+		File = (struct WatchedFile*) calloc(1, sizeof(*File));
+		if (!File)
+		{
+			free(Path);
+			return;
+		}
+		File->Path = Path;
+		File->Next = Watcher->Files;
+		Watcher->Files = File;
+	}
+	File->Track = Track;
+	File->Due = NowMillis() + WATCH_QUIET_MS;
+}
+
+/* Adds a watch on the directory holding File, and returns it. */
+static int WatchDirOf(struct Watcher* Watcher, const char* File)
+{
+	const char* Slash = strrchr(File, '/');
+	char* Dir;
+	int Wd;
+
+	if (!Slash)
+		return inotify_add_watch(Watcher->Fd, ".", WatchMask);
+	Dir = strndup(File, Slash == File ? 1 : (size_t)(Slash - File));
+	if (!Dir)
+		return -1;
+	Wd = inotify_add_watch(Watcher->Fd, Dir, WatchMask);
+	free(Dir);
+	return Wd;
+}
+
+struct Watcher* StartWatcher(const char* PhotoDir, char** TrackFiles, int NumTracks)
+{
+	struct Watcher* Watcher = (struct Watcher*) calloc(1, sizeof(*Watcher));
+	int i;
+
+	if (Watcher)
+		Watcher->Fd = -1;
+	if (!Watcher ||
+	    !(Watcher->Tracks = (struct TrackFile*) calloc(NumTracks + 1, sizeof(struct TrackFile))) ||
+	    !(Watcher->PhotoDir = strdup(PhotoDir)))
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		StopWatcher(Watcher);
+		return NULL;
+	}
+	Watcher->Fd = inotify_init();
+	if (Watcher->Fd < 0)
+	{
+		fprintf(stderr, _("Unable to watch for new files: %s\n"), strerror(errno));
+		StopWatcher(Watcher);
+		return NULL;
+	}
+
+	Watcher->PhotoWd = inotify_add_watch(Watcher->Fd, PhotoDir, WatchMask);
+	if (Watcher->PhotoWd < 0)
+	{
+		fprintf(stderr, _("Unable to watch %s: %s\n"), PhotoDir, strerror(errno));
+		StopWatcher(Watcher);
+		return NULL;
+	}
+
+	/* A track that can't be watched just won't be read again. */
+	Watcher->NumTracks = NumTracks;
+	for (i = 0; i < NumTracks; i++)
+	{
+		const char* Slash = strrchr(TrackFiles[i], '/');
+		Watcher->Tracks[i].Path = TrackFiles[i];
+		Watcher->Tracks[i].Wd = WatchDirOf(Watcher, TrackFiles[i]);
+		Watcher->Tracks[i].Name = Slash ? Slash + 1 : TrackFiles[i];
+	}
+
+	return Watcher;
+}
+
+int NextWatchEvent(struct Watcher* Watcher, const char** File, int* Track)
+{
+	char Buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct WatchedFile* Due;
+	struct WatchedFile* Scan;
+	struct WatchedFile* Next;
+
+	free(Watcher->Current);
+	Watcher->Current = NULL;
+
+	for (;;)
+	{
+		long long Now = NowMillis();
+		int Timeout = -1;
+
+		/* Hand over whatever has been left alone long enough, and
+		 * stop ignoring what we wrote a while ago. */
+		Due = NULL;
+		for (Scan = Watcher->Files; Scan; Scan = Next)
+		{
+			Next = Scan->Next;
+			if (Scan->Due <= Now)
+			{
+				if (Scan->Ignore)
+					ForgetFile(Watcher, Scan);
+				else if (!Due)
+					Due = Scan;
+				continue;
+			}
+			if (Timeout < 0 || Scan->Due - Now < Timeout)
+				Timeout = (int)(Scan->Due - Now);
+		}
+
+		if (Due)
+		{
+			*Track = Due->Track;
+			Watcher->Current = Due->Path;
+			Due->Path = NULL;
+			ForgetFile(Watcher, Due);
+			if (*Track >= 0)
+			{
+				*File = NULL;
+				return WATCH_TRACK;
+			}
+			if (!LooksLikePhoto(Watcher->Current))
+			{
+				free(Watcher->Current);
+				Watcher->Current = NULL;
+				continue;
+			}
+			*File = Watcher->Current;
+			return WATCH_PHOTO;
+		}
+
+		struct pollfd Poll;
+		Poll.fd = Watcher->Fd;
+		Poll.events = POLLIN;
+		int Ready = poll(&Poll, 1, Timeout);
+		if (Ready < 0)
+		{
+			if (errno == EINTR)
+				return WATCH_INTERRUPTED;
+			fprintf(stderr, _("Unable to watch for new files: %s\n"), strerror(errno));
+			return WATCH_FAILED;
+		}
+		if (Ready == 0)
+			continue;
+
+		ssize_t Got = read(Watcher->Fd, Buffer, sizeof(Buffer));
+		if (Got < 0)
+		{
+			if (errno == EINTR)
+				return WATCH_INTERRUPTED;
+			fprintf(stderr, _("Unable to watch for new files: %s\n"), strerror(errno));
+			return WATCH_FAILED;
+		}
+
+		char* Event;
+		for (Event = Buffer; Event < Buffer + Got; )
+		{
+			const struct inotify_event* Info = (const struct inotify_event*) Event;
+			if (Info->len && !(Info->mask & IN_ISDIR))
+				Touched(Watcher, Info->wd, Info->name);
+			if (Info->mask & IN_Q_OVERFLOW)
+				fprintf(stderr, _("Too many new files at once; some were missed.\n"));
+			Event += sizeof(struct inotify_event) + Info->len;
+		}
+	}
+}
+
+void WatchIgnore(struct Watcher* Watcher, const char* File)
+{
+	struct WatchedFile* Entry = FindFile(Watcher, File);
+
+	if (!Entry)
+	{
+		Entry = (struct WatchedFile*) calloc(1, sizeof(*Entry));
+		if (!Entry || !(Entry->Path = strdup(File)))
+		{
+			free(Entry);
+			return;
+		}
+		Entry->Next = Watcher->Files;
+		Watcher->Files = Entry;
+	}
+	Entry->Track = -1;
+	Entry->Ignore = 1;
+	Entry->Due = NowMillis() + WATCH_IGNORE_MS;
+}
+
+void StopWatcher(struct Watcher* Watcher)
+{
+	if (!Watcher)
+		return;
+	while (Watcher->Files)
+		ForgetFile(Watcher, Watcher->Files);
+	if (Watcher->Fd >= 0)
+		close(Watcher->Fd);
+	free(Watcher->Current);
+	free(Watcher->Tracks);
+	free(Watcher->PhotoDir);
+	free(Watcher);
+}
+
+#else
+
+/* No inotify here. */
+
+struct Watcher* StartWatcher(const char* PhotoDir, char** TrackFiles, int NumTracks)
+{
+	fprintf(stderr, _("Watching for new files isn't supported on this system.\n"));
+	return NULL;
+}
+
+int NextWatchEvent(struct Watcher* Watcher, const char** File, int* Track)
+{
+	return WATCH_FAILED;
+}
+
+void WatchIgnore(struct Watcher* Watcher, const char* File)
+{
+}
+
+void StopWatcher(struct Watcher* Watcher)
+{
+}
+
+#endif
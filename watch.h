@@ -0,0 +1,47 @@
+/* watch.h
+ *
+ * This file contains the prototypes for the directory watcher
+ * in watch.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct Watcher;
+
+/* What NextWatchEvent found. */
+#define WATCH_FAILED      0
+#define WATCH_PHOTO       1  /* A new or rewritten photo. */
+#define WATCH_TRACK       2  /* One of the track files changed. */
+#define WATCH_INTERRUPTED 3  /* A signal arrived while waiting. */
+
+/* Starts watching PhotoDir for photos, and the directories holding the
+ * NumTracks TrackFiles for changes to them. TrackFiles must outlive
+ * the watcher. Returns NULL, having said why, on failure. */
+struct Watcher* StartWatcher(const char* PhotoDir, char** TrackFiles, int NumTracks);
+
+/* Waits for something to happen. For WATCH_PHOTO, *File is the photo
+ * and is valid until the next call; for WATCH_TRACK, *Track is the
+ * index of the track file that changed. */
+int NextWatchEvent(struct Watcher* Watcher, const char** File, int* Track);
+
+/* Ignores changes to File for a little while, so photos we have just
+ * written don't come straight back. */
+void WatchIgnore(struct Watcher* Watcher, const char* File);
+
+/* Stops watching and frees everything. */
+void StopWatcher(struct Watcher* Watcher);
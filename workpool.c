@@ -0,0 +1,188 @@
+/* workpool.c
+ *
+ * This file contains a pool of worker threads, for running the same
+ * thing over lots of photos at once. Photos mostly wait on the disk
+ * and on Exiv2, so a few of them in hand together gets through a
+ * big batch much sooner.
+ *
+ * Jobs wait in a simple list until a thread is free. Whoever adds
+ * them decides what a job is and where its results go.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "i18n.h"
+#include "trace.h"
+#include "workpool.h"
+
+#define POOL_MAX_THREADS 32
+
+struct PendingJob {
+	void* Job;
+	struct PendingJob* Next;
+};
+
+struct WorkPool {
+	pthread_mutex_t Lock;
+	pthread_cond_t WorkReady;  /* A job was queued, or the pool is ending. */
+	pthread_cond_t NotFull;    /* Room in the queue. */
+
+	struct PendingJob* First;  /* Jobs waiting to start. */
+	struct PendingJob* Last;
+	int Queued;
+	int MaxQueued;
+	int Finishing;
+
+	WorkFunction Work;
+	void* Data;
+	const char* Name;          /* For the trace. */
+
+	pthread_t* Threads;
+	int NumThreads;
+};
+
+static void* WorkThread(void* Data)
+{
+	struct WorkPool* Pool = (struct WorkPool*) Data;
+
+	TraceThreadName(Pool->Name);
+	pthread_mutex_lock(&Pool->Lock);
+	for (;;)
+	{
+		while (!Pool->First && !Pool->Finishing)
+			pthread_cond_wait(&Pool->WorkReady, &Pool->Lock);
+		if (!Pool->First)
+			break;
+
+		struct PendingJob* Job = Pool->First;
+		Pool->First = Job->Next;
+		if (!Pool->First)
+			Pool->Last = NULL;
+		Pool->Queued--;
+		pthread_cond_signal(&Pool->NotFull);
+		pthread_mutex_unlock(&Pool->Lock);
+
+		Pool->Work(Job->Job, Pool->Data);
+		free(Job);
+
+		pthread_mutex_lock(&Pool->Lock);
+	}
+	pthread_mutex_unlock(&Pool->Lock);
+	return NULL;
+}
+
+struct WorkPool* StartWorkPool(const char* Name, int Threads, int MaxQueued,
+			       WorkFunction Work, void* Data)
+{
+	struct WorkPool* Pool = (struct WorkPool*) calloc(1, sizeof(*Pool));
+	int i;
+
+	if (Threads <= 0)
+	{
+		long Cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		Threads = Cpus > 0 ? (int)Cpus : 2;
+	}
+	if (Threads > POOL_MAX_THREADS)
+		Threads = POOL_MAX_THREADS;
+
+	if (!Pool ||
+	    !(Pool->Threads = (pthread_t*) malloc(Threads * sizeof(pthread_t))))
+	{
+		fprintf(stderr, _("Out of memory\n"));
+		free(Pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&Pool->Lock, NULL);
+	pthread_cond_init(&Pool->WorkReady, NULL);
+	pthread_cond_init(&Pool->NotFull, NULL);
+	Pool->MaxQueued = MaxQueued;
+	Pool->Work = Work;
+	Pool->Data = Data;
+	Pool->Name = Name;
+
+	for (i = 0; i < Threads; i++)
+	{
+		if (pthread_create(&Pool->Threads[i], NULL, WorkThread, Pool) != 0)
+			break;
+		Pool->NumThreads++;
+	}
+	if (!Pool->NumThreads)
+	{
+		fprintf(stderr, _("Unable to start any worker threads.\n"));
+		FinishWorkPool(Pool);
+		return NULL;
+	}
+
+	return Pool;
+}
+
+int AddWork(struct WorkPool* Pool, void* Job)
+{
+	struct PendingJob* Pending = (struct PendingJob*) malloc(sizeof(*Pending));
+	if (!Pending)
+		return 0;
+	Pending->Job = Job;
+	Pending->Next = NULL;
+
+	pthread_mutex_lock(&Pool->Lock);
+	while (Pool->MaxQueued > 0 && Pool->Queued >= Pool->MaxQueued)
+		pthread_cond_wait(&Pool->NotFull, &Pool->Lock);
+	if (Pool->Last)
+		Pool->Last->Next = Pending;
+	else
+		Pool->First = Pending;
+	Pool->Last = Pending;
+	Pool->Queued++;
+	pthread_cond_signal(&Pool->WorkReady);
+	pthread_mutex_unlock(&Pool->Lock);
+	return 1;
+}
+
+int WorkPoolThreads(const struct WorkPool* Pool)
+{
+	return Pool->NumThreads;
+}
+
+void FinishWorkPool(struct WorkPool* Pool)
+{
+	int i;
+
+	if (!Pool)
+		return;
+
+	/* The threads only stop once the queue is empty. */
+	pthread_mutex_lock(&Pool->Lock);
+	Pool->Finishing = 1;
+	pthread_cond_broadcast(&Pool->WorkReady);
+	pthread_mutex_unlock(&Pool->Lock);
+
+	for (i = 0; i < Pool->NumThreads; i++)
+		pthread_join(Pool->Threads[i], NULL);
+
+	pthread_cond_destroy(&Pool->NotFull);
+	pthread_cond_destroy(&Pool->WorkReady);
+	pthread_mutex_destroy(&Pool->Lock);
+	free(Pool->Threads);
+	free(Pool);
+}
@@ -0,0 +1,47 @@
+/* workpool.h
+ *
+ * This file contains the prototypes for the pool of worker
+ * threads in workpool.c.
+ */
+
+/* This file is part of gpscorrelate.
+ *
+ * gpscorrelate is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * gpscorrelate is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with gpscorrelate; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+struct WorkPool;
+
+/* Called on one of the pool's threads for each job added, with the
+ * Data given to StartWorkPool. */
+typedef void (*WorkFunction)(void* Job, void* Data);
+
+/* Starts Threads threads running Work; 0 picks one for each CPU.
+ * With MaxQueued above 0, AddWork waits while that many jobs are
+ * waiting to start. The threads are called Name in a trace; it must
+ * be a string constant. Returns NULL on failure. */
+struct WorkPool* StartWorkPool(const char* Name, int Threads, int MaxQueued,
+			       WorkFunction Work, void* Data);
+
+/* Queues Job for the next free thread. Jobs start in the order they
+ * were added, but may finish in any order. Returns 0 if it couldn't
+ * be queued. */
+int AddWork(struct WorkPool* Pool, void* Job);
+
+/* Returns the number of threads in the pool. */
+int WorkPoolThreads(const struct WorkPool* Pool);
+
+/* Waits for every job added to be done, then stops the threads and
+ * frees everything. */
+void FinishWorkPool(struct WorkPool* Pool);